@@ -0,0 +1,186 @@
+/*
+
+Runtime factory for the compile time demod pipelines.
+Each option is one level of template dispatch, the leaf
+returns the address of the instantiation it reached.  The
+constants are the values the usual rates give, any other
+takes the instantiation that reads it from the state.
+
+*/
+
+#include "DspPipeline.hh"
+
+//
+// Front
+//
+
+template <class Demod, bool Perf>
+static DspPipelineFn pick_decimator(const struct demod_state* d) {
+
+    if (d->downsample_passes) {
+        return &Front<HalfbandDecimator, Demod, Perf>::run;
+    }
+    // 1000000 / rate_in + 1, wbfm is 6, nbfm at 48, 32 and 24 kHz 21, 32, 42
+    switch (d->downsample) {
+        case 2:
+            return &Front<BoxcarDecimator<2>, Demod, Perf>::run;
+        case 3:
+            return &Front<BoxcarDecimator<3>, Demod, Perf>::run;
+        case 4:
+            return &Front<BoxcarDecimator<4>, Demod, Perf>::run;
+        case 5:
+            return &Front<BoxcarDecimator<5>, Demod, Perf>::run;
+        case 6:
+            return &Front<BoxcarDecimator<6>, Demod, Perf>::run;
+        case 21:
+            return &Front<BoxcarDecimator<21>, Demod, Perf>::run;
+        case 32:
+            return &Front<BoxcarDecimator<32>, Demod, Perf>::run;
+        case 42:
+            return &Front<BoxcarDecimator<42>, Demod, Perf>::run;
+        default:
+            return &Front<BoxcarDecimator<0>, Demod, Perf>::run;
+    }
+}
+
+template <bool Perf>
+static DspPipelineFn pick_front(const struct demod_state* d) {
+
+    if (d->mode_demod == &fm_demod) {
+        switch (d->custom_atan) {
+            case 1:
+                return pick_decimator<FmDemod<&fm_disc_fast>, Perf>(d);
+            case 2:
+                return pick_decimator<FmDemod<&fm_disc_lut>, Perf>(d);
+            case 3:
+                return pick_decimator<DispatchedFmDemod, Perf>(d);
+            default:
+                return pick_decimator<FmDemod<&fm_disc_std>, Perf>(d);
+        }
+    }
+    if (d->mode_demod == &am_demod) {
+        return pick_decimator<PlainDemod<&am_demod>, Perf>(d);
+    }
+    if (d->mode_demod == &usb_demod) {
+        return pick_decimator<PlainDemod<&usb_demod>, Perf>(d);
+    }
+    if (d->mode_demod == &lsb_demod) {
+        return pick_decimator<PlainDemod<&lsb_demod>, Perf>(d);
+    }
+    if (d->mode_demod == &raw_demod) {
+        return pick_decimator<PlainDemod<&raw_demod>, Perf>(d);
+    }
+    return NULL;
+}
+
+//
+// Taps
+//
+
+template <bool Rds, bool Post, bool Perf>
+static DspPipelineFn pick_squelch(const struct demod_state* d) {
+
+    if (d->squelch_level > 0) {
+        return &Taps<Rds, Post, true, Perf>::run;
+    }
+    return &Taps<Rds, Post, false, Perf>::run;
+}
+
+template <bool Rds, bool Perf>
+static DspPipelineFn pick_post(const struct demod_state* d) {
+
+    if (d->post_downsample > 1) {
+        return pick_squelch<Rds, true, Perf>(d);
+    }
+    return pick_squelch<Rds, false, Perf>(d);
+}
+
+template <bool Perf>
+static DspPipelineFn pick_taps(const struct demod_state* d) {
+
+    if (d->rds) {
+        return pick_post<true, Perf>(d);
+    }
+    return pick_post<false, Perf>(d);
+}
+
+//
+// Audio
+//
+
+template <int Deemph, bool DcBlock, bool Perf>
+static DspPipelineFn pick_resample(const struct demod_state* d) {
+
+    if (d->rate_out2 > 0) {
+        return &AudioSegment<MonoAudio<Deemph, DcBlock, true>, Perf>::run;
+    }
+    return &AudioSegment<MonoAudio<Deemph, DcBlock, false>, Perf>::run;
+}
+
+template <int Deemph, bool Perf>
+static DspPipelineFn pick_dc_block(const struct demod_state* d) {
+
+    if (d->dc_block) {
+        return pick_resample<Deemph, true, Perf>(d);
+    }
+    return pick_resample<Deemph, false, Perf>(d);
+}
+
+template <bool Perf>
+static DspPipelineFn pick_deemph(const struct demod_state* d) {
+
+    // 1 / (1 - exp(-1 / (rate_out * 75 us))), 24 kHz out is 2,
+    // 32 kHz 3, 48 kHz 4, wbfm 13
+    switch (d->deemph_a) {
+        case 2:
+            return pick_dc_block<2, Perf>(d);
+        case 3:
+            return pick_dc_block<3, Perf>(d);
+        case 4:
+            return pick_dc_block<4, Perf>(d);
+        case 13:
+            return pick_dc_block<13, Perf>(d);
+        default:
+            return pick_dc_block<-1, Perf>(d);
+    }
+}
+
+template <bool Perf>
+static DspPipelineFn pick_audio(const struct demod_state* d) {
+
+    if (d->stereo) {
+        return &AudioSegment<StereoAudio, Perf>::run;
+    }
+    if (d->deemph) {
+        return pick_deemph<Perf>(d);
+    }
+    return pick_dc_block<0, Perf>(d);
+}
+
+template <bool Perf>
+static int pick_segments(const struct demod_state* d, DspPipelineFn* segments) {
+
+    segments[0] = pick_front<Perf>(d);
+    if (!segments[0]) {
+        return 0;
+    }
+    if (d->mode_demod == &raw_demod) {
+        // Nothing runs after the demodulator
+        return 1;
+    }
+    segments[1] = pick_taps<Perf>(d);
+    segments[2] = pick_audio<Perf>(d);
+    return 3;
+}
+
+int dsp_pipeline_select(const struct demod_state* d, DspPipelineFn* segments) {
+
+    int i;
+    for (i = 0; i < DSP_SEGMENTS; i++) {
+        segments[i] = NULL;
+    }
+    if (d->perf_on) {
+        return pick_segments<true>(d, segments);
+    }
+    return pick_segments<false>(d, segments);
+}
@@ -0,0 +1,229 @@
+/*
+
+Demod pipelines composed from the rtl_fm_lib stages at
+compile time.  The chain is cut in three segments, the
+front (decimator, demodulator), the taps on the demodulated
+signal (RDS, post FIR, squelch) and the audio.  Each option,
+-E perf included, is a template argument of the segment it
+belongs to, so none is tested per block in full_demod() or
+per sample in a stage, and the boxcar factor and the
+de-emphasis divisor are constants the compiler unrolls and
+divides by.  Three segments keep the instantiations to a few
+hundred where one graph would need thousands.
+
+*/
+
+#ifndef __DSP_PIPELINE_HH__
+#define __DSP_PIPELINE_HH__
+
+#include "rtl_fm_lib.h"
+
+typedef void (*DspPipelineFn)(struct demod_state* d);
+
+//
+// Decimators, lowpassed -> lowpassed
+//
+
+// low_pass() with the factor a constant, 0 takes it from the state.
+// Bit-exact with it, the state is the same running sum, but a whole
+// period is summed without storing it back on each sample.
+template <int Factor>
+struct BoxcarDecimator {
+    static void run(struct demod_state* d) {
+        const int ds = Factor ? Factor : d->downsample;
+        int16_t* lp = d->lowpassed;
+        int len = d->lp_len;
+        int i = 0, i2 = 0, k = d->prev_index, n, r = d->now_r, j = d->now_j, sr, sj;
+        // finish the period the last block left open
+        while (k && i < len) {
+            r += lp[i];
+            j += lp[i + 1];
+            i += 2;
+            if (++k < ds) {
+                continue;
+            }
+            lp[i2] = r;
+            lp[i2 + 1] = j;
+            i2 += 2;
+            k = r = j = 0;
+        }
+        for (; len - i >= 2 * ds; i += 2 * ds, i2 += 2) {
+            sr = sj = 0;
+            for (n = 0; n < ds; n++) {
+                sr += lp[i + 2 * n];
+                sj += lp[i + 2 * n + 1];
+            }
+            lp[i2] = sr;
+            lp[i2 + 1] = sj;
+        }
+        // the start of the next one
+        for (; i < len; i += 2, k++) {
+            r += lp[i];
+            j += lp[i + 1];
+        }
+        d->prev_index = k;
+        d->now_r = r;
+        d->now_j = j;
+        d->lp_len = i2;
+    }
+};
+
+struct HalfbandDecimator {
+    static void run(struct demod_state* d) {
+        d->lp_len = halfband_decimate(&d->hb, d->lowpassed, d->lp_len);
+    }
+};
+
+//
+// Demodulators, lowpassed -> result
+//
+
+// The discriminator is a template argument, a direct call
+template <fm_disc_fn Disc>
+struct FmDemod {
+    static void run(struct demod_state* d) {
+        int16_t* lp = d->lowpassed;
+        Disc(lp, d->lp_len, d->pre_r, d->pre_j, d->result);
+        d->pre_r = lp[d->lp_len - 2];
+        d->pre_j = lp[d->lp_len - 1];
+        d->result_len = d->lp_len / 2;
+    }
+};
+
+// -A simd, the kernel depends on the cpu so it stays a pointer,
+// picked once by fm_disc_select()
+struct DispatchedFmDemod {
+    static void run(struct demod_state* d) {
+        fm_demod(d);
+    }
+};
+
+template <void (*Demod)(struct demod_state*)>
+struct PlainDemod {
+    static void run(struct demod_state* d) {
+        Demod(d);
+    }
+};
+
+//
+// Audio, result -> result
+//
+
+// deemph_filter() with the divisor a constant, 0 is off and -1
+// takes it from the state
+template <int Divisor>
+static inline void deemph(struct demod_state* d) {
+    int16_t* buf = d->result;
+    int avg = d->deemph_avg;
+    int i, x;
+    if (Divisor < 0) {
+        deemph_filter(d, d->result, d->result_len);
+        return;
+    }
+    for (i = 0; i < d->result_len; i++) {
+        x = buf[i] - avg;
+        if (x > 0) {
+            avg += (x + Divisor / 2) / Divisor;
+        } else {
+            avg += (x - Divisor / 2) / Divisor;
+        }
+        buf[i] = (int16_t)avg;
+    }
+    d->deemph_avg = avg;
+}
+
+template <int Deemph, bool DcBlock, bool Resample>
+struct MonoAudio {
+    static void run(struct demod_state* d) {
+        if (Deemph) {
+            deemph<Deemph>(d);
+        }
+        if (DcBlock) {
+            dc_block_filter(d);
+        }
+        if (Resample) {
+            d->result_len = resample_process(&d->audio_rs, d->result, d->result_len, MAXIMUM_BUF_LENGTH);
+        }
+    }
+};
+
+struct StereoAudio {
+    static void run(struct demod_state* d) {
+        d->result_len = stereo_process(&d->stereo_dec, d->result, d->result_len, MAXIMUM_BUF_LENGTH);
+    }
+};
+
+//
+// The segments, in the order full_demod() runs the stages.
+// Perf false leaves out the marks, not only their branch.
+//
+
+template <class Decimator, class Demod, bool Perf>
+struct Front {
+    static void run(struct demod_state* d) {
+        int n = d->lp_len / 2;
+        Decimator::run(d);
+        if (Perf) {
+            PERF_MARK(d->perf, PERF_DECIMATE, n);
+        }
+        n = d->lp_len / 2;
+        Demod::run(d);
+        if (Perf) {
+            PERF_MARK(d->perf, PERF_DEMOD, n);
+        }
+    }
+};
+
+template <bool Rds, bool Post, bool Squelch, bool Perf>
+struct Taps {
+    static void run(struct demod_state* d) {
+        int n = d->result_len;
+        if (Rds) {
+            rds_process(&d->rds_dec, d->result, d->result_len);
+            if (Perf) {
+                PERF_MARK(d->perf, PERF_RDS, n);
+            }
+        }
+        if (Post) {
+            d->result_len = fir_process(&d->post_fir, d->result, d->result_len);
+            if (Perf) {
+                PERF_MARK(d->perf, PERF_POST_FIR, n);
+            }
+        }
+        if (Squelch) {
+            squelch(d, d->result, d->result_len);
+            if (Perf) {
+                PERF_MARK(d->perf, PERF_SQUELCH, d->result_len);
+            }
+        }
+    }
+};
+
+// d->squelched is what the squelch found in this block, not an option
+template <class Audio, bool Perf>
+struct AudioSegment {
+    static void run(struct demod_state* d) {
+        int n = d->result_len;
+        Audio::run(d);
+        if (d->squelched) {
+            memset(d->result, 0, 2 * d->result_len);
+        }
+        if (Perf) {
+            PERF_MARK(d->perf, PERF_AUDIO, n);
+        }
+    }
+};
+
+/*!
+ * Pick the segments that match the options, call once the boxcar
+ * factor and the de-emphasis divisor are set, after optimal_settings()
+ *
+ * \param d demod state with the options set
+ * \param segments DSP_SEGMENTS entries, run in turn up to the first NULL
+ * \return the segments picked, 0 if the mode has none (full_demod() then
+ *         runs the stages itself)
+ */
+
+extern int dsp_pipeline_select(const struct demod_state* d, DspPipelineFn* segments);
+
+#endif
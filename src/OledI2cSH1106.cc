@@ -1,5 +1,6 @@
 
 #include "OledI2cSH1106.hh"
+#include "rtl_fm_trace.h"
 
 OledI2cSH1106::OledI2cSH1106() :
     m_display(-1) {
@@ -40,14 +41,18 @@ void OledI2cSH1106::lcdLoc(int line) {
 
 void OledI2cSH1106::clrLcd(void) {
 
+  TRACE_BEGIN("display clear");
   m_display.clear();
+  TRACE_END("display clear");
 }
 
 // this allows use of any size string
 void OledI2cSH1106::typeln(const char *s) {
 
+  TRACE_BEGIN("display write");
   m_display.clear();
   m_display.printFixed(0, 16, s, STYLE_NORMAL);
+  TRACE_END("display write");
 }
 
 void OledI2cSH1106::typeChar(char val) {
@@ -57,3 +62,16 @@ void OledI2cSH1106::typeChar(char val) {
   buffer[0] = val;
   typeln(buffer);
 }
+
+void OledI2cSH1106::typeSmall(int y, const char *s) {
+
+  // pad to the full width so the previous text is overwritten
+  char buffer[SMALL_LINE_CHARS + 1];
+  snprintf(buffer, sizeof(buffer), "%-*s", SMALL_LINE_CHARS, s);
+
+  TRACE_BEGIN("display write");
+  m_display.setFixedFont(ssd1306xled_font6x8);
+  m_display.printFixed(0, y, buffer, STYLE_NORMAL);
+  m_display.setFixedFont(comic_sans_font24x32_123);
+  TRACE_END("display write");
+}
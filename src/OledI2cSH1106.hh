@@ -12,6 +12,11 @@
 
 #define LINE1  0x80 // 1st line - copied from LcdI2cHD44780.hh for now
 
+// 6x8 text rows above and below the frequency
+#define SMALL_ROW_TOP     0
+#define SMALL_ROW_BOTTOM  56
+#define SMALL_LINE_CHARS  21
+
 class OledI2cSH1106 {
 
 public:
@@ -28,6 +33,7 @@ public:
     void clrLcd(void); // clr LCD return home
     void typeln(const char *s);
     void typeChar(char val);
+    void typeSmall(int y, const char *s); // one row of small text, leaves the rest alone
 
 protected:
 
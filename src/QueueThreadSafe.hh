@@ -3,6 +3,8 @@
 #include <queue>
 #include <chrono>
 
+#include "rtl_fm_log.h"
+
 using namespace std::chrono_literals;
   
 // Thread-safe queue
@@ -48,7 +50,7 @@ public:
             if (stat == false) {
 
                 // A timeout occured
-                //fprintf(stderr, "QueueThreadSafe.pop : wait timeout\n");
+                //LOG_DEBUG("QueueThreadSafe.pop : wait timeout");
 
                 continue;
             }
@@ -60,12 +62,30 @@ public:
             // return item
             return item;
         }
-        fprintf(stderr, "QueueThreadSafe.pop : exiting\n");
+        LOG_INFO("QueueThreadSafe.pop : exiting");
 
         T item;
         return item;
     }
 
+    // Pops an element off the queue, gives up after timeout
+    // so the caller can get on with something else
+    bool pop_for(T& item, std::chrono::milliseconds timeout) {
+
+        // acquire lock
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if (!m_cond.wait_for( lock, timeout, [this]() { return !m_queue.empty(); } )) {
+            return false;
+        }
+
+        // retrieve item
+        item = m_queue.front();
+        m_queue.pop();
+
+        return true;
+    }
+
 private:
 
     // Termination flag
@@ -19,11 +19,15 @@ Jeff McLane <jkmclane68@yahoo.com>
 //#include "LcdI2cHD44780.hh"
 #include "OledI2cSH1106.hh"
 #include "rtl_fm_lib.h"
+#include "rtl_fm_bench.h"
+#include "DspPipeline.hh"
 #include "RadioControlMain.hh"
 
 RadioControlMain::RadioControlMain() :
     m_rotary_encoder(NULL),
-    m_tune_queue(NULL)
+    m_tune_queue(NULL),
+    m_rds_seq(0),
+    m_rt_scroll(0)
 {
 }
 
@@ -91,10 +95,53 @@ bool RadioControlMain::init() {
     return true;
 }
 
+void RadioControlMain::update_rds_display() {
+
+    struct rds_info info;
+    char line[SMALL_LINE_CHARS + 1];
+
+    // Lock free, the demod thread never waits on the display
+    unsigned int seq = rds_snapshot(&demod.rds_dec, &info);
+
+    if (seq != m_rds_seq) {
+        m_rds_seq = seq;
+        snprintf(line, sizeof(line), "%s", info.ps);
+        m_lcd.typeSmall(SMALL_ROW_TOP, line);
+    }
+
+    // RadioText is up to 64 characters, scroll it through the bottom row
+    int len = RDS_RT_LEN;
+    while (len > 0 && info.rt[len - 1] == ' ') {
+        --len;
+    }
+    if (len <= SMALL_LINE_CHARS) {
+        m_rt_scroll = 0;
+        m_lcd.typeSmall(SMALL_ROW_BOTTOM, info.rt);
+        return;
+    }
+    m_rt_scroll = (m_rt_scroll + 1) % (len + 3);
+    for (int ii=0; ii<SMALL_LINE_CHARS; ++ii) {
+        int jj = (m_rt_scroll + ii) % (len + 3);
+        line[ii] = (jj < len) ? info.rt[jj] : ' ';
+    }
+    line[SMALL_LINE_CHARS] = '\0';
+    m_lcd.typeSmall(SMALL_ROW_BOTTOM, line);
+}
+
 void RadioControlMain::wait_for_frequency_change() {
 
-    fprintf(stderr, "RadioControlMain::wait_for_frequency_change : waiting to pop\n");
-    RotaryEncoderEvent::RotaryStates rs = m_tune_queue->pop();
+    RotaryEncoderEvent::RotaryStates rs;
+
+    if (demod.rds) {
+        // Keep the RDS text current while the dial is idle
+        if (!m_tune_queue->pop_for(rs, std::chrono::milliseconds(RDS_REFRESH_MS))) {
+            update_rds_display();
+            return;
+        }
+    } else {
+        fprintf(stderr, "RadioControlMain::wait_for_frequency_change : waiting to pop\n");
+        rs = m_tune_queue->pop();
+    }
     fprintf(stderr, "RadioControlMain::wait_for_frequency_change : popped %d\n", rs);
 
     switch(rs) {
@@ -133,10 +180,18 @@ void RadioControlMain::wait_for_frequency_change() {
     //m_lcd.typeln("RF (MHz): ");
     m_lcd.typeFloat(m_fm_center_freqs_MHz[m_stn_idx]);
 
+    // In the RDS decoder, the old station's text must not linger
+    if (demod.rds) {
+        rds_reset(&demod.rds_dec);
+        m_rt_scroll = 0;
+    }
+
     // In the RTL-SDR dongle
     int freq_Hz = (int) (m_fm_center_freqs_MHz[m_stn_idx] * 1e6);
+    TRACE_BEGIN("retune");
     optimal_settings(freq_Hz, demod.rate_in);
     verbose_set_frequency(dongle.dev, dongle.freq);
+    TRACE_END("retune");
 
     return;
 }
@@ -169,13 +224,29 @@ void usage(void)
                 "\t    ranges supported, -f 118M:137M:25k\n"
                 "\t[-M modulation (default: fm)]\n"
                 "\t    fm, wbfm, raw, am, usb, lsb\n"
-                "\t    wbfm == -M fm -s 170k -o 4 -A fast -r 32k -l 0 -E deemp\n"
+                "\t    wbfm == -M fm -s 170k -o 4 -A simd -r 32k -l 0 -E deemp\n"
                 "\t    raw mode outputs 2x16 bit IQ pairs\n"
                 "\t[-s sample_rate (default: 24k)]\n"
                 "\t[-d device_index (default: 0)]\n"
                 "\t[-T enable bias-T on GPIO PIN 0 (works for rtl-sdr.com v3 dongles)]\n"
+                "\t[-B run the DSP benchmarks on generated data and exit]\n"
+                "\t[-D alsa_device, play through ALSA instead of the filename]\n"
+                "\t    mmap at the card's own format, e.g. hw:audioinjectorpi\n"
+                "\t[-P alsa_period[:alsa_buffer] in frames (default: 1024:4096)]\n"
+                "\t[-L alsa_latency in ms, held against clock drift (default: 40, 0/off)]\n"
+                "\t[-S name, counters and gauges in /dev/shm/name, a text\n"
+                "\t    snapshot to each connection on /tmp/name.sock]\n"
+                "\t[-X trace.json, timeline of the usb callback, demod, writes,\n"
+                "\t    retunes and display, written on kill -USR2 and at exit]\n"
+                "\t[-Q seconds, on kill -USR1 sample the pipeline threads that\n"
+                "\t    long, stacks folded for a flame graph in /tmp]\n"
+                "\t[-R realtime profile, stage=prio[@cpu],... or default]\n"
+                "\t    SCHED_FIFO priority and cpu per thread, stages dongle,\n"
+                "\t    demod, output, controller, worker; locks memory and\n"
+                "\t    prints each thread's wake-up latency at exit\n"
                 "\t[-g tuner_gain (default: automatic)]\n"
                 "\t[-l squelch_level (default: 0/off)]\n"
+                "\t    mutes while the noise power above the audio band exceeds it\n"
                 //"\t    for fm squelch is inverted\n"
                 //"\t[-o oversampling (default: 1, 4 recommended)]\n"
                 "\t[-p ppm_error (default: 0)]\n"
@@ -186,15 +257,39 @@ void usage(void)
                 "\t    deemp:  enable de-emphasis filter\n"
                 "\t    direct: enable direct sampling\n"
                 "\t    offset: enable offset tuning\n"
+                "\t    stereo: decode the 19k pilot and 38k L-R, needs -M wbfm,\n"
+                "\t            outputs interleaved L/R at the -r rate\n"
+                "\t    rds:    decode station name and RadioText onto the display,\n"
+                "\t            needs -M wbfm\n"
+                "\t    fused:  run the fm chain a tile at a time instead of a\n"
+                "\t            stage at a time over the block, off by default,\n"
+                "\t            on x86 no faster; -B shows which is faster here\n"
+                "\t    float:  run the fm chain in float32, for the Pi 2/3/4,\n"
+                "\t            on x86 some 0.6x the int16 speed but a cleaner\n"
+                "\t            boxcar; -B shows which of the two is faster here\n"
+                "\t    parallel: decimate and demodulate each block on all\n"
+                "\t            cores, the same output as one core\n"
+                "\t    perf:   count cycles, instructions, cache and branch misses\n"
+                "\t            of each demod stage, IPC and misses per sample at exit\n"
+                "\t    verbose: also log the debug lines (encoder, power)\n"
+                "\t    testmode: run on the dongle's test counter, report the\n"
+                "\t            samples the usb dropped and the gaps at exit\n"
+                "\t    testsweep: read the test counter at each rate up to\n"
+                "\t            3.2M and exit with the highest that dropped none\n"
                 "\tfilename ('-' means stdout)\n"
                 "\t    omitting the filename also uses stdout\n\n"
                 "Experimental options:\n"
                 "\t[-r resample_rate (default: none / same as -s)]\n"
+                "\t    polyphase, use a rate the sound card runs natively\n"
+                "\t    (32k, 44.1k, 48k) so aplay needs no plughw: conversion\n"
                 "\t    +values will mute/scan, -values will exit\n"
                 "\t[-F fir_size (default: off)]\n"
-                "\t    enables low-leakage downsample filter\n"
-                "\t    size can be 0 or 9.  0 has bad roll off\n"
-                "\t[-A std/fast/lut choose atan math (default: std)]\n"
+                "\t    enables the half-band decimator cascade\n"
+                "\t    size of the last stage, 7 to 31 taps (0: 19)\n"
+                "\t[-A std/fast/lut/simd choose atan math (default: std)]\n"
+                "\t    simd uses NEON/SSE2/AVX2 when the cpu has them, else fast\n"
+                "\t    lut is the most accurate, slower than fast on x86 and not\n"
+                "\t    timed on the Pi; -B shows which is faster here\n"
                 //"\t[-C clip_path (default: off)\n"
                 //"\t (create time stamped raw clips, requires squelch)\n"
                 //"\t (path must have '\%s' and will expand to date_time_freq)\n"
@@ -223,8 +318,16 @@ int main(int argc, char **argv)
     int dev_given = 0;
     int custom_ppm = 0;
     int enable_biastee = 0;
-
-    while ((opt = getopt(argc, argv, "d:f:g:s:b:l:o:t:r:p:E:F:A:M:hT")) != -1) {
+    int benchmark = 0;
+    int test_sweep = 0;
+    const char *alsa_device = NULL;
+    unsigned int alsa_period = 0, alsa_buffer = 0;
+    unsigned int alsa_latency = ALSA_LATENCY_MS;
+    const char *metrics_name = NULL;
+    const char *trace_name = NULL;
+    int prof_secs = 0;
+
+    while ((opt = getopt(argc, argv, "d:f:g:s:b:l:o:t:r:p:E:F:A:M:R:D:P:L:S:X:Q:hTB")) != -1) {
         switch (opt) {
         case 'd':
             dongle.dev_index = verbose_device_search(optarg);
@@ -283,6 +386,34 @@ int main(int argc, char **argv)
             if (strcmp("offset",  optarg) == 0) {
                 dongle.offset_tuning = 1;
             }
+            if (strcmp("stereo",  optarg) == 0) {
+                demod.stereo = 1;
+            }
+            if (strcmp("rds",  optarg) == 0) {
+                demod.rds = 1;
+            }
+            if (strcmp("fused",  optarg) == 0) {
+                demod.fused = 1;
+            }
+            if (strcmp("float",  optarg) == 0) {
+                demod.fp = 1;
+            }
+            if (strcmp("parallel",  optarg) == 0) {
+                // the demod thread is one of them
+                demod.workers = sysconf(_SC_NPROCESSORS_ONLN);
+            }
+            if (strcmp("perf",  optarg) == 0) {
+                demod.perf_on = 1;
+            }
+            if (strcmp("verbose",  optarg) == 0) {
+                log_level = LOG_LEVEL_DEBUG;
+            }
+            if (strcmp("testmode",  optarg) == 0) {
+                dongle.testmode = 1;
+            }
+            if (strcmp("testsweep",  optarg) == 0) {
+                test_sweep = 1;
+            }
             break;
         case 'F':
             demod.downsample_passes = 1;  /* truthy placeholder */
@@ -299,6 +430,9 @@ int main(int argc, char **argv)
                 atan_lut_init();
                 demod.custom_atan = 2;
             }
+            if (strcmp("simd", optarg) == 0) {
+                demod.custom_atan = 3;
+            }
             break;
         case 'M':
             if (strcmp("fm",  optarg) == 0) {
@@ -322,7 +456,7 @@ int main(int argc, char **argv)
                 demod.rate_in = 170000;
                 demod.rate_out = 170000;
                 demod.rate_out2 = 32000;
-                demod.custom_atan = 1;
+                demod.custom_atan = 3;
                 //demod.post_downsample = 4;
                 demod.deemph = 1;
             }
@@ -330,6 +464,36 @@ int main(int argc, char **argv)
         case 'T':
             enable_biastee = 1;
             break;
+        case 'B':
+            benchmark = 1;
+            break;
+        case 'D':
+            alsa_device = optarg;
+            break;
+        case 'P':
+            if (sscanf(optarg, "%u:%u", &alsa_period, &alsa_buffer) < 1) {
+                fprintf(stderr, "Bad -P period[:buffer]: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'L':
+            alsa_latency = (unsigned int)atoi(optarg);
+            break;
+        case 'S':
+            metrics_name = optarg;
+            break;
+        case 'X':
+            trace_name = optarg;
+            break;
+        case 'Q':
+            prof_secs = atoi(optarg);
+            break;
+        case 'R':
+            if (rt_parse(&rt, optarg) < 0) {
+                fprintf(stderr, "Bad -R profile: %s\n", optarg);
+                exit(1);
+            }
+            break;
         case 'h':
         default:
             usage();
@@ -337,6 +501,13 @@ int main(int argc, char **argv)
         }
     }
 
+    fm_disc_select(&demod);
+
+    if (benchmark) {
+        exit(dsp_benchmark());
+    }
+    demod.verbose = 1;
+
     /* quadruple sample_rate to limit to ��θto ��/2 */
     demod.rate_in *= demod.post_downsample;
 
@@ -354,6 +525,17 @@ int main(int argc, char **argv)
     int lcm_post[17] = {1,1,1,3,1,5,3,7,1,9,5,11,3,13,7,15,1};
     ACTUAL_BUF_LENGTH = lcm_post[demod.post_downsample] * DEFAULT_BUF_LENGTH;
 
+    if (alsa_device && alsa_latency && !dongle.buf_len) {
+        // librtlsdr's 256 KB transfers arrive 128 ms apart at 1 MS/s, far
+        // coarser than the delay held, the demod's own blocks are 8 ms
+        dongle.buf_len = ACTUAL_BUF_LENGTH;
+    }
+
+    if (rings_init() < 0) {
+        fprintf(stderr, "Failed to allocate the sample rings.\n");
+        exit(1);
+    }
+
     if (!dev_given) {
         char* dev = (char*) malloc(2);
         strcpy(dev, "0");
@@ -388,6 +570,37 @@ int main(int argc, char **argv)
         fprintf(stderr, "activated bias-T on GPIO PIN 0\n");
     }
 
+    if (test_sweep) {
+        // only the dongle, none of the radio is started
+        r = testmode_sweep(dongle.dev, dongle.buf_num, dongle.buf_len);
+        rtlsdr_close(dongle.dev);
+        exit(r > 0 ? 0 : 1);
+    }
+
+    // first, every thread started after it leaves SIGUSR2 to the dump thread
+    if (trace_name && trace_open(trace_name) < 0) {
+        exit(1);
+    }
+
+    // the same for SIGUSR1 and the sampler thread; the dump thread is
+    // older but blocks every signal, it never takes a SIGUSR1 either
+    if (prof_secs > 0 && prof_open(prof_secs) < 0) {
+        exit(1);
+    }
+
+    if (metrics_name && metrics_open(metrics_name) < 0) {
+        exit(1);
+    }
+
+    // before the threads that log, it writes their lines for them
+    log_open();
+
+    if (rt.enabled) {
+        // before the display and encoder threads, they inherit the controller's cpu
+        rt_lock_memory();
+        rt_enter(RT_CONTROLLER);
+    }
+
     // NEW -- Create and initialize the Radio Controller
 
     RadioControlMain rcm;
@@ -397,9 +610,22 @@ int main(int argc, char **argv)
 
     sanity_checks();
 
+    // the boxcar factor is set by rcm.init() and the de-emphasis
+    // divisor after the open, both are constants of the pipeline
+    dsp_pipeline_select(&demod, demod.pipeline);
+
     verbose_ppm_set(dongle.dev, dongle.ppm_error);
 
-    if (strcmp(output.filename, "-") == 0) { /* Write samples to stdout */
+    if (alsa_device) {
+        // the rate the audio stages end at, iq pairs for raw
+        r = alsa_sink_open(&output.alsa, alsa_device,
+                           demod.rate_out2 > 0 && demod.mode_demod != &raw_demod ? demod.rate_out2 : demod.rate_out,
+                           demod.stereo || demod.mode_demod == &raw_demod ? 2 : 1,
+                           alsa_period, alsa_buffer, alsa_latency);
+        if (r < 0) {
+            exit(1);
+        }
+    } else if (strcmp(output.filename, "-") == 0) { /* Write samples to stdout */
         output.file = stdout;
 #ifdef _WIN32
         _setmode(_fileno(output.file), _O_BINARY);
@@ -412,7 +638,10 @@ int main(int argc, char **argv)
         }
     }
 
-    //r = rtlsdr_set_testmode(dongle.dev, 1);
+    if (dongle.testmode) {
+        // checked transfer by transfer in rtlsdr_callback()
+        rtlsdr_set_testmode(dongle.dev, 1);
+    }
 
     /* Reset endpoint before we start reading from it (mandatory) */
     verbose_reset_buffer(dongle.dev);
@@ -450,20 +679,25 @@ int main(int argc, char **argv)
 
     //rtlsdr_cancel_async(dongle.dev); // this redundant invocation was removed from sighandler()
     rtlsdr_cancel_async(dongle.dev);
+    rings_close();
     pthread_join(dongle.thread, NULL);
-    safe_cond_signal(&demod.ready, &demod.ready_m);
     pthread_join(demod.thread, NULL);
-    safe_cond_signal(&output.ready, &output.ready_m);
     pthread_join(output.thread, NULL);
     safe_cond_signal(&controller.hop, &controller.hop_m);
     pthread_join(controller.thread, NULL);
 
+    log_close();
+    rings_report();
+    metrics_close();
+    trace_close();
+    prof_close();
+
     //dongle_cleanup(&dongle);
     demod_cleanup(&demod);
     output_cleanup(&output);
     controller_cleanup(&controller);
 
-    if (output.file != stdout) {
+    if (output.file && output.file != stdout) {
         fclose(output.file);
     }
 
@@ -37,6 +37,8 @@ private:
     static void sighandler(int signum);
     #endif
 
+    void update_rds_display();
+
     QueueThreadSafe<RotaryEncoderEvent::RotaryStates>* m_tune_queue;
 
     RotaryEncoderEvent*  m_rotary_encoder;
@@ -50,5 +52,11 @@ private:
     double m_fm_center_freqs_MHz[NUM_FM_FREQS];
 
     int m_stn_idx;
+
+    // RDS text on the display, redrawn between dial events
+    static const int RDS_REFRESH_MS = 400;
+
+    unsigned int m_rds_seq;
+    int m_rt_scroll;
 };
 
@@ -18,6 +18,7 @@ Jeff McLane <jkmclane68@yahoo.com>
 #include <unistd.h>
 #include <sys/signalfd.h>
 
+#include "rtl_fm_log.h"
 #include "QueueThreadSafe.hh"
 #include "RotaryEncoderEvent.hh"
 
@@ -136,16 +137,17 @@ void RotaryEncoderEvent::event_print_human_readable(unsigned int offset,
                                                     int event_type,
                                                     const struct timespec& now_ts)
 {
-    char evname[32];
+    // a literal, the logger formats it later
+    const char* evname;
 
     if (event_type == GPIOD_CTXLESS_EVENT_CB_RISING_EDGE)
-        strcpy(evname, " RISING EDGE");
+        evname = " RISING EDGE";
     else
-        strcpy(evname, "FALLING EDGE");
+        evname = "FALLING EDGE";
 
-    fprintf(stderr, "event: %s offset: %u Event Generated Time (MONOTONIC) : [%8ld.%09ld]  : Event Handled Time (MONOTONIC) : [%8ld.%09ld]\n",
-           evname, offset, ts->tv_sec, ts->tv_nsec,
-           now_ts.tv_sec, now_ts.tv_nsec);
+    LOG_DEBUG("event: %s offset: %u Event Generated Time (MONOTONIC) : [%8ld.%09ld]  : Event Handled Time (MONOTONIC) : [%8ld.%09ld]",
+           evname, offset, (long)ts->tv_sec, ts->tv_nsec,
+           (long)now_ts.tv_sec, now_ts.tv_nsec);
 }
 
 int RotaryEncoderEvent::poll_callback(unsigned int num_lines,
@@ -252,7 +254,7 @@ void RotaryEncoderEvent::handle_event(thread_data_t* p_thread_data,
     switch (p_offset) {
 
     case PIN_CLK: {
-        if (!p_thread_data->ctx.silent) fprintf(stderr, "%d - Here 1\n", p_offset);
+        LOG_DEBUG("%d - Here 1", p_offset);
 
         // Get the period from now to the first active pin detection
         timespec diff_ts = diff_timespec(p_offset, now_ts, first_active_ts, p_thread_data);
@@ -266,7 +268,7 @@ void RotaryEncoderEvent::handle_event(thread_data_t* p_thread_data,
             // Detected clockwise rotation
             //
 
-            if (!p_thread_data->ctx.silent) fprintf(stderr, "%d - Here 5\n", p_offset);
+            LOG_DEBUG("%d - Here 5", p_offset);
             first_active_ts = new timespec();
             clock_gettime(CLOCK_MONOTONIC, first_active_ts);
  
@@ -276,7 +278,7 @@ void RotaryEncoderEvent::handle_event(thread_data_t* p_thread_data,
         break;
     }
     case PIN_DT: {
-        if (!p_thread_data->ctx.silent) fprintf(stderr, "%d - Here 1\n", p_offset);
+        LOG_DEBUG("%d - Here 1", p_offset);
 
         // Get the period from now to the first active pin detection
         timespec diff_ts = diff_timespec(p_offset, now_ts, first_active_ts, p_thread_data);
@@ -290,7 +292,7 @@ void RotaryEncoderEvent::handle_event(thread_data_t* p_thread_data,
             // Detected counter-clockwise rotation
             //
 
-            if (!p_thread_data->ctx.silent) fprintf(stderr, "%d - Here 5\n", p_offset);
+            LOG_DEBUG("%d - Here 5", p_offset);
             first_active_ts = new timespec();
             clock_gettime(CLOCK_MONOTONIC, first_active_ts);
 
@@ -300,7 +302,7 @@ void RotaryEncoderEvent::handle_event(thread_data_t* p_thread_data,
         break;
     }
     case PIN_SW: {
-        if (!p_thread_data->ctx.silent) fprintf(stderr, "%d - Here 1\n", p_offset);
+        LOG_DEBUG("%d - Here 1", p_offset);
 
         // Get the period from now to the first active pin detection
         timespec diff_ts = diff_timespec(p_offset, now_ts, first_active_ts, p_thread_data);
@@ -314,7 +316,7 @@ void RotaryEncoderEvent::handle_event(thread_data_t* p_thread_data,
             // Detected momentary switch activation
             //
 
-            if (!p_thread_data->ctx.silent) fprintf(stderr, "%d - Here 5\n", p_offset);
+            LOG_DEBUG("%d - Here 5", p_offset);
             first_active_ts = new timespec();
             clock_gettime(CLOCK_MONOTONIC, first_active_ts);
  
@@ -324,7 +326,7 @@ void RotaryEncoderEvent::handle_event(thread_data_t* p_thread_data,
         break;
     }
     default: {
-        fprintf(stderr, "RotaryEncoderEvent.handle_event(): Unexpected offset: %d\n", p_offset);
+        LOG_WARN("RotaryEncoderEvent.handle_event(): Unexpected offset: %d", p_offset);
     }
     }
 
@@ -337,13 +339,13 @@ void RotaryEncoderEvent::handle_event(thread_data_t* p_thread_data,
         // Debouncing
         //
 
-        if (!p_thread_data->ctx.silent) fprintf(stderr, "Here 6 - Debouncing\n");
+        LOG_DEBUG("Here 6 - Debouncing");
     } else {
         //
         // Notify the controller
         //
 
-        fprintf(stderr, "RotaryEncoderEvent::handle_event: pushed %d\n", rs);
+        LOG_INFO("RotaryEncoderEvent::handle_event: pushed %d", rs);
         s_tune_queue->push(rs);
         rs = ROT_NC;
     }
@@ -367,8 +369,7 @@ timespec RotaryEncoderEvent::diff_timespec(int& offset,
         diff_ts.tv_sec--;
     }
 
-    if (!thread_data->ctx.silent)
-        fprintf(stderr, "%d - Here 2 - diff_ts = [%8ld.%09ld]\n", offset, diff_ts.tv_sec, diff_ts.tv_nsec);
+    LOG_DEBUG("%d - Here 2 - diff_ts = [%8ld.%09ld]", offset, (long)diff_ts.tv_sec, diff_ts.tv_nsec);
 
     return diff_ts;
 }
@@ -379,10 +380,10 @@ timespec* RotaryEncoderEvent::check_debouncing_timeout(int& offset,
                                                        thread_data_t* thread_data) {
 
     if ( (diff_ts.tv_sec > 0) || (diff_ts.tv_nsec > 250000000) ) {
-        if (!thread_data->ctx.silent) fprintf(stderr, "%d - Here 3\n", offset);
+        LOG_DEBUG("%d - Here 3", offset);
 
         if (first_active_ts != NULL) {
-            if (!thread_data->ctx.silent) fprintf(stderr, "%d - Here 4\n", offset);
+            LOG_DEBUG("%d - Here 4", offset);
             delete first_active_ts;
             first_active_ts = NULL;
         }
@@ -0,0 +1,338 @@
+/*
+ * ALSA playback straight from the output thread
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "rtl_fm_alsa.h"
+
+static int alsa_hw_setup(struct alsa_sink *a, snd_pcm_hw_params_t *hw)
+/* the nearest the card takes without a plug layer */
+{
+	snd_pcm_t *pcm = a->pcm;
+	int r;
+	snd_pcm_hw_params_any(pcm, hw);
+	r = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED);
+	if (r < 0) {
+		fprintf(stderr, "%s: no mmap access, try plughw:\n", a->device);
+		return r;
+	}
+	a->format = SND_PCM_FORMAT_S16_LE;
+	if (snd_pcm_hw_params_test_format(pcm, hw, a->format) < 0) {
+		a->format = SND_PCM_FORMAT_S32_LE;}
+	r = snd_pcm_hw_params_set_format(pcm, hw, a->format);
+	if (r < 0) {
+		fprintf(stderr, "%s: takes neither S16_LE nor S32_LE, try plughw:\n", a->device);
+		return r;
+	}
+	a->channels = a->in_channels;
+	if (snd_pcm_hw_params_test_channels(pcm, hw, a->channels) < 0) {
+		a->channels = a->in_channels == 1 ? 2 : 1;}
+	r = snd_pcm_hw_params_set_channels(pcm, hw, a->channels);
+	if (r < 0) {
+		fprintf(stderr, "%s: takes neither 1 nor 2 channels, try plughw:\n", a->device);
+		return r;
+	}
+	r = snd_pcm_hw_params_set_rate(pcm, hw, a->rate, 0);
+	if (r < 0) {
+		fprintf(stderr, "%s: does not run at %u Hz, change -r or try plughw:\n", a->device, a->rate);
+		return r;
+	}
+	snd_pcm_hw_params_set_period_size_near(pcm, hw, &a->period, 0);
+	snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &a->buffer);
+	r = snd_pcm_hw_params(pcm, hw);
+	if (r < 0) {
+		return r;}
+	snd_pcm_hw_params_get_period_size(hw, &a->period, 0);
+	snd_pcm_hw_params_get_buffer_size(hw, &a->buffer);
+	return 0;
+}
+
+static int alsa_sw_setup(struct alsa_sink *a, snd_pcm_sw_params_t *sw)
+/* poll() wakes once a period is free, playback starts on a full buffer,
+   or at the target delay with drift control */
+{
+	a->start = a->target ? a->target : a->buffer;
+	snd_pcm_sw_params_current(a->pcm, sw);
+	snd_pcm_sw_params_set_avail_min(a->pcm, sw, a->period);
+	snd_pcm_sw_params_set_start_threshold(a->pcm, sw, a->start);
+	return snd_pcm_sw_params(a->pcm, sw);
+}
+
+int alsa_sink_open(struct alsa_sink *a, const char *device, unsigned int rate,
+	int channels, unsigned int period, unsigned int buffer, unsigned int latency_ms)
+{
+	snd_pcm_hw_params_t *hw;
+	snd_pcm_sw_params_t *sw;
+	int r;
+	a->device = device;
+	a->rate = rate;
+	a->in_channels = channels;
+	a->period = period ? period : ALSA_PERIOD;
+	a->buffer = buffer ? buffer : ALSA_PERIODS * a->period;
+	a->target = (snd_pcm_uframes_t)latency_ms * rate / 1000;
+	a->ratio = 1.0;
+	a->fill = -1;
+	/* room above the target for a late block, and for one that bunches up */
+	if (a->buffer < 3 * a->target) {
+		a->buffer = 3 * a->target;}
+	if (a->target && drift_init(&a->drift, channels) < 0) {
+		fprintf(stderr, "%s: out of memory for drift control\n", device);
+		return -1;
+	}
+	r = a->pcm ? 0 : snd_pcm_open(&a->pcm, device, SND_PCM_STREAM_PLAYBACK, 0);
+	if (r < 0) {
+		fprintf(stderr, "%s: %s\n", device, snd_strerror(r));
+		a->pcm = NULL;
+		return r;
+	}
+	snd_pcm_hw_params_malloc(&hw);
+	snd_pcm_sw_params_malloc(&sw);
+	r = alsa_hw_setup(a, hw);
+	if (r >= 0) {
+		r = alsa_sw_setup(a, sw);}
+	snd_pcm_hw_params_free(hw);
+	snd_pcm_sw_params_free(sw);
+	if (r >= 0) {
+		a->nfds = snd_pcm_poll_descriptors_count(a->pcm);
+		if (a->nfds > ALSA_MAX_FDS) {
+			a->nfds = ALSA_MAX_FDS;}
+		a->nfds = snd_pcm_poll_descriptors(a->pcm, a->fds, a->nfds);
+		r = a->nfds < 0 ? a->nfds : 0;
+	}
+	if (r < 0) {
+		fprintf(stderr, "%s: %s\n", device, snd_strerror(r));
+		snd_pcm_close(a->pcm);
+		a->pcm = NULL;
+		return r;
+	}
+	fprintf(stderr, "ALSA %s: %u Hz, %u ch %s, period %lu, buffer %lu frames, mmap\n",
+		device, a->rate, a->channels, snd_pcm_format_name(a->format),
+		(unsigned long)a->period, (unsigned long)a->buffer);
+	if (a->target) {
+		fprintf(stderr, "ALSA %s: drift control, delay held at %lu frames (%u ms)\n",
+			device, (unsigned long)a->target, latency_ms);}
+	return 0;
+}
+
+static void alsa_kick(struct alsa_sink *a)
+/* the start threshold is only acted on by the write calls, an mmap
+   commit leaves the stream PREPARED however full the buffer gets */
+{
+	snd_pcm_sframes_t avail;
+	if (snd_pcm_state(a->pcm) != SND_PCM_STATE_PREPARED) {
+		return;}
+	avail = snd_pcm_avail_update(a->pcm);
+	if (avail < 0 || a->buffer - (snd_pcm_uframes_t)avail < a->start) {
+		return;}
+	if (snd_pcm_start(a->pcm) < 0) {
+		a->failures++;
+		return;
+	}
+	a->starts++;
+}
+
+static int alsa_recover(struct alsa_sink *a, int err)
+{
+	if (err == -EPIPE) {
+		a->xruns++;}
+	if (err == -ESTRPIPE) {
+		a->suspends++;}
+	err = snd_pcm_recover(a->pcm, err, 1);
+	if (err < 0) {
+		a->failures++;
+		fprintf(stderr, "%s: %s\n", a->device, snd_strerror(err));
+		return err;
+	}
+	a->recoveries++;
+	/* PREPARED again, and empty after an xrun */
+	alsa_kick(a);
+	return 0;
+}
+
+static void alsa_copy(struct alsa_sink *a, const snd_pcm_channel_area_t *areas,
+	snd_pcm_uframes_t offset, const int16_t *in, snd_pcm_uframes_t frames)
+/* interleaved, the first area walks every channel of a frame */
+{
+	int step = areas[0].step / 8;
+	char *out = (char*)areas[0].addr + areas[0].first / 8 + offset * step;
+	int16_t *o16;
+	int32_t *o32;
+	int ich = a->in_channels;
+	unsigned int c;
+	snd_pcm_uframes_t i;
+	int s;
+	if (a->format == SND_PCM_FORMAT_S16_LE && a->channels == (unsigned int)ich && step == 2 * ich) {
+		memcpy(out, in, frames * step);
+		return;
+	}
+	for (i = 0; i < frames; i++, in += ich, out += step) {
+		o16 = (int16_t*)out;
+		o32 = (int32_t*)out;
+		for (c = 0; c < a->channels; c++) {
+			/* mono to every channel, stereo to a mono card mixed down */
+			s = in[c % ich];
+			if (a->channels < (unsigned int)ich) {
+				s = (in[0] + in[1]) / 2;}
+			if (a->format == SND_PCM_FORMAT_S16_LE) {
+				o16[c] = (int16_t)s;
+			} else {
+				o32[c] = s * 65536;
+			}
+		}
+	}
+}
+
+static int alsa_play(struct alsa_sink *a, const int16_t *buf, snd_pcm_uframes_t left)
+{
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset, frames;
+	snd_pcm_sframes_t avail, done;
+	unsigned short revents;
+	int idle = 0, r;
+
+	while (left > 0) {
+		avail = snd_pcm_avail_update(a->pcm);
+		if (avail < 0) {
+			if (alsa_recover(a, (int)avail) < 0) {
+				return -1;}
+			continue;
+		}
+		if ((snd_pcm_uframes_t)avail < a->period && (snd_pcm_uframes_t)avail < left) {
+			/* less than a period free, sleep until the card takes one */
+			r = poll(a->fds, a->nfds, ALSA_POLL_MS);
+			if (r < 0 && errno != EINTR) {
+				return -1;}
+			if (r == 0 && ++idle * ALSA_POLL_MS >= ALSA_STALL_MS) {
+				a->stalls++;
+				return -1;
+			}
+			if (r > 0) {
+				a->polls++;
+				snd_pcm_poll_descriptors_revents(a->pcm, a->fds, a->nfds, &revents);
+			}
+			continue;
+		}
+		idle = 0;
+		frames = left;
+		r = snd_pcm_mmap_begin(a->pcm, &areas, &offset, &frames);
+		if (r < 0) {
+			if (alsa_recover(a, r) < 0) {
+				return -1;}
+			continue;
+		}
+		alsa_copy(a, areas, offset, buf, frames);
+		done = snd_pcm_mmap_commit(a->pcm, offset, frames);
+		if (done < 0 || (snd_pcm_uframes_t)done != frames) {
+			if (alsa_recover(a, done < 0 ? (int)done : -EPIPE) < 0) {
+				return -1;}
+			continue;
+		}
+		buf += frames * a->in_channels;
+		left -= frames;
+		a->frames += frames;
+		alsa_kick(a);
+	}
+	return 0;
+}
+
+static void alsa_steer(struct alsa_sink *a, int frames)
+/* the delay as a block goes in is the low point of the sawtooth the
+   blocks make, half a block on top is its middle */
+{
+	snd_pcm_sframes_t delay;
+	double t = (double)frames / a->rate;
+	double kp = 2.0 * ALSA_DRIFT_ZETA * ALSA_DRIFT_WN;
+	double ki = ALSA_DRIFT_WN * ALSA_DRIFT_WN;
+	double lim = ALSA_DRIFT_MAX_PPM * 1e-6;
+	double alpha = t / ALSA_DRIFT_SMOOTH_S;
+	double e, u;
+	if (snd_pcm_state(a->pcm) != SND_PCM_STATE_RUNNING || snd_pcm_delay(a->pcm, &delay) < 0) {
+		/* filling up to the start threshold, the integrator keeps the drift */
+		a->fill = -1;
+		return;
+	}
+	if (a->fill < 0) {
+		a->fill = delay + frames / 2.0;}
+	if (alpha > 1.0) {
+		alpha = 1.0;}
+	a->fill += alpha * (delay + frames / 2.0 - a->fill);
+	a->fill_sum += a->fill;
+	a->fill_n++;
+	/* seconds of delay too many, fewer frames out while positive */
+	e = (a->fill - a->target) / a->rate;
+	a->integ += e * t;
+	if (a->integ > lim / ki) {
+		a->integ = lim / ki;}
+	if (a->integ < -lim / ki) {
+		a->integ = -lim / ki;}
+	u = kp * e + ki * a->integ;
+	if (u > lim) {
+		u = lim;}
+	if (u < -lim) {
+		u = -lim;}
+	a->ratio = 1.0 - u;
+}
+
+int alsa_sink_write(struct alsa_sink *a, const int16_t *buf, int len)
+{
+	int frames = len / a->in_channels;
+	int room = frames + frames / 256 + 2;
+	int16_t *tmp;
+	if (!a->target) {
+		return alsa_play(a, buf, frames);}
+	alsa_steer(a, frames);
+	if (room * a->in_channels > a->scratch_len) {
+		tmp = (int16_t*)realloc(a->scratch, room * a->in_channels * sizeof(int16_t));
+		if (!tmp) {
+			return -1;}
+		a->scratch = tmp;
+		a->scratch_len = room * a->in_channels;
+	}
+	frames = drift_process(&a->drift, buf, frames, a->ratio, a->scratch, room);
+	return alsa_play(a, a->scratch, frames);
+}
+
+uint64_t alsa_sink_delay_ns(struct alsa_sink *a)
+/* counts the frames queued before the start too, they wait as well */
+{
+	snd_pcm_sframes_t delay;
+	if (snd_pcm_delay(a->pcm, &delay) < 0 || delay <= 0) {
+		return 0;}
+	return (uint64_t)delay * 1000000000ULL / a->rate;
+}
+
+void alsa_sink_close(struct alsa_sink *a)
+{
+	if (!a->pcm) {
+		return;}
+	snd_pcm_drop(a->pcm);
+	snd_pcm_close(a->pcm);
+	a->pcm = NULL;
+	fprintf(stderr, "ALSA %s: %llu frames, %u starts, %u polls, %u xruns, %u suspends, "
+		"%u recovered, %u failed, %u stalls\n", a->device, a->frames, a->starts, a->polls,
+		a->xruns, a->suspends, a->recoveries, a->failures, a->stalls);
+	if (a->target) {
+		fprintf(stderr, "ALSA %s: drift %+.0f ppm, delay %.1f ms average, target %.1f ms\n",
+			a->device, (a->ratio - 1.0) * 1e6,
+			a->fill_n ? 1000.0 * a->fill_sum / a->fill_n / a->rate : 0.0,
+			1000.0 * a->target / a->rate);}
+	free(a->scratch);
+	a->scratch = NULL;
+}
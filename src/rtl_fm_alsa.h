@@ -0,0 +1,138 @@
+/*
+ * ALSA playback straight from the output thread
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * -D, in place of piping stdout into aplay.  The samples are written
+ * once, from the output block into the card's mmap area, in the format
+ * and channel count the card takes (S16 or S32, mono fanned out to
+ * every channel), so a hw: device needs no plug layer.  The rate has to
+ * be one the card runs at, or use plughw:.  An mmap commit does not
+ * start the stream the way a write does, the sink starts it itself once
+ * the start threshold is queued, and again after each xrun.
+ *
+ * -L, the dongle's crystal and the card's never run at quite the same
+ * rate, so left alone the card either runs dry now and then or the
+ * blocks back up in front of it without end.  Each block goes through
+ * drift_process() first, at a ratio steered by how full the card's
+ * buffer is: a PI loop on the smoothed delay holds it at the target, the
+ * integrator ends up at the difference between the clocks.  The loop
+ * settles in some 30 seconds, slow enough that the pitch never moves
+ * audibly.
+ */
+
+#ifndef __RTL_FM_ALSA_H
+#define __RTL_FM_ALSA_H
+
+#include <stdint.h>
+#include <poll.h>
+#include <alsa/asoundlib.h>
+
+#include "rtl_fm_resample.h"
+
+/* frames, 21 ms at 48 kHz */
+#define ALSA_PERIOD		1024
+#define ALSA_PERIODS		4
+#define ALSA_MAX_FDS		4
+/* poll wakes this often, gives up on a card that stopped taking samples */
+#define ALSA_POLL_MS		100
+#define ALSA_STALL_MS		2000
+/* -L, the delay held by default */
+#define ALSA_LATENCY_MS		40
+/* the loop's natural frequency (rad/s) and damping, the delay is
+   smoothed over ALSA_DRIFT_SMOOTH_S, the ratio held within this of 1 */
+#define ALSA_DRIFT_WN		0.1
+#define ALSA_DRIFT_ZETA		0.7
+#define ALSA_DRIFT_SMOOTH_S	0.5
+#define ALSA_DRIFT_MAX_PPM	1000
+
+struct alsa_sink
+{
+	snd_pcm_t *pcm;
+	const char *device;
+	unsigned int rate;
+	int      in_channels;   /* interleaved in the output blocks */
+	unsigned int channels;  /* the card's */
+	snd_pcm_format_t format;
+	snd_pcm_uframes_t period;
+	snd_pcm_uframes_t buffer;
+	snd_pcm_uframes_t start;   /* frames queued before alsa_kick() starts it */
+	struct pollfd fds[ALSA_MAX_FDS];
+	int      nfds;
+	/* counters, output thread only */
+	unsigned long long frames;
+	unsigned int starts;    /* the first, and one after each xrun */
+	unsigned int polls;
+	unsigned int xruns;     /* the card ran dry */
+	unsigned int suspends;
+	unsigned int recoveries;
+	unsigned int failures;  /* could not recover, block dropped */
+	unsigned int stalls;    /* nothing taken for ALSA_STALL_MS, block dropped */
+	/* -L, the ratio steered to hold the delay at target */
+	snd_pcm_uframes_t target;  /* frames, 0 without drift control */
+	struct drift_resampler drift;
+	int16_t  *scratch;         /* the block resampled */
+	int      scratch_len;      /* int16 */
+	double   ratio;            /* output frames per input frame */
+	double   integ;            /* seconds x seconds of delay error */
+	double   fill;             /* smoothed delay, frames, -1 until running */
+	double   fill_sum;         /* for the average at close */
+	unsigned long long fill_n;
+};
+
+/*!
+ * Open and configure the pcm for mmap playback
+ *
+ * \param a sink, zeroed, or with pcm set to one opened already that it
+ *        then owns
+ * \param device e.g. hw:audioinjectorpi
+ * \param rate samples per second, exact
+ * \param channels in the output blocks, 1 or 2
+ * \param period frames per period, 0 for ALSA_PERIOD
+ * \param buffer frames in the ring, 0 for ALSA_PERIODS periods
+ * \param latency_ms delay held by drift control, 0 to play at the rate as is
+ * \return 0, a negative alsa error
+ */
+
+extern int alsa_sink_open(struct alsa_sink *a, const char *device, unsigned int rate,
+	int channels, unsigned int period, unsigned int buffer, unsigned int latency_ms);
+
+/*!
+ * Play a block, waits in poll() for room, recovers from xruns, resampled
+ * first with drift control
+ *
+ * \param buf interleaved int16
+ * \param len int16 in buf
+ * \return 0, -1 if (part of) the block was dropped
+ */
+
+extern int alsa_sink_write(struct alsa_sink *a, const int16_t *buf, int len);
+
+/*!
+ * How long until the last frame queued is played, the card's queue
+ *
+ * \return nanoseconds, 0 if the card cannot tell
+ */
+
+extern uint64_t alsa_sink_delay_ns(struct alsa_sink *a);
+
+/*!
+ * Stop playback and print the counters, and the drift with -L
+ */
+
+extern void alsa_sink_close(struct alsa_sink *a);
+
+#endif /* #ifndef __RTL_FM_ALSA_H */
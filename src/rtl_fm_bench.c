@@ -0,0 +1,1622 @@
+/*
+ * Synthetic benchmarks for the rtl_fm_lib DSP kernels
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+#include <alsa/pcm_external.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "rtl_fm_lib.h"
+#include "rtl_fm_bench.h"
+#include "DspPipeline.hh"
+#include "rtl_fm_pool.h"
+
+/* each kernel runs for at least this long */
+#define BENCH_MIN_NS		200000000LL
+/* for close calls, rounds the time is split in, the best one is kept */
+#define BENCH_ROUNDS		10
+/* the sink's blocks, frames, and the seconds of the card's clock run */
+#define BENCH_CARD_BLOCK	1024
+#define BENCH_CARD_SECS		120
+/* least left into right of a left only tone, what a receiver is expected to keep */
+#define STEREO_MIN_SEP_DB	30
+
+static double cpu_hz = 0;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static double cycles_per_ns(void)
+/* tsc on x86, the cpufreq clock elsewhere (pin the governor to performance) */
+{
+	FILE *f;
+	long khz = 0;
+	if (cpu_hz > 0) {
+		return cpu_hz * 1e-9;}
+#if defined(__x86_64__) || defined(__i386__)
+	{
+		long long t0 = now_ns();
+		unsigned long long c0 = __rdtsc();
+		while (now_ns() - t0 < 50000000LL) {}
+		cpu_hz = (double)(__rdtsc() - c0) / ((double)(now_ns() - t0) * 1e-9);
+	}
+#else
+	f = fopen("/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq", "r");
+	if (f) {
+		if (fscanf(f, "%ld", &khz) != 1) {
+			khz = 0;}
+		fclose(f);
+	}
+	cpu_hz = khz ? khz * 1e3 : 1e9;
+#endif
+	return cpu_hz * 1e-9;
+}
+
+static void report(const char *name, long long ns, long long bytes)
+{
+	double cycles = (double)ns * cycles_per_ns();
+	fprintf(stderr, "  %-34s %7.3f bytes/cycle %8.1f MB/s\n", name,
+		(double)bytes / cycles, (double)bytes * 1e3 / (double)ns);
+}
+
+/* the three passes rtlsdr_callback() used to make */
+
+static void ref_rotate_90(unsigned char *buf, uint32_t len)
+{
+	uint32_t i;
+	unsigned char tmp;
+	for (i=0; i<len; i+=8) {
+		tmp = 255 - buf[i+3];
+		buf[i+3] = buf[i+2];
+		buf[i+2] = tmp;
+		buf[i+4] = 255 - buf[i+4];
+		buf[i+5] = 255 - buf[i+5];
+		tmp = 255 - buf[i+6];
+		buf[i+6] = buf[i+7];
+		buf[i+7] = tmp;
+	}
+}
+
+static void ref_convert(unsigned char *buf, uint32_t len, int16_t *buf16, int16_t *lowpassed)
+{
+	uint32_t i;
+	ref_rotate_90(buf, len);
+	for (i=0; i<len; i++) {
+		buf16[i] = (int16_t)buf[i] - 127;}
+	memcpy(lowpassed, buf16, 2*len);
+}
+
+static int bench_iq_convert(void)
+{
+	uint32_t len = MAXIMUM_BUF_LENGTH;
+	unsigned char *buf = (unsigned char*)malloc(len);
+	unsigned char *ref_buf = (unsigned char*)malloc(len);
+	int16_t *buf16 = (int16_t*)malloc(2 * len);
+	int16_t *out = (int16_t*)malloc(2 * len);
+	int16_t *check = (int16_t*)malloc(2 * len);
+	int features = dsp_cpu_features();
+	iq_convert_fn fns[2];
+	const char *names[2];
+	long long t0, n;
+	uint32_t i;
+	int f, bad = 0;
+
+	for (i=0; i<len; i++) {
+		buf[i] = (unsigned char)(rand() & 0xff);}
+	memcpy(ref_buf, buf, len);
+
+	fprintf(stderr, "u8 -> s16 + fs/4 rotation, %u byte usb buffer\n", len);
+	t0 = now_ns();
+	for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+		ref_convert(ref_buf, len, buf16, out);}
+	report("before: rotate_90+convert+memcpy", now_ns() - t0, n * len);
+
+	/* reference result on the untouched buffer */
+	memcpy(ref_buf, buf, len);
+	ref_convert(ref_buf, len, buf16, check);
+
+	fns[0] = iq_convert_select(0);
+	names[0] = "after: fused scalar";
+	fns[1] = iq_convert_select(features);
+	names[1] = features ? "after: fused simd" : NULL;
+	for (f=0; f<2; f++) {
+		if (!names[f]) {
+			continue;}
+		t0 = now_ns();
+		for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+			fns[f](buf, len, 1, out);}
+		report(names[f], now_ns() - t0, n * len);
+		if (memcmp(out, check, 2 * len)) {
+			fprintf(stderr, "  %s does not match the reference!\n", names[f]);
+			bad = 1;
+		}
+	}
+
+	free(buf);
+	free(ref_buf);
+	free(buf16);
+	free(out);
+	free(check);
+	return bad;
+}
+
+/* the old 9 tap generic_fir(), one channel at a time */
+
+static void ref_fir9(int16_t *data, int length, int *fir, int16_t *hist)
+{
+	int d, j, temp, sum;
+	for (d=0; d<length; d+=2) {
+		temp = data[d];
+		sum = 0;
+		for (j=0; j<4; j++) {
+			sum += (hist[j] + hist[8-j]) * fir[j+1];}
+		sum += hist[4] * fir[5];
+		data[d] = sum >> 15;
+		for (j=0; j<8; j++) {
+			hist[j] = hist[j+1];}
+		hist[8] = temp;
+	}
+}
+
+static int fir_run(struct fir_filter *fir, const int16_t *coef, int taps, int decim,
+	int ch, fir_fn kernel, const int16_t *in, int16_t *out, int len)
+/* from fresh history, in uneven pieces so the phase and the history
+   carry across calls, returns the int16 out */
+{
+	static const int pieces[] = {2 * 37, 2 * 511, 2 * 1000};
+	int i, done, m, o = 0;
+	fir_init(fir, coef, taps, decim, ch);
+	fir->kernel = kernel;
+	memcpy(out, in, 2 * len);
+	for (i = 0, done = 0; done < len; i++, done += m) {
+		m = i < 3 ? pieces[i] : len - done;
+		if (m > len - done) {
+			m = len - done;}
+		/* in place, the output goes on after what is there */
+		memmove(out + o, out + done, 2 * m);
+		o += fir_process(fir, out + o, m);
+	}
+	return o;
+}
+
+static int bench_fir(void)
+{
+	static const int sizes[] = {9, 31, 63, 127};
+	static const int decims[] = {1, 2, 3, 4, 7};
+	static const int tap_counts[] = {1, 2, 9, 10, 31, 64, 127, 255};
+	static struct fir_filter fir;
+	int ref_coef[6] = {9, -156, -97, 2798, -15489, 61019};
+	int16_t coef[FIR_MAX_TAPS];
+	int16_t hist[2][9];
+	int len = 2 * 16384;
+	int16_t *in = (int16_t*)malloc(2 * len);
+	int16_t *out = (int16_t*)malloc(2 * len);
+	int16_t *check = (int16_t*)malloc(2 * len);
+	int features = dsp_cpu_features();
+	char name[64];
+	long long t0, n;
+	int i, s, f, ch, d, cases, clen, olen, bad = 0;
+	fir_fn kernel;
+
+	for (i=0; i<len; i++) {
+		in[i] = (int16_t)((rand() & 0x3fff) - 0x2000);}
+
+	fprintf(stderr, "symmetric fir, %i complex samples\n", len / 2);
+	memset(hist, 0, sizeof(hist));
+	t0 = now_ns();
+	for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+		memcpy(out, in, 2 * len);
+		ref_fir9(out, len, ref_coef, hist[0]);
+		ref_fir9(out + 1, len - 1, ref_coef, hist[1]);
+	}
+	report("before: generic_fir 9 taps I, Q", now_ns() - t0, n * 2 * len);
+
+	for (s=0; s<4; s++) {
+		fir_lowpass(coef, sizes[s], 0.2, 1.0);
+		for (f=0; f<2; f++) {
+			if (f && !features) {
+				continue;}
+			fir_init(&fir, coef, sizes[s], 1, 2);
+			fir.kernel = fir_select(f ? features : 0);
+			t0 = now_ns();
+			for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+				memcpy(out, in, 2 * len);
+				fir_process(&fir, out, len);
+			}
+			snprintf(name, sizeof(name), "after: %s %i taps I/Q", f ? "simd" : "scalar", sizes[s]);
+			report(name, now_ns() - t0, n * 2 * len);
+			/* same history, same input: the kernels must agree exactly */
+			fir_init(&fir, coef, sizes[s], 1, 2);
+			fir.kernel = fir_select(f ? features : 0);
+			memcpy(out, in, 2 * len);
+			fir_process(&fir, out, len);
+			if (!f) {
+				memcpy(check, out, 2 * len);
+			} else if (memcmp(out, check, 2 * len)) {
+				fprintf(stderr, "  %s does not match scalar!\n", name);
+				bad = 1;
+			}
+		}
+	}
+
+	/* every kernel the cpu has against scalar, over what -o and the
+	   pool use: either channel count, decimation, odd and even taps */
+	for (f=0; f<2; f++) {
+		kernel = fir_select(features & (f ? ~0 : DSP_CPU_SSE2));
+		if (kernel == fir_select(0) || (f && kernel == fir_select(features & DSP_CPU_SSE2))) {
+			continue;}
+		cases = 0;
+		for (ch=1; ch<=2; ch++) {
+		for (d=0; d<(int)(sizeof(decims)/sizeof(decims[0])); d++) {
+		for (s=0; s<(int)(sizeof(tap_counts)/sizeof(tap_counts[0])); s++) {
+			fir_lowpass(coef, tap_counts[s], 0.45 / decims[d], 1.0);
+			clen = fir_run(&fir, coef, tap_counts[s], decims[d], ch, fir_select(0), in, check, len);
+			olen = fir_run(&fir, coef, tap_counts[s], decims[d], ch, kernel, in, out, len);
+			cases++;
+			if (olen != clen || memcmp(out, check, 2 * clen)) {
+				fprintf(stderr, "  MISMATCH: fir %s, %i ch, decim %i, %i taps\n",
+					f ? "best" : "sse2", ch, decims[d], tap_counts[s]);
+				bad = 1;
+			}
+		}
+		}
+		}
+		fprintf(stderr, "  %-34s %i cases bit-exact with scalar\n",
+			f ? "identity: best kernel" : "identity: sse2 kernel", cases);
+	}
+
+	free(in);
+	free(out);
+	free(check);
+	return bad;
+}
+
+static int halfband_run(struct halfband_cascade *hb, int stages, int last_taps,
+	halfband_fn kernel, const int16_t *in, int16_t *out, int len)
+/* from fresh history, in pieces that are a multiple of 2^(stages+1) but
+   not of the chunk, returns the int16 out */
+{
+	static const int pieces[] = {3, 37, 250};
+	int unit = 2 << stages;
+	int i, done, m, o = 0;
+	halfband_init(hb, stages, last_taps);
+	hb->kernel = kernel;
+	memcpy(out, in, 2 * len);
+	for (i = 0, done = 0; done < len; i++, done += m) {
+		m = i < 3 ? pieces[i] * unit : len - done;
+		if (m > len - done) {
+			m = len - done;}
+		memmove(out + o, out + done, 2 * m);
+		o += halfband_decimate(hb, out + o, m);
+	}
+	return o;
+}
+
+static int bench_halfband(void)
+/* the cascade -F runs, scalar against the vector kernels, which must
+   agree exactly for every stage count and last stage size */
+{
+	static const int last[] = {7, 11, 15, 19, 23, 27, 31};
+	static struct halfband_cascade hb;
+	int len = 2 * 16384;
+	int16_t *in = (int16_t*)malloc(2 * len);
+	int16_t *out = (int16_t*)malloc(2 * len);
+	int16_t *check = (int16_t*)malloc(2 * len);
+	int features = dsp_cpu_features();
+	char name[64];
+	long long t0, n;
+	int i, f, st, l, cases, clen, olen, bad = 0;
+	halfband_fn kernel;
+
+	for (i=0; i<len; i++) {
+		in[i] = (int16_t)((rand() & 0x3fff) - 0x2000);}
+
+	/* 3 stages, what -M wbfm -F takes 1.02 MHz down by */
+	fprintf(stderr, "half-band cascade, 3 stages, %i complex samples\n", len / 2);
+	for (f=0; f<2; f++) {
+		if (f && !features) {
+			continue;}
+		halfband_init(&hb, 3, 0);
+		hb.kernel = halfband_select(f ? features : 0);
+		t0 = now_ns();
+		for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+			memcpy(out, in, 2 * len);
+			halfband_decimate(&hb, out, len);
+		}
+		snprintf(name, sizeof(name), "%s: %s", f ? "after" : "before", f ? "simd" : "scalar");
+		report(name, now_ns() - t0, n * 2 * len);
+	}
+
+	for (f=0; f<2; f++) {
+		kernel = halfband_select(features & (f ? ~0 : DSP_CPU_SSE2));
+		if (kernel == halfband_select(0) || (f && kernel == halfband_select(features & DSP_CPU_SSE2))) {
+			continue;}
+		cases = 0;
+		for (st=1; st<=5; st++) {
+		for (l=0; l<(int)(sizeof(last)/sizeof(last[0])); l++) {
+			clen = halfband_run(&hb, st, last[l], halfband_select(0), in, check, len);
+			olen = halfband_run(&hb, st, last[l], kernel, in, out, len);
+			cases++;
+			if (olen != clen || memcmp(out, check, 2 * clen)) {
+				fprintf(stderr, "  MISMATCH: half-band %s, %i stages, last %i taps\n",
+					f ? "best" : "sse2", st, last[l]);
+				bad = 1;
+			}
+		}
+		}
+		fprintf(stderr, "  %-34s %i cases bit-exact with scalar\n",
+			f ? "identity: best kernel" : "identity: sse2 kernel", cases);
+	}
+
+	free(in);
+	free(out);
+	free(check);
+	return bad;
+}
+
+/* the old low_pass_real(), boxcar plus a divide per output */
+
+static int ref_low_pass_real(int16_t *result, int len, int fast, int slow, int *now, int *index)
+{
+	int i=0, i2=0;
+	while (i < len) {
+		*now += result[i];
+		i++;
+		*index += slow;
+		if (*index < fast) {
+			continue;
+		}
+		result[i2] = (int16_t)(*now / (fast/slow));
+		*index -= fast;
+		*now = 0;
+		i2 += 1;
+	}
+	return i2;
+}
+
+static int bench_resample(void)
+{
+	static const int rates[] = {32000, 44100, 48000};
+	static struct resampler rs;
+	int len = 16384, rate_in = 170000;
+	int16_t *in = (int16_t*)malloc(2 * len);
+	int16_t *out = (int16_t*)malloc(2 * len);
+	int16_t *check = (int16_t*)malloc(2 * len);
+	int features = dsp_cpu_features();
+	char name[64];
+	long long t0, n;
+	int i, r, f, olen = 0, clen = 0, now, index, bad = 0;
+
+	for (i=0; i<len; i++) {
+		in[i] = (int16_t)((rand() & 0x3fff) - 0x2000);}
+
+	fprintf(stderr, "audio resampling from %i Hz, %i samples\n", rate_in, len);
+	for (r=0; r<3; r++) {
+		now = index = 0;
+		t0 = now_ns();
+		for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+			memcpy(out, in, 2 * len);
+			ref_low_pass_real(out, len, rate_in, rates[r], &now, &index);
+		}
+		snprintf(name, sizeof(name), "before: boxcar to %i", rates[r]);
+		report(name, now_ns() - t0, n * 2 * len);
+		for (f=0; f<2; f++) {
+			if (f && !features) {
+				continue;}
+			resample_init(&rs, rate_in, rates[r], 0);
+			rs.dot = dot_select(f ? features : 0);
+			t0 = now_ns();
+			for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+				memcpy(out, in, 2 * len);
+				resample_process(&rs, out, len, len);
+			}
+			snprintf(name, sizeof(name), "after: %s polyphase to %i", f ? "simd" : "scalar", rates[r]);
+			report(name, now_ns() - t0, n * 2 * len);
+			resample_init(&rs, rate_in, rates[r], 0);
+			rs.dot = dot_select(f ? features : 0);
+			memcpy(out, in, 2 * len);
+			olen = resample_process(&rs, out, len, len);
+			if (!f) {
+				memcpy(check, out, 2 * olen);
+				clen = olen;
+			} else if (olen != clen || memcmp(out, check, 2 * olen)) {
+				fprintf(stderr, "  %s does not match scalar!\n", name);
+				bad = 1;
+			}
+		}
+	}
+
+	free(in);
+	free(out);
+	free(check);
+	return bad;
+}
+
+/* the 128K entry int table -A lut used to walk, with a divide per sample */
+
+static int *ref_atan_lut = NULL;
+
+static int ref_polar_disc_lut(int ar, int aj, int br, int bj)
+{
+	int cr = ar*br + aj*bj, cj = aj*br - ar*bj, x;
+	if (cr == 0 || cj == 0) {
+		if (cj == 0) {
+			return cr < 0 ? 1 << 14 : 0;}
+		return cj > 0 ? 1 << 13 : -(1 << 13);
+	}
+	x = (cj << 8) / cr;
+	if (abs(x) >= 131072) {
+		return (cj > 0) ? 1<<13 : -(1<<13);}
+	if (x > 0) {
+		return (cj > 0) ? ref_atan_lut[x] : ref_atan_lut[x] - (1<<14);}
+	return (cj > 0) ? (1<<14) - ref_atan_lut[-x] : -ref_atan_lut[-x];
+}
+
+static void ref_fm_disc_lut(const int16_t *lp, int len, int pre_r, int pre_j, int16_t *result)
+{
+	int i;
+	result[0] = (int16_t)ref_polar_disc_lut(lp[0], lp[1], pre_r, pre_j);
+	for (i = 2; i < (len-1); i += 2) {
+		result[i/2] = (int16_t)ref_polar_disc_lut(lp[i], lp[i+1], lp[i-2], lp[i-1]);}
+}
+
+static int bench_atan(void)
+/* error against atan2() in output lsb (pi == 1<<14), then speed */
+{
+	static const char *names[] = {"std", "fast", "lut", "simd"};
+	static struct demod_state fm;
+	int len = 16384, n_out = len / 2;
+	int16_t *lp = (int16_t*)malloc(2 * len);
+	int16_t *out = (int16_t*)malloc(2 * n_out);
+	double *ref = (double*)malloc(sizeof(double) * n_out);
+	double ph = 0, amp, e, max, sum, cr, cj;
+	char name[64];
+	fm_disc_fn fn;
+	long long t0, n;
+	int i, a;
+
+	/* fm with a random walk of deviation, amplitude from a few lsb to
+	   what the half-band cascade makes of full scale 8 bit iq */
+	for (i=0; i<n_out; i++) {
+		amp = 8.0 * pow(128.0, (double)rand() / RAND_MAX);
+		ph += M_PI * ((double)rand() / RAND_MAX * 1.8 - 0.9);
+		lp[2*i]   = (int16_t)round(amp * cos(ph));
+		lp[2*i+1] = (int16_t)round(amp * sin(ph));
+	}
+	for (i=1; i<n_out; i++) {
+		cr = (double)lp[2*i] * lp[2*i-2] + (double)lp[2*i+1] * lp[2*i-1];
+		cj = (double)lp[2*i+1] * lp[2*i-2] - (double)lp[2*i] * lp[2*i-1];
+		ref[i] = atan2(cj, cr) / M_PI * (1 << 14);
+	}
+
+	ref_atan_lut = (int*)malloc(131072 * sizeof(int));
+	for (i=0; i<131072; i++) {
+		ref_atan_lut[i] = (int)(atan((double)i / (1<<8)) / 3.14159 * (1<<14));}
+	atan_lut_init();
+
+	fprintf(stderr, "fm discriminator, %i samples\n", n_out);
+	for (a=-1; a<4; a++) {
+		if (a < 0) {
+			fn = &ref_fm_disc_lut;
+			snprintf(name, sizeof(name), "before: 512 KB lut + divide");
+		} else {
+			fm.custom_atan = a;
+			fm_disc_select(&fm);
+			fn = fm.fm_disc;
+			snprintf(name, sizeof(name), "after: -A %s", names[a]);
+		}
+		fn(lp, len, lp[0], lp[1], out);
+		max = sum = 0;
+		for (i=1; i<n_out; i++) {
+			e = fabs(out[i] - ref[i]);
+			/* +pi and -pi are the same angle */
+			if (e > (1 << 14)) {
+				e = fabs(e - (1 << 15));}
+			max = e > max ? e : max;
+			sum += e * e;
+		}
+		t0 = now_ns();
+		for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+			fn(lp, len, lp[0], lp[1], out);}
+		report(name, now_ns() - t0, n * 2 * len);
+		fprintf(stderr, "  %-34s max %6.2f rms %6.3f lsb\n", "", max, sqrt(sum / (n_out - 1)));
+	}
+
+	free(ref_atan_lut);
+	free(lp);
+	free(out);
+	free(ref);
+	return 0;
+}
+
+static void wbfm_setup(struct demod_state *d, int fused, int passes, fm_disc_fn disc)
+/* what -M wbfm asks for, one dongle block of 8 bit iq at 1.02 MHz */
+{
+	/* the benches run one state at a time, they can share the blocks
+	   the demod thread would take from the rings */
+	static int16_t lowpassed[MAXIMUM_BUF_LENGTH];
+	static int16_t result[MAXIMUM_BUF_LENGTH];
+	demod_init(d);
+	d->lowpassed = lowpassed;
+	d->result = result;
+	d->rate_in = 170000;
+	d->rate_out = 170000;
+	d->rate_out2 = 32000;
+	d->custom_atan = 3;
+	d->deemph = 1;
+	d->deemph_a = (int)round(1.0/((1.0-exp(-1.0/(d->rate_out * 75e-6)))));
+	d->downsample = 6;
+	d->downsample_passes = passes;
+	d->fused = fused;
+	d->fm_disc = disc;
+	/* demod_init() leaves the filters, make full_demod() rebuild them */
+	d->hb.stages = 0;
+	d->audio_rs.rate_in = 0;
+	d->fc.hb.stages = 0;
+	d->fc.audio_rs.rate_in = 0;
+	d->stereo_dec.rate_in = 0;
+}
+
+static double stereo_mpx(double t, double tone, double pilot)
+/* a tone on the left channel only, 1.0 is full deviation */
+{
+	double l = sin(2.0 * M_PI * tone * t), p = 2.0 * M_PI * pilot * t;
+	return 0.45 * l + 0.45 * l * sin(2.0 * p) + 0.1 * sin(p);
+}
+
+static int bench_fused(void)
+/* staged full block passes against L1 tiles, outputs must agree exactly */
+{
+	static struct demod_state st[2];
+	static const int lens[] = {DEFAULT_BUF_LENGTH, MAXIMUM_BUF_LENGTH};
+	/* the stages that work on the whole block */
+	static const struct {
+		const char *name;
+		int dc_block, stereo;
+	} opts[] = {
+		{"-E dc",        1, 0},
+		{"stereo",       0, 1},
+		{"stereo -E dc", 1, 1},
+	};
+	int16_t *iq = (int16_t*)malloc(2 * MAXIMUM_BUF_LENGTH);
+	int16_t *mpx = (int16_t*)malloc(2 * MAXIMUM_BUF_LENGTH);
+	int16_t *check = (int16_t*)malloc(2 * MAXIMUM_BUF_LENGTH);
+	double ph = 0;
+	char name[64];
+	long long t0, n, ns, best[2];
+	int i, c, f, l, p, r, rate, clen = 0, bad = 0;
+	fm_disc_fn disc;
+
+	st[0].custom_atan = 3;
+	fm_disc_select(&st[0]);
+	disc = st[0].fm_disc;
+
+	/* a 1 kHz tone at 75 kHz deviation, +-127 like the dongle */
+	for (i=0; i<MAXIMUM_BUF_LENGTH/2; i++) {
+		ph += 2.0 * M_PI * 75000.0 / 1020000.0 * sin(2.0 * M_PI * 1000.0 * i / 1020000.0);
+		iq[2*i]   = (int16_t)round(100.0 * cos(ph) + (rand() % 9 - 4));
+		iq[2*i+1] = (int16_t)round(100.0 * sin(ph) + (rand() % 9 - 4));
+	}
+
+	for (p=0; p<2; p++) {
+	for (l=0; l<2; l++) {
+		fprintf(stderr, "wbfm chain, %s, %i byte blocks\n", p ? "-F half-band" : "boxcar", lens[l]);
+		/* the two take turns, the best round of each counts, a busy
+		   moment then costs one round and not one of the two */
+		best[0] = best[1] = 0;
+		for (r=0; r<BENCH_ROUNDS; r++) {
+			for (f=0; f<2; f++) {
+				/* passes 3 is 1.02 MHz / 8, close enough to time the stages */
+				wbfm_setup(&st[f], f, p ? 3 : 0, disc);
+				t0 = now_ns();
+				for (n=0; now_ns() - t0 < BENCH_MIN_NS / BENCH_ROUNDS; n++) {
+					memcpy(st[f].lowpassed, iq, 2 * lens[l]);
+					st[f].lp_len = lens[l];
+					full_demod(&st[f]);
+				}
+				ns = now_ns() - t0;
+				if (!best[f] || ns / n < best[f]) {
+					best[f] = ns / n;}
+			}
+		}
+		for (f=0; f<2; f++) {
+			snprintf(name, sizeof(name), "%s: %s", f ? "after" : "before", f ? "fused tiles" : "staged");
+			report(name, best[f], lens[l]);
+			/* fresh state, two blocks so the carried state is exercised */
+			wbfm_setup(&st[f], f, p ? 3 : 0, disc);
+			for (i=0; i<2; i++) {
+				memcpy(st[f].lowpassed, iq, 2 * lens[l]);
+				st[f].lp_len = lens[l];
+				full_demod(&st[f]);
+			}
+			if (!f) {
+				memcpy(check, st[f].result, 2 * st[f].result_len);
+				clen = st[f].result_len;
+			} else if (st[f].result_len != clen || memcmp(st[f].result, check, 2 * clen)) {
+				fprintf(stderr, "  %s does not match staged!\n", name);
+				bad = 1;
+			}
+		}
+	}
+	}
+
+	for (p=0; p<2; p++) {
+	/* a stereo multiplex at the rate that lands on 170 kHz, 10 kHz off
+	   tune so there is a dc to block */
+	rate = p ? 170000 << 3 : 170000 * 6;
+	ph = 0;
+	for (i=0; i<MAXIMUM_BUF_LENGTH/2; i++) {
+		ph += 2.0 * M_PI * (10000.0 + 75000.0 * stereo_mpx((double)i / rate, 1000.0, STEREO_PILOT)) / rate;
+		mpx[2*i]   = (int16_t)round(100.0 * cos(ph) + (rand() % 9 - 4));
+		mpx[2*i+1] = (int16_t)round(100.0 * sin(ph) + (rand() % 9 - 4));
+	}
+	for (c=0; c<(int)(sizeof(opts)/sizeof(opts[0])); c++) {
+		for (f=0; f<2; f++) {
+			wbfm_setup(&st[f], f, p ? 3 : 0, disc);
+			st[f].dc_block = opts[c].dc_block;
+			st[f].stereo = opts[c].stereo;
+			/* enough blocks for the pilot to lock and the blend to move */
+			for (i=0; i<4; i++) {
+				memcpy(st[f].lowpassed, mpx, 2 * MAXIMUM_BUF_LENGTH);
+				st[f].lp_len = MAXIMUM_BUF_LENGTH;
+				full_demod(&st[f]);
+			}
+			if (opts[c].stereo && !st[f].stereo_dec.locked) {
+				fprintf(stderr, "  MISMATCH: no pilot lock %s %s\n", p ? "-F half-band" : "boxcar", opts[c].name);
+				bad = 1;
+			}
+			if (!f) {
+				memcpy(check, st[f].result, 2 * st[f].result_len);
+				clen = st[f].result_len;
+			} else if (st[f].result_len != clen || memcmp(st[f].result, check, 2 * clen)) {
+				fprintf(stderr, "  MISMATCH: fused tiles %s %s\n", p ? "-F half-band" : "boxcar", opts[c].name);
+				bad = 1;
+			}
+		}
+	}
+	}
+	if (!bad) {
+		fprintf(stderr, "  %-34s %i cases agree\n", "fused tiles, -E dc and stereo", 2 * (int)(sizeof(opts)/sizeof(opts[0])));}
+
+	free(iq);
+	free(mpx);
+	free(check);
+	return bad;
+}
+
+static int bench_pipeline(void)
+/* full_demod() testing the options per block against the segments
+   dsp_pipeline_select() picks for them, outputs must agree exactly */
+{
+	static struct demod_state st[2];
+	/* wbfm's boxcar and de-emphasis are constants of the pipeline, 42
+	   and 2 are nbfm at 24 kHz, 7 and 9 take them from the state */
+	static const struct {
+		const char *name;
+		void (*mode)(struct demod_state *);
+		int atan, downsample, deemph_a;
+	} cases[] = {
+		{"fm -A std",         &fm_demod, 0, 6, 13},
+		{"fm -A fast",        &fm_demod, 1, 6, 13},
+		{"fm -A lut",         &fm_demod, 2, 6, 13},
+		{"fm -A simd",        &fm_demod, 3, 6, 13},
+		{"fm -A fast, /42",   &fm_demod, 1, 42, 2},
+		{"fm -A fast, /7 /9", &fm_demod, 1, 7, 9},
+		{"am",                &am_demod, 0, 6, 13},
+		{"usb",               &usb_demod, 0, 6, 13},
+	};
+	int16_t *iq = (int16_t*)malloc(2 * DEFAULT_BUF_LENGTH);
+	int16_t *check = (int16_t*)malloc(2 * MAXIMUM_BUF_LENGTH);
+	double ph = 0;
+	char name[64];
+	long long t0, n, ns, best[2];
+	int i, c, f, p, r, clen = 0, bad = 0;
+	fm_disc_fn disc[4];
+
+	for (i=0; i<4; i++) {
+		st[0].custom_atan = i;
+		fm_disc_select(&st[0]);
+		disc[i] = st[0].fm_disc;
+	}
+
+	/* the same tone as bench_fused() */
+	for (i=0; i<DEFAULT_BUF_LENGTH/2; i++) {
+		ph += 2.0 * M_PI * 75000.0 / 1020000.0 * sin(2.0 * M_PI * 1000.0 * i / 1020000.0);
+		iq[2*i]   = (int16_t)round(100.0 * cos(ph) + (rand() % 9 - 4));
+		iq[2*i+1] = (int16_t)round(100.0 * sin(ph) + (rand() % 9 - 4));
+	}
+
+	for (p=0; p<2; p++) {
+	for (c=0; c<(int)(sizeof(cases)/sizeof(cases[0])); c++) {
+		/* the half-band cascade has no boxcar to vary */
+		if (p && cases[c].downsample != 6) {
+			continue;}
+		fprintf(stderr, "%s chain, %s, %i byte blocks\n", cases[c].name,
+			p ? "-F half-band" : "boxcar", DEFAULT_BUF_LENGTH);
+		/* turns and best rounds as in bench_fused() */
+		best[0] = best[1] = 0;
+		for (r=0; r<=BENCH_ROUNDS; r++) {
+			for (f=0; f<2; f++) {
+				/* the last round two blocks from fresh state, not timed */
+				wbfm_setup(&st[f], 0, p ? 3 : 0, disc[cases[c].atan]);
+				st[f].mode_demod = cases[c].mode;
+				st[f].custom_atan = cases[c].atan;
+				st[f].downsample = cases[c].downsample;
+				st[f].deemph_a = cases[c].deemph_a;
+				if (f) {
+					dsp_pipeline_select(&st[f], st[f].pipeline);}
+				t0 = now_ns();
+				for (n=0; r == BENCH_ROUNDS ? n < 2 : now_ns() - t0 < BENCH_MIN_NS / BENCH_ROUNDS; n++) {
+					memcpy(st[f].lowpassed, iq, 2 * DEFAULT_BUF_LENGTH);
+					st[f].lp_len = DEFAULT_BUF_LENGTH;
+					full_demod(&st[f]);
+				}
+				ns = now_ns() - t0;
+				if (r < BENCH_ROUNDS) {
+					if (!best[f] || ns / n < best[f]) {
+						best[f] = ns / n;}
+				} else if (!f) {
+					memcpy(check, st[f].result, 2 * st[f].result_len);
+					clen = st[f].result_len;
+				} else if (st[f].result_len != clen || memcmp(st[f].result, check, 2 * clen)) {
+					fprintf(stderr, "  %s does not match options per block!\n", cases[c].name);
+					bad = 1;
+				}
+			}
+		}
+		for (f=0; f<2; f++) {
+			snprintf(name, sizeof(name), "%s: %s", f ? "after" : "before",
+				f ? "template pipeline" : "options per block");
+			report(name, best[f], DEFAULT_BUF_LENGTH);
+		}
+	}
+	}
+
+	free(iq);
+	free(check);
+	return bad;
+}
+
+static int bench_parallel(void)
+/* -E parallel against one core over consecutive blocks, so the state
+   carried between blocks is checked too, outputs must agree exactly */
+{
+	static struct demod_state st;
+	static const int workers[] = {1, 2, 4};
+	const int blocks = 3;
+	int16_t *iq = (int16_t*)malloc(2 * blocks * MAXIMUM_BUF_LENGTH);
+	int16_t *check = (int16_t*)malloc(2 * blocks * MAXIMUM_BUF_LENGTH);
+	int clen[3];
+	double ph = 0;
+	char name[64];
+	long long t0, n;
+	int i, b, p, f, bad = 0;
+	fm_disc_fn disc;
+
+	st.custom_atan = 3;
+	fm_disc_select(&st);
+	disc = st.fm_disc;
+
+	/* the tone of bench_fused(), running on across the blocks */
+	for (i=0; i<blocks * MAXIMUM_BUF_LENGTH/2; i++) {
+		ph += 2.0 * M_PI * 75000.0 / 1020000.0 * sin(2.0 * M_PI * 1000.0 * i / 1020000.0);
+		iq[2*i]   = (int16_t)round(100.0 * cos(ph) + (rand() % 9 - 4));
+		iq[2*i+1] = (int16_t)round(100.0 * sin(ph) + (rand() % 9 - 4));
+	}
+
+	for (p=0; p<2; p++) {
+		fprintf(stderr, "wbfm chain, %s, %i byte blocks, %li cores\n",
+			p ? "-F half-band" : "boxcar", 2 * MAXIMUM_BUF_LENGTH,
+			sysconf(_SC_NPROCESSORS_ONLN));
+		for (f=0; f<(int)(sizeof(workers)/sizeof(workers[0])); f++) {
+			for (i=0; i<2; i++) {
+				/* i == 0 times it, i == 1 the blocks from fresh state */
+				wbfm_setup(&st, 0, p ? 3 : 0, disc);
+				st.workers = workers[f];
+				t0 = now_ns();
+				for (n=0; i ? n < blocks : now_ns() - t0 < BENCH_MIN_NS; n++) {
+					b = i ? (int)n : 0;
+					memcpy(st.lowpassed, iq + b * MAXIMUM_BUF_LENGTH, 2 * MAXIMUM_BUF_LENGTH);
+					st.lp_len = MAXIMUM_BUF_LENGTH;
+					full_demod(&st);
+					if (!i) {
+						continue;}
+					if (f == 0) {
+						memcpy(check + b * MAXIMUM_BUF_LENGTH, st.result, 2 * st.result_len);
+						clen[b] = st.result_len;
+					} else if (st.result_len != clen[b] ||
+						   memcmp(st.result, check + b * MAXIMUM_BUF_LENGTH, 2 * clen[b])) {
+						fprintf(stderr, "  %i workers, block %i does not match one core!\n", workers[f], b);
+						bad = 1;
+					}
+				}
+				if (!i) {
+					if (f) {
+						snprintf(name, sizeof(name), "after: %i workers", workers[f]);
+					} else {
+						snprintf(name, sizeof(name), "before: one core");
+					}
+					report(name, now_ns() - t0, n * 2 * MAXIMUM_BUF_LENGTH);
+				}
+				if (st.pool) {
+					pool_free(st.pool);
+					st.pool = NULL;
+				}
+			}
+		}
+	}
+
+	free(iq);
+	free(check);
+	return bad;
+}
+
+static double sinad_db(const int16_t *x, int n, int period)
+/* tone over everything else, n a multiple of the tone period */
+{
+	double a = 0, b = 0, c = 0, e, r = 0, w;
+	int i;
+	for (i = 0; i < n; i++) {
+		w = 2.0 * M_PI * i / period;
+		a += x[i] * cos(w);
+		b += x[i] * sin(w);
+		c += x[i];
+	}
+	a *= 2.0 / n;
+	b *= 2.0 / n;
+	c /= n;
+	for (i = 0; i < n; i++) {
+		w = 2.0 * M_PI * i / period;
+		e = x[i] - c - a * cos(w) - b * sin(w);
+		r += e * e;
+	}
+	return 10.0 * log10((a*a + b*b) / 2.0 / (r / n + 1e-30));
+}
+
+static int bench_float(void)
+/* the int16 chain against the float32 one, speed and audio quality,
+   the same 8 bit samples go into both */
+{
+	static struct demod_state st;
+	static const int amps[] = {100, 10};
+	const int blocks = 12, settle = 512, period = 32;
+	int16_t *iq = (int16_t*)malloc(2 * blocks * DEFAULT_BUF_LENGTH);
+	int16_t *out = (int16_t*)malloc(2 * blocks * DEFAULT_BUF_LENGTH);
+	double ph, fs;
+	char name[64];
+	long long t0, n;
+	int i, a, f, p, len;
+	fm_disc_fn disc;
+
+	st.custom_atan = 3;
+	fm_disc_select(&st);
+	disc = st.fm_disc;
+
+	for (p=0; p<2; p++) {
+		fprintf(stderr, "wbfm chain, %s, %i byte blocks\n", p ? "-F half-band" : "boxcar", DEFAULT_BUF_LENGTH);
+		for (f=0; f<2; f++) {
+			wbfm_setup(&st, 0, p ? 3 : 0, disc);
+			st.fp = f;
+			ph = 0;
+			for (i=0; i<DEFAULT_BUF_LENGTH/2; i++) {
+				ph += 2.0 * M_PI * 75000.0 / 1020000.0 * sin(2.0 * M_PI * 1000.0 * i / 1020000.0);
+				iq[2*i]   = (int16_t)round(100.0 * cos(ph) + (rand() % 9 - 4));
+				iq[2*i+1] = (int16_t)round(100.0 * sin(ph) + (rand() % 9 - 4));
+			}
+			t0 = now_ns();
+			for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+				memcpy(st.lowpassed, iq, 2 * DEFAULT_BUF_LENGTH);
+				st.lp_len = DEFAULT_BUF_LENGTH;
+				full_demod(&st);
+			}
+			report(f ? "after: float32" : "before: int16", now_ns() - t0, n * DEFAULT_BUF_LENGTH);
+		}
+		/* 1 kHz at 75 kHz deviation, no noise but the 8 bit rounding,
+		   sinad of the 32 kS/s audio once the filters have settled.
+		   Here the rate has to be right, the cascade decimates by 8 */
+		fs = p ? 1360000.0 : 1020000.0;
+		for (a=0; a<2; a++) {
+			ph = 0;
+			for (i=0; i<blocks*DEFAULT_BUF_LENGTH/2; i++) {
+				ph += 2.0 * M_PI * 75000.0 / fs * sin(2.0 * M_PI * 1000.0 * i / fs);
+				iq[2*i]   = (int16_t)round(amps[a] * cos(ph));
+				iq[2*i+1] = (int16_t)round(amps[a] * sin(ph));
+			}
+			for (f=0; f<2; f++) {
+				wbfm_setup(&st, 0, p ? 3 : 0, disc);
+				st.fp = f;
+				len = 0;
+				for (i=0; i<blocks; i++) {
+					memcpy(st.lowpassed, iq + i*DEFAULT_BUF_LENGTH, 2 * DEFAULT_BUF_LENGTH);
+					st.lp_len = DEFAULT_BUF_LENGTH;
+					full_demod(&st);
+					memcpy(out + len, st.result, 2 * st.result_len);
+					len += st.result_len;
+				}
+				len = (len - settle) / period * period;
+				snprintf(name, sizeof(name), "sinad %s, +-%i input", f ? "float32" : "int16", amps[a]);
+				fprintf(stderr, "  %-34s %7.1f dB\n", name, sinad_db(out + settle, len, period));
+			}
+		}
+	}
+
+	free(iq);
+	free(out);
+	return 0;
+}
+
+/* the handoff before the rings, one shared block behind a rwlock,
+   a condvar without a predicate and a copy out of the block */
+struct handoff
+{
+	pthread_rwlock_t rw;
+	pthread_cond_t ready;
+	pthread_mutex_t ready_m;
+	struct block_ring ring;
+	int16_t  block[DEFAULT_BUF_LENGTH];
+	int16_t  copy[DEFAULT_BUF_LENGTH];
+	volatile int done;
+	long long seen, lost;
+};
+
+static void handoff_count(struct handoff *h, const int16_t *block, int *last)
+/* the producer stamps a 32 bit sequence number into each block */
+{
+	int seq = (uint16_t)block[0] | (int)block[1] << 16;
+	if (*last >= 0 && seq > *last + 1) {
+		h->lost += seq - *last - 1;}
+	h->seen++;
+	*last = seq;
+}
+
+static void handoff_fill(int16_t *block, int seq)
+{
+	int i;
+	for (i = 2; i < DEFAULT_BUF_LENGTH; i++) {
+		block[i] = (int16_t)(seq + i);}
+	block[0] = (int16_t)(seq & 0xffff);
+	block[1] = (int16_t)(seq >> 16);
+}
+
+static void *handoff_old_fn(void *arg)
+{
+	struct handoff *h = (struct handoff*)arg;
+	int last = -1;
+	while (!h->done) {
+		safe_cond_wait(&h->ready, &h->ready_m);
+		pthread_rwlock_rdlock(&h->rw);
+		memcpy(h->copy, h->block, sizeof(h->copy));
+		pthread_rwlock_unlock(&h->rw);
+		handoff_count(h, h->copy, &last);
+	}
+	h->done = 2;
+	return 0;
+}
+
+static void *handoff_ring_fn(void *arg)
+{
+	struct handoff *h = (struct handoff*)arg;
+	int16_t *block;
+	int len, last = -1;
+	while ((block = ring_peek(&h->ring, &len))) {
+		handoff_count(h, block, &last);
+		ring_release(&h->ring);
+	}
+	return 0;
+}
+
+static int bench_ring(void)
+/* dongle -> demod handoff of 16 KB blocks, blocks lost on the way */
+{
+	static struct handoff h;
+	pthread_t t;
+	long long t0, ns;
+	int16_t *block;
+	int n, f;
+
+	fprintf(stderr, "thread handoff, %i byte blocks\n", 2 * DEFAULT_BUF_LENGTH);
+	for (f=0; f<2; f++) {
+		memset(&h, 0, sizeof(h));
+		if (f) {
+			if (ring_init(&h.ring, RING_BLOCKS, DEFAULT_BUF_LENGTH) < 0) {
+				return 1;}
+			pthread_create(&t, NULL, handoff_ring_fn, &h);
+		} else {
+			pthread_rwlock_init(&h.rw, NULL);
+			pthread_cond_init(&h.ready, NULL);
+			pthread_mutex_init(&h.ready_m, NULL);
+			pthread_create(&t, NULL, handoff_old_fn, &h);
+		}
+		t0 = now_ns();
+		for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+			if (f) {
+				block = ring_acquire(&h.ring);
+				handoff_fill(block, n);
+				ring_publish(&h.ring, DEFAULT_BUF_LENGTH);
+			} else {
+				pthread_rwlock_wrlock(&h.rw);
+				handoff_fill(h.block, n);
+				pthread_rwlock_unlock(&h.rw);
+				safe_cond_signal(&h.ready, &h.ready_m);
+			}
+		}
+		ns = now_ns() - t0;
+		if (f) {
+			/* let the consumer drain before it is told to stop */
+			while (h.seen < n && now_ns() - t0 < ns + 1000000000LL) {
+				usleep(1000);}
+			ring_close(&h.ring);
+			pthread_join(t, NULL);
+			ring_free(&h.ring);
+		} else {
+			h.done = 1;
+			while (h.done != 2) {
+				safe_cond_signal(&h.ready, &h.ready_m);
+				usleep(1000);
+			}
+			pthread_join(t, NULL);
+		}
+		report(f ? "after: spsc ring" : "before: rwlock + cond + memcpy", ns, (long long)n * 2 * DEFAULT_BUF_LENGTH);
+		fprintf(stderr, "  %-34s %lld of %i\n", "blocks lost", h.lost, n);
+		if (f) {
+			fprintf(stderr, "  %-34s %u\n", "producer waits (ring full)", h.ring.full_waits);
+			ring_latency_print("  consumer", &h.ring.empty_lat);
+		}
+	}
+	return 0;
+}
+
+/* the demod side of the usb ring, it only has to keep the ring drained */
+static void *ingest_fn(void *arg)
+{
+	struct block_ring *r = (struct block_ring*)arg;
+	int len;
+	while (ring_peek(r, &len)) {
+		ring_release(r);}
+	return 0;
+}
+
+static long long thread_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int bench_ingest(void)
+/* the usb callback, wall clock per transfer and its worst case, since
+   librtlsdr only resubmits the transfer once the callback returns */
+{
+	static struct block_ring ring;
+	static unsigned char xfer[DEFAULT_BUF_NUMBER][MAXIMUM_BUF_LENGTH];
+	iq_convert_fn iq_convert = iq_convert_select(dsp_cpu_features());
+	pthread_t t;
+	long long t0, t1, c0, ns, cpu, cb, cb_sum = 0, cb_max = 0;
+	int16_t *block;
+	int i, n;
+
+	for (i=0; i<DEFAULT_BUF_NUMBER; i++) {
+		memset(xfer[i], rand() & 0xff, MAXIMUM_BUF_LENGTH);}
+	fprintf(stderr, "usb callback, %i byte transfers\n", MAXIMUM_BUF_LENGTH);
+	if (ring_init(&ring, RING_BLOCKS, MAXIMUM_BUF_LENGTH) < 0) {
+		return 1;}
+	pthread_create(&t, NULL, ingest_fn, &ring);
+	t0 = now_ns();
+	c0 = thread_ns();
+	for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+		t1 = now_ns();
+		block = ring_acquire(&ring);
+		iq_convert(xfer[n % DEFAULT_BUF_NUMBER], MAXIMUM_BUF_LENGTH, 1, block);
+		ring_publish(&ring, MAXIMUM_BUF_LENGTH);
+		cb = now_ns() - t1;
+		cb_sum += cb;
+		if (cb > cb_max) {
+			cb_max = cb;}
+	}
+	cpu = thread_ns() - c0;
+	ns = now_ns() - t0;
+	ring_close(&ring);
+	pthread_join(t, NULL);
+	ring_free(&ring);
+	report("callback converts into the ring", ns, (long long)n * MAXIMUM_BUF_LENGTH);
+	fprintf(stderr, "  %-34s %7.1f us\n", "callback wall clock per transfer", (double)cb_sum * 1e-3 / n);
+	fprintf(stderr, "  %-34s %7.1f us\n", "callback worst case", (double)cb_max * 1e-3);
+	fprintf(stderr, "  %-34s %7.1f us\n", "usb thread cpu per transfer", (double)cpu * 1e-3 / n);
+	fprintf(stderr, "  %-34s %7.1f us\n", "transfer at 2.4 MS/s", (double)MAXIMUM_BUF_LENGTH / 2 / 2.4);
+	return 0;
+}
+
+static uint32_t rds_block_word(uint16_t data, uint16_t offset)
+/* 16 data bits, the checkword and the offset word, as a station sends it */
+{
+	uint32_t w = (uint32_t)data << 10;
+	int i;
+	for (i = 25; i >= 10; i--) {
+		if (w & (1u << i)) {
+			w ^= 0x5B9u << (i - 10);}
+	}
+	return ((uint32_t)data << 10) | ((w & 0x3FF) ^ offset);
+}
+
+static int rds_group_bits(uint8_t *bits, const uint16_t *blocks)
+/* one group of four blocks, offsets A B C D, msb first */
+{
+	static const uint16_t offset[4] = {0x0FC, 0x198, 0x168, 0x1B4};
+	uint32_t w;
+	int b, i;
+	for (b = 0; b < 4; b++) {
+		w = rds_block_word(blocks[b], offset[b]);
+		for (i = 25; i >= 0; i--) {
+			*bits++ = (w >> i) & 1;}
+	}
+	return 104;
+}
+
+static int bench_rds(void)
+/* new stage, there is no before, what matters is its share of the core.
+   A station's PS and RadioText are sent three times over a pilot and a
+   tone, the last RadioText with a two bit burst the decoder must fix. */
+{
+	static struct rds_decoder rds;
+	static const char ps[] = "RTL FM  ";
+	static const char rt[] = "radiotext from the rds bench\r   ";
+	static uint8_t bits[3 * 12 * 104];
+	struct rds_info info;
+	uint16_t pi = 0x1234, pty = 10, blocks[4];
+	int len = 16384, rate_in = 170000;
+	/* deviation to discriminator units, pi == 1<<14 */
+	double scale = 2.0 * (1 << 14) / rate_in, t, x;
+	int16_t *in;
+	long long t0, ns, n;
+	unsigned long bad_before;
+	int i, g, k, rep, nbits = 0, burst = 0, total, level = 0, bad = 0;
+
+	for (rep = 0; rep < 3; rep++) {
+		for (g = 0; g < 4; g++) {
+			/* 0A, TP, PTY, TA off, music, PS segment g */
+			blocks[0] = pi;
+			blocks[1] = (uint16_t)((1 << 10) | (pty << 5) | (1 << 3) | g);
+			blocks[2] = 0xE0CD;
+			blocks[3] = (uint16_t)((uint8_t)ps[2*g] << 8 | (uint8_t)ps[2*g+1]);
+			nbits += rds_group_bits(bits + nbits, blocks);
+		}
+		for (g = 0; g < 8; g++) {
+			/* 2A, text A, RadioText segment g */
+			blocks[0] = pi;
+			blocks[1] = (uint16_t)((2 << 12) | (1 << 10) | (pty << 5) | g);
+			blocks[2] = (uint16_t)((uint8_t)rt[4*g] << 8 | (uint8_t)rt[4*g+1]);
+			blocks[3] = (uint16_t)((uint8_t)rt[4*g+2] << 8 | (uint8_t)rt[4*g+3]);
+			if (rep == 2 && g == 1) {
+				/* block C, mid data */
+				burst = nbits + 2 * 26 + 8;}
+			nbits += rds_group_bits(bits + nbits, blocks);
+		}
+	}
+	/* differential coding, one wrong symbol is two wrong bits */
+	for (i = 0; i < nbits; i++) {
+		level ^= bits[i];
+		bits[i] = (uint8_t)level;
+	}
+	bits[burst] ^= 1;
+
+	total = (int)((double)nbits / RDS_BITRATE * rate_in);
+	in = (int16_t*)malloc(2 * total);
+	for (i = 0; i < total; i++) {
+		t = (double)i / rate_in;
+		k = (int)(t * RDS_BITRATE);
+		/* biphase, the symbol then its inverse */
+		x = bits[k] ? 1.0 : -1.0;
+		if (t * RDS_BITRATE - k >= 0.5) {
+			x = -x;}
+		x = 2000.0 * x * cos(2.0 * M_PI * RDS_CARRIER * t)
+		  + 7500.0 * sin(2.0 * M_PI * STEREO_PILOT * t)
+		  + 40000.0 * sin(2.0 * M_PI * 1000.0 * t);
+		in[i] = (int16_t)round(scale * x + (rand() % 65 - 32));
+	}
+
+	fprintf(stderr, "rds from %i Hz multiplex, %i samples\n", rate_in, len);
+	rds_init(&rds, rate_in);
+	/* everything up to the group with the burst, then the rest */
+	k = (int)((double)(burst - 60) / RDS_BITRATE * rate_in);
+	rds_process(&rds, in, k);
+	rds_snapshot(&rds, &info);
+	bad_before = info.blocks_bad;
+	rds_process(&rds, in + k, total - k);
+	rds_snapshot(&rds, &info);
+	fprintf(stderr, "  %-34s pi %04X ps \"%s\" %lu groups\n", "decoded", info.pi, info.ps, info.groups);
+	if (!info.synced || info.pi != pi || memcmp(info.ps, ps, RDS_PS_LEN)
+	    || memcmp(info.rt, rt, 28) || info.rt[28] != ' ') {
+		fprintf(stderr, "  MISMATCH: rt \"%s\"\n", info.rt);
+		bad = 1;
+	}
+	if (info.blocks_bad != bad_before) {
+		fprintf(stderr, "  MISMATCH: the burst was not corrected\n");
+		bad = 1;
+	}
+
+	t0 = now_ns();
+	for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+		rds_process(&rds, in + (n * len) % (total - len), len);}
+	ns = now_ns() - t0;
+	report("after: cic + costas + block sync", ns, n * 2 * len);
+	fprintf(stderr, "  %-34s %7.2f %% of one core\n", "at 170 kS/s",
+		100.0 * (double)ns / (double)(n * len) * rate_in * 1e-9);
+
+	free(in);
+	return bad;
+}
+
+static int bench_stereo(void)
+/* new stage, a left only tone with the pilot off by the +-2 Hz the
+   standard allows, it has to lock and keep the right channel quiet */
+{
+	static struct stereo_decoder st;
+	static const int offsets[] = {-2, 2};
+	int len = 16384, rate_in = 170000, rate_out = 32000;
+	int16_t *mpx = (int16_t*)malloc(2 * len);
+	int16_t *buf = (int16_t*)malloc(2 * len);
+	/* full deviation in discriminator units, pi == 1<<14 */
+	double scale = 75000.0 * 2.0 * (1 << 14) / rate_in, pl, pr, sep;
+	long long t0, ns, n;
+	int i, k, o, m, bad = 0;
+
+	fprintf(stderr, "stereo from %i Hz multiplex, %i samples\n", rate_in, len);
+	for (o=0; o<2; o++) {
+		stereo_init(&st, rate_in, rate_out, STEREO_DEEMPH_US);
+		pl = pr = 0;
+		/* two seconds, the last half of it is measured */
+		for (k=0; k<2*rate_in/len; k++) {
+			for (i=0; i<len; i++) {
+				buf[i] = (int16_t)round(scale * stereo_mpx((double)(k * len + i) / rate_in,
+					1000.0, STEREO_PILOT + offsets[o]));}
+			m = stereo_process(&st, buf, len, len);
+			if (k < rate_in/len) {
+				continue;}
+			for (i=0; i<m; i+=2) {
+				pl += (double)buf[i] * buf[i];
+				pr += (double)buf[i+1] * buf[i+1];
+			}
+		}
+		sep = 10.0 * log10(pl / (pr > 1 ? pr : 1));
+		fprintf(stderr, "  %-34s %s, %5.1f dB separation\n", offsets[o] < 0 ? "pilot -2 Hz" : "pilot +2 Hz",
+			st.locked ? "locked" : "not locked", sep);
+		if (!st.locked || sep < STEREO_MIN_SEP_DB) {
+			fprintf(stderr, "  MISMATCH: want a lock and %i dB\n", STEREO_MIN_SEP_DB);
+			bad = 1;
+		}
+	}
+
+	for (i=0; i<len; i++) {
+		mpx[i] = (int16_t)round(scale * stereo_mpx((double)i / rate_in, 1000.0, STEREO_PILOT));}
+	t0 = now_ns();
+	for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+		memcpy(buf, mpx, 2 * len);
+		stereo_process(&st, buf, len, len);
+	}
+	ns = now_ns() - t0;
+	report("after: pll + matrix + resample", ns, n * 2 * len);
+	fprintf(stderr, "  %-34s %7.2f %% of one core\n", "at 170 kS/s",
+		100.0 * (double)ns / (double)(n * len) * rate_in * 1e-9);
+
+	free(mpx);
+	free(buf);
+	return bad;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static int bench_stamp(void)
+/* new, what leaving the block stamps on costs, and how far the bucketed
+   percentiles are from the exact ones */
+{
+	static struct lat_hist h;
+	static uint32_t us[100000];
+	static const double p[4] = {0.5, 0.9, 0.99, 0.999};
+	uint64_t t;
+	long long t0, ns, n;
+	uint32_t exact, got;
+	int i, r = 0;
+
+	fprintf(stderr, "block stamps, clock + histogram per stage\n");
+	t0 = now_ns();
+	for (n=0; now_ns() - t0 < BENCH_MIN_NS; n++) {
+		t = stamp_now_ns();
+		lat_add(&h, t - 1000 * (n & 1023), t);
+	}
+	ns = now_ns() - t0;
+	fprintf(stderr, "  %-34s %7.1f ns\n", "after: per stage", (double)ns / n);
+
+	/* log-normal around 2 ms, a long tail like the real stages */
+	memset(&h, 0, sizeof(h));
+	for (i=0; i<100000; i++) {
+		us[i] = (uint32_t)(2000.0 * exp(0.8 * sqrt(-2.0 * log((rand() + 1.0) / (RAND_MAX + 2.0)))
+			* cos(2.0 * M_PI * rand() / (RAND_MAX + 1.0))));
+		lat_add(&h, 0, (uint64_t)us[i] * 1000);
+	}
+	qsort(us, 100000, sizeof(uint32_t), cmp_u32);
+	for (i=0; i<4; i++) {
+		exact = us[(int)(p[i] * 100000) - 1];
+		got = lat_percentile(&h, p[i]);
+		fprintf(stderr, "  %5.1f%%: exact %6u us, histogram < %6u us\n", p[i] * 100, exact, got);
+		if (got <= exact || got > exact + exact / (LAT_SUB / 2) + 1) {
+			r = 1;}
+	}
+	if (r) {
+		fprintf(stderr, "  MISMATCH: percentile outside its bucket\n");}
+	return r;
+}
+
+static int bench_trace(void)
+/* new, a begin and end pair with -X off, what every stage pays, and on */
+{
+	long long t0, ns, n;
+	int on, i;
+
+	fprintf(stderr, "trace events, begin + end\n");
+	for (on=0; on<2; on++) {
+		trace_on = on;
+		trace_thread("bench");
+		t0 = now_ns();
+		for (n=0; now_ns() - t0 < BENCH_MIN_NS; n+=1000) {
+			for (i=0; i<1000; i++) {
+				TRACE_BEGIN("bench");
+				TRACE_END("bench");
+			}
+		}
+		ns = now_ns() - t0;
+		fprintf(stderr, "  %-34s %7.1f ns\n", on ? "after: recording" : "after: compiled in, off",
+			(double)ns / n);
+	}
+	trace_on = 0;
+	return 0;
+}
+
+static int bench_log(void)
+/* new, a line from a real-time thread, fprintf() before; what the log
+   writes goes to /dev/null meanwhile, and each batch fits the ring */
+{
+	static const char *names[4] = {"before: fprintf, /dev/null", "after: below the level",
+		"after: held back by the rate", "after: into the ring"};
+	double per[4];
+	long long t0, ns, n;
+	FILE *null = fopen("/dev/null", "w");
+	int err = dup(2), i, k;
+
+	fprintf(stderr, "log line, one int\n");
+	if (!null || err < 0) {
+		return 1;}
+	/* a write() a line, as stderr does */
+	setvbuf(null, NULL, _IONBF, 0);
+	dup2(fileno(null), 2);
+	for (k=0; k<3; k++) {
+		t0 = now_ns();
+		for (n=0; now_ns() - t0 < BENCH_MIN_NS; n+=1000) {
+			for (i=0; i<1000; i++) {
+				if (k == 0) {
+					fprintf(null, "UN-MUTE %d\n", i);
+				} else if (k == 1) {
+					LOG_DEBUG("UN-MUTE %d", i);
+				} else {
+					LOG_INFO("UN-MUTE %d", i);}
+			}
+		}
+		per[k] = (double)(now_ns() - t0) / n;
+	}
+	log_open();
+	/* 100 batches, the writer needs the sleeps in between */
+	ns = 0;
+	for (n=0; n < 100*LOG_RECORDS/2; n+=LOG_RECORDS/2) {
+		t0 = now_ns();
+		for (i=0; i<LOG_RECORDS/2; i++) {
+			LOG_AT(LOG_LEVEL_INFO, 1000000000, "UN-MUTE %d", i);}
+		ns += now_ns() - t0;
+		usleep(2 * LOG_POLL_US);
+	}
+	per[3] = (double)ns / n;
+	log_close();
+	dup2(err, 2);
+	close(err);
+	fclose(null);
+	for (k=0; k<4; k++) {
+		fprintf(stderr, "  %-34s %7.1f ns\n", names[k], per[k]);}
+	return 0;
+}
+
+/* a card that, like a hw: one, only plays once snd_pcm_start() is
+   called, on a clock the bench moves on a block at a time */
+struct bench_card
+{
+	snd_pcm_ioplug_t io;
+	int      fds[2];        /* never readable, poll() only times out */
+	int      running;
+	int      starts;
+	double   ppm;           /* the card's clock, fast of the samples' */
+	double   pos;           /* frames played since prepare */
+	uint64_t queued;        /* frames committed since prepare */
+};
+
+static int card_start(snd_pcm_ioplug_t *io)
+{
+	struct bench_card *c = (struct bench_card*)io->private_data;
+	c->running = 1;
+	c->starts++;
+	return 0;
+}
+
+static int card_stop(snd_pcm_ioplug_t *io)
+{
+	((struct bench_card*)io->private_data)->running = 0;
+	return 0;
+}
+
+static int card_prepare(snd_pcm_ioplug_t *io)
+{
+	struct bench_card *c = (struct bench_card*)io->private_data;
+	c->running = 0;
+	c->pos = 0;
+	c->queued = 0;
+	return 0;
+}
+
+static snd_pcm_sframes_t card_pointer(snd_pcm_ioplug_t *io)
+/* played past what was committed, it ran dry */
+{
+	struct bench_card *c = (struct bench_card*)io->private_data;
+	if ((uint64_t)c->pos > c->queued) {
+		return -EPIPE;}
+	return (snd_pcm_sframes_t)((uint64_t)c->pos % io->buffer_size);
+}
+
+static snd_pcm_sframes_t card_transfer(snd_pcm_ioplug_t *io, const snd_pcm_channel_area_t *areas,
+	snd_pcm_uframes_t offset, snd_pcm_uframes_t size)
+{
+	((struct bench_card*)io->private_data)->queued += size;
+	return size;
+}
+
+static int card_close(snd_pcm_ioplug_t *io)
+{
+	struct bench_card *c = (struct bench_card*)io->private_data;
+	close(c->fds[0]);
+	close(c->fds[1]);
+	return 0;
+}
+
+static int card_open(struct bench_card *c, double ppm)
+{
+	static const unsigned int access[1] = {SND_PCM_ACCESS_MMAP_INTERLEAVED};
+	static const unsigned int format[1] = {SND_PCM_FORMAT_S16_LE};
+	static snd_pcm_ioplug_callback_t cb;
+	memset(&cb, 0, sizeof(cb));
+	cb.start = card_start;
+	cb.stop = card_stop;
+	cb.prepare = card_prepare;
+	cb.pointer = card_pointer;
+	cb.transfer = card_transfer;
+	cb.close = card_close;
+	memset(c, 0, sizeof(*c));
+	if (pipe(c->fds) < 0) {
+		return -1;}
+	c->ppm = ppm;
+	c->io.version = SND_PCM_IOPLUG_VERSION;
+	c->io.name = "rtl_fm bench card";
+	c->io.mmap_rw = 1;
+	c->io.poll_fd = c->fds[0];
+	c->io.poll_events = POLLIN;
+	c->io.callback = &cb;
+	c->io.private_data = c;
+	if (snd_pcm_ioplug_create(&c->io, "bench", SND_PCM_STREAM_PLAYBACK, 0) < 0) {
+		close(c->fds[0]);
+		close(c->fds[1]);
+		return -1;
+	}
+	snd_pcm_ioplug_set_param_list(&c->io, SND_PCM_IOPLUG_HW_ACCESS, 1, access);
+	snd_pcm_ioplug_set_param_list(&c->io, SND_PCM_IOPLUG_HW_FORMAT, 1, format);
+	snd_pcm_ioplug_set_param_minmax(&c->io, SND_PCM_IOPLUG_HW_CHANNELS, 2, 2);
+	snd_pcm_ioplug_set_param_minmax(&c->io, SND_PCM_IOPLUG_HW_RATE, 48000, 48000);
+	snd_pcm_ioplug_set_param_minmax(&c->io, SND_PCM_IOPLUG_HW_PERIOD_BYTES, 256, 65536);
+	snd_pcm_ioplug_set_param_minmax(&c->io, SND_PCM_IOPLUG_HW_PERIODS, 2, 64);
+	return 0;
+}
+
+static int bench_alsa(void)
+/* new, no timing: the sink has to start the card itself, again after
+   the xrun made halfway, and with -L hold the delay on a card 300 ppm
+   fast, the loop ending up at the ppm */
+{
+	static struct alsa_sink a;
+	static struct bench_card c;
+	static int16_t block[2 * BENCH_CARD_BLOCK];
+	int blocks = BENCH_CARD_SECS * 48000 / BENCH_CARD_BLOCK;
+	int i, k, n, r = 0, bad;
+	double ppm;
+
+	for (i=0; i<2*BENCH_CARD_BLOCK; i++) {
+		block[i] = (int16_t)((rand() & 0x3fff) - 0x2000);}
+	fprintf(stderr, "alsa sink, mmap into a card that does not start itself, %i s\n", BENCH_CARD_SECS);
+	for (k=0; k<2; k++) {
+		memset(&a, 0, sizeof(a));
+		if (card_open(&c, k ? 300.0 : 0.0) < 0) {
+			fprintf(stderr, "  no ioplug card\n");
+			return 1;
+		}
+		a.pcm = c.io.pcm;
+		if (alsa_sink_open(&a, k ? "bench -L" : "bench", 48000, 2, 0, 0, k ? ALSA_LATENCY_MS : 0) < 0) {
+			return 1;}
+		bad = 0;
+		for (n=0; n<blocks && !bad; n++) {
+			if (c.running) {
+				c.pos += BENCH_CARD_BLOCK * (1.0 + c.ppm * 1e-6);}
+			if (!k && n == blocks / 2 && c.running) {
+				/* a block late, and more */
+				c.pos += a.buffer;}
+			bad = alsa_sink_write(&a, block, 2 * BENCH_CARD_BLOCK) < 0;
+		}
+		ppm = (a.ratio - 1.0) * 1e6;
+		fprintf(stderr, "  %-34s %i starts, %u xruns, %u stalls", k ? "-L 40" : "as is",
+			c.starts, a.xruns, a.stalls);
+		if (k) {
+			fprintf(stderr, ", %+.0f ppm, delay %.0f of %lu frames", ppm, a.fill, (unsigned long)a.target);}
+		fprintf(stderr, "\n");
+		if (bad || a.stalls || a.failures || c.starts != (k ? 1 : 2) || a.xruns != (k ? 0 : 1)) {
+			fprintf(stderr, "  MISMATCH: the card was not started, or not again after the xrun\n");
+			r = 1;
+		}
+		if (k && (!a.fill_n || fabs(ppm - c.ppm) > 20.0 || fabs(a.fill - a.target) > a.target / 10.0)) {
+			fprintf(stderr, "  MISMATCH: drift control did not hold the delay\n");
+			r = 1;
+		}
+		alsa_sink_close(&a);
+	}
+	return r;
+}
+
+int dsp_benchmark(void)
+{
+	int r = 0;
+	srand(1);
+	fprintf(stderr, "cpu: %s, %.0f MHz\n", dsp_cpu_name(dsp_cpu_features()),
+		cycles_per_ns() * 1e3);
+	r |= bench_iq_convert();
+	r |= bench_fir();
+	r |= bench_halfband();
+	r |= bench_resample();
+	r |= bench_atan();
+	r |= bench_fused();
+	r |= bench_pipeline();
+	r |= bench_parallel();
+	r |= bench_float();
+	r |= bench_ring();
+	r |= bench_ingest();
+	r |= bench_rds();
+	r |= bench_stereo();
+	r |= bench_stamp();
+	r |= bench_trace();
+	r |= bench_log();
+	r |= bench_alsa();
+	return r;
+}
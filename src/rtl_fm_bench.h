@@ -0,0 +1,30 @@
+/*
+ * Synthetic benchmarks for the rtl_fm_lib DSP kernels
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RTL_FM_BENCH_H
+#define __RTL_FM_BENCH_H
+
+/*!
+ * Run every kernel benchmark on generated data and report on stderr.
+ * Needs no dongle, so it can be run on any board before deployment.
+ *
+ * \return 0 on success
+ */
+
+extern int dsp_benchmark(void);
+
+#endif /* #ifndef __RTL_FM_BENCH_H */
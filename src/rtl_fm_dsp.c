@@ -0,0 +1,1082 @@
+/*
+ * Vectorized DSP kernels for rtl_fm_lib with runtime CPU dispatch
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DSP_BUILD_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) || (defined(__arm__) && defined(__ARM_FP))
+#define DSP_BUILD_NEON
+#include <sys/auxv.h>
+#if defined(__arm__)
+#include <asm/hwcap.h>
+#ifndef HWCAP_NEON
+#define HWCAP_NEON (1 << 12)
+#endif
+#if !defined(__ARM_NEON)
+/* armv6 build, NEON only exists at runtime on the Pi 2/3/4 */
+#pragma GCC push_options
+#pragma GCC target("fpu=neon")
+#define DSP_NEON_PRAGMA
+#endif
+#endif
+#include <arm_neon.h>
+#endif
+
+#include "rtl_fm_dsp.h"
+
+/* DISC_SCALE is the same scaling as polar_discriminant(), pi == 1<<14 */
+#define DISC_PI			3.14159265f
+#define DISC_PI_2		1.57079633f
+
+/* minimax atan() on [0, 1], max error ~1e-5 rad (0.05 lsb) */
+#define ATAN_P1			 0.99986600f
+#define ATAN_P3			-0.33029950f
+#define ATAN_P5			 0.18014100f
+#define ATAN_P7			-0.08513300f
+#define ATAN_P9			 0.02083510f
+
+static inline float atan2_poly(float y, float x)
+{
+	float ax, ay, mn, mx, a, s, r;
+
+	/* octant reduction, mx >= 1 whenever it is non zero */
+	ax = fabsf(x);
+	ay = fabsf(y);
+	mn = ax < ay ? ax : ay;
+	mx = ax < ay ? ay : ax;
+	if (mx < 1.0f) {
+		mx = 1.0f;}
+	a = mn / mx;
+	s = a * a;
+	r = a * (ATAN_P1 + s * (ATAN_P3 + s * (ATAN_P5 + s * (ATAN_P7 + s * ATAN_P9))));
+	if (ay > ax) {
+		r = DISC_PI_2 - r;}
+	if (x < 0) {
+		r = DISC_PI - r;}
+	if (y < 0) {
+		r = -r;}
+	return r;
+}
+
+int polar_disc_poly(int ar, int aj, int br, int bj)
+{
+	int cr, cj;
+
+	/* a * conj(b) */
+	cr = ar*br + aj*bj;
+	cj = aj*br - ar*bj;
+	return (int)(atan2_poly((float)cj, (float)cr) * DISC_SCALE);
+}
+
+/* lanes of 8 int16 after the fs/4 shuffle [0, 1, 3, 2, 4, 5, 7, 6],
+   negated lanes are -1 and x ^ -1 == -x - 1 so 128-x == (x ^ -1) + 129 */
+static const int16_t rot_neg[8] = {0, 0, -1, 0, -1, -1, 0, -1};
+static const int16_t rot_off[8] = {-127, -127, 129, -127, 129, 129, -127, 129};
+
+static void iq_convert_scalar(const unsigned char *buf, uint32_t len, int rotate, int16_t *out)
+/* 90 rotation is 1+0j, 0+1j, -1+0j, 0-1j
+   or [0, 1, -3, 2, -4, -5, 7, -6]
+   offset binary, 255-x-127 == 128-x */
+{
+	////////// 27Mar2023 First Comment Update ///////////////////////
+	// https://dsp.stackexchange.com/questions/54950/90-degree-phase-shift-rotation-algorithm-for-sdr
+	// 
+	// I believe this algorithm isn’t a rotation (phase shift)
+	// by 90degrees but instead is a frequency shift of fsamp/4. 
+	// In this algorithm each sample is rotated 90 degrees with 
+	// respect to the last one causing a frequency shift:
+	//    
+	//    Samp1: no rotation
+	//    Samp2: 90 degree rotation
+	//    Samp3: 180 degree rotation
+	//    Samp4: 270 degree rotation
+	//    Samp5: 360 -> 0 degree rotation
+	//    Samp6: 90 degree rotation
+	////////////////////////////////////////////////////////
+
+	////////// 27Mar2023 2nd Comment Update ///////////////////////
+	// https://dsp.stackexchange.com/questions/51889/what-exactly-is-a-90-degree-phase-shift-of-a-digital-signal-in-fm-demodulation-a/51898#51898
+	//
+	// I want to mention the possibility that this may 
+	// actually be a delay element and not a phase shift in 
+	// the sense that phase shift implies a shift of that 
+	// phase at all frequencies, while a true delay has a 
+	// phase shift that is proportional to frequency. It is 
+	// this property that is exploited to form simple FM demodulator structures
+	//
+	// For a pure 90 degree phase shift all you need to do is:
+	//
+	//    Ir = -Qi, 
+	//    Qr = Ii 
+	//
+	// at every sample.
+	////////////////////////////////////////////////////////
+
+	uint32_t i = 0;
+	if (rotate) {
+		for (; i + 8 <= len; i += 8) {
+			out[i]   = (int16_t)buf[i] - 127;
+			out[i+1] = (int16_t)buf[i+1] - 127;
+			out[i+2] = 128 - (int16_t)buf[i+3];
+			out[i+3] = (int16_t)buf[i+2] - 127;
+			out[i+4] = 128 - (int16_t)buf[i+4];
+			out[i+5] = 128 - (int16_t)buf[i+5];
+			out[i+6] = (int16_t)buf[i+7] - 127;
+			out[i+7] = 128 - (int16_t)buf[i+6];
+		}
+	}
+	for (; i < len; i++) {
+		out[i] = (int16_t)buf[i] - 127;}
+}
+
+static inline int16_t sat16(int x)
+{
+	if (x > 32767) {
+		return 32767;}
+	if (x < -32768) {
+		return -32768;}
+	return (int16_t)x;
+}
+
+static void halfband_scalar(const int16_t *ev, const int16_t *od, int n,
+	const int16_t *coef, int k, int16_t *out)
+{
+	int i, j, sr, sj;
+	for (i = 0; i < n; i++) {
+		sr = (1 << (HALFBAND_SHIFT-1)) + coef[k+1] * od[2*(i+k)];
+		sj = (1 << (HALFBAND_SHIFT-1)) + coef[k+1] * od[2*(i+k)+1];
+		for (j = 0; j <= k; j++) {
+			sr += coef[j] * (ev[2*(i+k-j)]   + ev[2*(i+k+1+j)]);
+			sj += coef[j] * (ev[2*(i+k-j)+1] + ev[2*(i+k+1+j)+1]);
+		}
+		out[2*i]   = sat16(sr >> HALFBAND_SHIFT);
+		out[2*i+1] = sat16(sj >> HALFBAND_SHIFT);
+	}
+}
+
+static inline void fir_finish(const int32_t *acc, int lanes, const int16_t *x,
+	int ch, const int16_t *coef, int taps, int16_t *out)
+/* vector lanes alternate between the channels, add the centre tap */
+{
+	int c, l, s;
+	for (c = 0; c < ch; c++) {
+		s = (1 << (FIR_SHIFT-1)) + coef[0] * x[ch*(taps/2) + c];
+		for (l = c; l < lanes; l += ch) {
+			s += acc[l];}
+		out[c] = sat16(s >> FIR_SHIFT);
+	}
+}
+
+static void fir_scalar(const int16_t *x, int n, int step, int ch,
+	const int16_t *coef, int taps, int16_t *out)
+{
+	const int16_t *fc = coef + 1;
+	int i, j, c, s, half = taps / 2;
+	for (i = 0; i < n; i++) {
+		for (c = 0; c < ch; c++) {
+			s = (1 << (FIR_SHIFT-1)) + coef[0] * x[ch*half + c];
+			for (j = 0; j < half; j++) {
+				s += fc[ch*j + c] * (x[ch*j + c] + x[ch*(taps-1-j) + c]);}
+			out[ch*i + c] = sat16(s >> FIR_SHIFT);
+		}
+		x += ch * step;
+	}
+}
+
+static int32_t dot_scalar(const int16_t *a, const int16_t *b, int n)
+{
+	int32_t s = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		s += a[i] * b[i];}
+	return s;
+}
+
+static inline float disc_f32(float ar, float aj, float br, float bj)
+{
+	return atan2_poly(aj*br - ar*bj, ar*br + aj*bj);
+}
+
+static void fm_disc_f32_scalar(const float *iq, int len, float pre_r, float pre_j, float *result)
+{
+	int i, n = len / 2;
+	if (n <= 0) {
+		return;}
+	result[0] = disc_f32(iq[0], iq[1], pre_r, pre_j);
+	for (i = 1; i < n; i++) {
+		result[i] = disc_f32(iq[2*i], iq[2*i+1], iq[2*i-2], iq[2*i-1]);}
+}
+
+static void halfband_f32_scalar(const float *ev, const float *od, int n,
+	const float *coef, int k, float *out)
+{
+	int i, j;
+	float sr, sj;
+	for (i = 0; i < n; i++) {
+		sr = coef[k+1] * od[2*(i+k)];
+		sj = coef[k+1] * od[2*(i+k)+1];
+		for (j = 0; j <= k; j++) {
+			sr += coef[j] * (ev[2*(i+k-j)]   + ev[2*(i+k+1+j)]);
+			sj += coef[j] * (ev[2*(i+k-j)+1] + ev[2*(i+k+1+j)+1]);
+		}
+		out[2*i]   = sr;
+		out[2*i+1] = sj;
+	}
+}
+
+static float dot_f32_scalar(const float *a, const float *b, int n)
+{
+	float s = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		s += a[i] * b[i];}
+	return s;
+}
+
+#ifdef DSP_BUILD_X86
+
+#define DSP_SSE2 __attribute__((target("sse2")))
+#define DSP_AVX2 __attribute__((target("avx2")))
+
+static inline DSP_SSE2 __m128 atan2_sse2(__m128 y, __m128 x)
+{
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	__m128 ax, ay, mn, mx, a, s, r, m;
+	ax = _mm_andnot_ps(sign, x);
+	ay = _mm_andnot_ps(sign, y);
+	mn = _mm_min_ps(ax, ay);
+	mx = _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1.0f));
+	a = _mm_div_ps(mn, mx);
+	s = _mm_mul_ps(a, a);
+	r = _mm_add_ps(_mm_set1_ps(ATAN_P7), _mm_mul_ps(s, _mm_set1_ps(ATAN_P9)));
+	r = _mm_add_ps(_mm_set1_ps(ATAN_P5), _mm_mul_ps(s, r));
+	r = _mm_add_ps(_mm_set1_ps(ATAN_P3), _mm_mul_ps(s, r));
+	r = _mm_add_ps(_mm_set1_ps(ATAN_P1), _mm_mul_ps(s, r));
+	r = _mm_mul_ps(a, r);
+	m = _mm_cmpgt_ps(ay, ax);
+	r = _mm_or_ps(_mm_and_ps(m, _mm_sub_ps(_mm_set1_ps(DISC_PI_2), r)), _mm_andnot_ps(m, r));
+	m = _mm_cmplt_ps(x, _mm_setzero_ps());
+	r = _mm_or_ps(_mm_and_ps(m, _mm_sub_ps(_mm_set1_ps(DISC_PI), r)), _mm_andnot_ps(m, r));
+	/* y comes from an int, never -0.0 */
+	return _mm_xor_ps(r, _mm_and_ps(sign, y));
+}
+
+static inline DSP_SSE2 __m128i disc_sse2(__m128i a, __m128i b)
+/* 4 interleaved samples of a * conj(b) -> 4 int32 phases */
+{
+	const __m128i lo = _mm_set1_epi32(0x0000ffff);
+	__m128i bs, cr, cj;
+	/* (br, bj) -> (bj, br) */
+	bs = _mm_shufflelo_epi16(b, _MM_SHUFFLE(2,3,0,1));
+	bs = _mm_shufflehi_epi16(bs, _MM_SHUFFLE(2,3,0,1));
+	cr = _mm_madd_epi16(a, b);
+	cj = _mm_sub_epi32(_mm_madd_epi16(a, _mm_andnot_si128(lo, bs)),
+			   _mm_madd_epi16(a, _mm_and_si128(lo, bs)));
+	return _mm_cvttps_epi32(_mm_mul_ps(atan2_sse2(_mm_cvtepi32_ps(cj), _mm_cvtepi32_ps(cr)),
+					   _mm_set1_ps(DISC_SCALE)));
+}
+
+static DSP_SSE2 void fm_disc_sse2(const int16_t *lp, int len, int pre_r, int pre_j, int16_t *result)
+{
+	int i, n = len / 2;
+	__m128i p0, p1;
+	if (n <= 0) {
+		return;}
+	result[0] = (int16_t)polar_disc_poly(lp[0], lp[1], pre_r, pre_j);
+	/* 8 samples per pass */
+	for (i = 1; i + 8 <= n; i += 8) {
+		p0 = disc_sse2(_mm_loadu_si128((const __m128i*)(lp + 2*i)),
+			       _mm_loadu_si128((const __m128i*)(lp + 2*i - 2)));
+		p1 = disc_sse2(_mm_loadu_si128((const __m128i*)(lp + 2*i + 8)),
+			       _mm_loadu_si128((const __m128i*)(lp + 2*i + 6)));
+		_mm_storeu_si128((__m128i*)(result + i), _mm_packs_epi32(p0, p1));
+	}
+	for (; i < n; i++) {
+		result[i] = (int16_t)polar_disc_poly(lp[2*i], lp[2*i+1], lp[2*i-2], lp[2*i-1]);
+	}
+}
+
+static inline DSP_AVX2 __m256 atan2_avx2(__m256 y, __m256 x)
+{
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	__m256 ax, ay, mn, mx, a, s, r, m;
+	ax = _mm256_andnot_ps(sign, x);
+	ay = _mm256_andnot_ps(sign, y);
+	mn = _mm256_min_ps(ax, ay);
+	mx = _mm256_max_ps(_mm256_max_ps(ax, ay), _mm256_set1_ps(1.0f));
+	a = _mm256_div_ps(mn, mx);
+	s = _mm256_mul_ps(a, a);
+	r = _mm256_add_ps(_mm256_set1_ps(ATAN_P7), _mm256_mul_ps(s, _mm256_set1_ps(ATAN_P9)));
+	r = _mm256_add_ps(_mm256_set1_ps(ATAN_P5), _mm256_mul_ps(s, r));
+	r = _mm256_add_ps(_mm256_set1_ps(ATAN_P3), _mm256_mul_ps(s, r));
+	r = _mm256_add_ps(_mm256_set1_ps(ATAN_P1), _mm256_mul_ps(s, r));
+	r = _mm256_mul_ps(a, r);
+	m = _mm256_cmp_ps(ay, ax, _CMP_GT_OQ);
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(DISC_PI_2), r), m);
+	m = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ);
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(DISC_PI), r), m);
+	return _mm256_xor_ps(r, _mm256_and_ps(sign, y));
+}
+
+static inline DSP_AVX2 __m256i disc_avx2(__m256i a, __m256i b)
+{
+	const __m256i lo = _mm256_set1_epi32(0x0000ffff);
+	__m256i bs, cr, cj;
+	bs = _mm256_shufflelo_epi16(b, _MM_SHUFFLE(2,3,0,1));
+	bs = _mm256_shufflehi_epi16(bs, _MM_SHUFFLE(2,3,0,1));
+	cr = _mm256_madd_epi16(a, b);
+	cj = _mm256_sub_epi32(_mm256_madd_epi16(a, _mm256_andnot_si256(lo, bs)),
+			      _mm256_madd_epi16(a, _mm256_and_si256(lo, bs)));
+	return _mm256_cvttps_epi32(_mm256_mul_ps(atan2_avx2(_mm256_cvtepi32_ps(cj), _mm256_cvtepi32_ps(cr)),
+						 _mm256_set1_ps(DISC_SCALE)));
+}
+
+static DSP_AVX2 void fm_disc_avx2(const int16_t *lp, int len, int pre_r, int pre_j, int16_t *result)
+{
+	int i, n = len / 2;
+	__m256i p0, p1, p;
+	if (n <= 0) {
+		return;}
+	result[0] = (int16_t)polar_disc_poly(lp[0], lp[1], pre_r, pre_j);
+	/* 16 samples per pass */
+	for (i = 1; i + 16 <= n; i += 16) {
+		p0 = disc_avx2(_mm256_loadu_si256((const __m256i*)(lp + 2*i)),
+			       _mm256_loadu_si256((const __m256i*)(lp + 2*i - 2)));
+		p1 = disc_avx2(_mm256_loadu_si256((const __m256i*)(lp + 2*i + 16)),
+			       _mm256_loadu_si256((const __m256i*)(lp + 2*i + 14)));
+		/* packs works per 128 bit lane, put the quads back in order */
+		p = _mm256_permute4x64_epi64(_mm256_packs_epi32(p0, p1), _MM_SHUFFLE(3,1,2,0));
+		_mm256_storeu_si256((__m256i*)(result + i), p);
+	}
+	for (; i < n; i++) {
+		result[i] = (int16_t)polar_disc_poly(lp[2*i], lp[2*i+1], lp[2*i-2], lp[2*i-1]);
+	}
+}
+
+static DSP_SSE2 void iq_convert_sse2(const unsigned char *buf, uint32_t len, int rotate, int16_t *out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i neg = _mm_setzero_si128();
+	__m128i off = _mm_set1_epi16(-127);
+	__m128i v, lo, hi;
+	uint32_t i;
+	if (rotate) {
+		neg = _mm_loadu_si128((const __m128i*)rot_neg);
+		off = _mm_loadu_si128((const __m128i*)rot_off);
+	}
+	/* 16 bytes per pass */
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i*)(buf + i));
+		lo = _mm_unpacklo_epi8(v, zero);
+		hi = _mm_unpackhi_epi8(v, zero);
+		if (rotate) {
+			lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(2,3,1,0)), _MM_SHUFFLE(2,3,1,0));
+			hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(2,3,1,0)), _MM_SHUFFLE(2,3,1,0));
+		}
+		_mm_storeu_si128((__m128i*)(out + i), _mm_add_epi16(_mm_xor_si128(lo, neg), off));
+		_mm_storeu_si128((__m128i*)(out + i + 8), _mm_add_epi16(_mm_xor_si128(hi, neg), off));
+	}
+	iq_convert_scalar(buf + i, len - i, rotate, out + i);
+}
+
+static DSP_AVX2 void iq_convert_avx2(const unsigned char *buf, uint32_t len, int rotate, int16_t *out)
+{
+	__m256i neg = _mm256_setzero_si256();
+	__m256i off = _mm256_set1_epi16(-127);
+	__m256i lo, hi;
+	uint32_t i;
+	if (rotate) {
+		neg = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)rot_neg));
+		off = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)rot_off));
+	}
+	/* 32 bytes per pass */
+	for (i = 0; i + 32 <= len; i += 32) {
+		lo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(buf + i)));
+		hi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(buf + i + 16)));
+		if (rotate) {
+			lo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, _MM_SHUFFLE(2,3,1,0)), _MM_SHUFFLE(2,3,1,0));
+			hi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, _MM_SHUFFLE(2,3,1,0)), _MM_SHUFFLE(2,3,1,0));
+		}
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi16(_mm256_xor_si256(lo, neg), off));
+		_mm256_storeu_si256((__m256i*)(out + i + 16), _mm256_add_epi16(_mm256_xor_si256(hi, neg), off));
+	}
+	iq_convert_scalar(buf + i, len - i, rotate, out + i);
+}
+
+static DSP_SSE2 void halfband_sse2(const int16_t *ev, const int16_t *od, int n,
+	const int16_t *coef, int k, int16_t *out)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(1 << (HALFBAND_SHIFT-1));
+	__m128i a, b, h, lo, hi;
+	int i, j;
+	/* 4 complex outputs per pass, madd on (I_a, I_b) pairs folds the taps */
+	for (i = 0; i + 4 <= n; i += 4) {
+		a = _mm_loadu_si128((const __m128i*)(od + 2*(i+k)));
+		h = _mm_set1_epi16(coef[k+1]);
+		lo = _mm_add_epi32(round, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), h));
+		hi = _mm_add_epi32(round, _mm_madd_epi16(_mm_unpackhi_epi16(a, zero), h));
+		for (j = 0; j <= k; j++) {
+			a = _mm_loadu_si128((const __m128i*)(ev + 2*(i+k-j)));
+			b = _mm_loadu_si128((const __m128i*)(ev + 2*(i+k+1+j)));
+			h = _mm_set1_epi16(coef[j]);
+			lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), h));
+			hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), h));
+		}
+		lo = _mm_srai_epi32(lo, HALFBAND_SHIFT);
+		hi = _mm_srai_epi32(hi, HALFBAND_SHIFT);
+		_mm_storeu_si128((__m128i*)(out + 2*i), _mm_packs_epi32(lo, hi));
+	}
+	halfband_scalar(ev + 2*i, od + 2*i, n - i, coef, k, out + 2*i);
+}
+
+static DSP_AVX2 void halfband_avx2(const int16_t *ev, const int16_t *od, int n,
+	const int16_t *coef, int k, int16_t *out)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i round = _mm256_set1_epi32(1 << (HALFBAND_SHIFT-1));
+	__m256i a, b, h, lo, hi;
+	int i, j;
+	/* 8 complex outputs per pass, unpack and packs both work per
+	   128 bit lane so the outputs come back out in order */
+	for (i = 0; i + 8 <= n; i += 8) {
+		a = _mm256_loadu_si256((const __m256i*)(od + 2*(i+k)));
+		h = _mm256_set1_epi16(coef[k+1]);
+		lo = _mm256_add_epi32(round, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, zero), h));
+		hi = _mm256_add_epi32(round, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, zero), h));
+		for (j = 0; j <= k; j++) {
+			a = _mm256_loadu_si256((const __m256i*)(ev + 2*(i+k-j)));
+			b = _mm256_loadu_si256((const __m256i*)(ev + 2*(i+k+1+j)));
+			h = _mm256_set1_epi16(coef[j]);
+			lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), h));
+			hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), h));
+		}
+		lo = _mm256_srai_epi32(lo, HALFBAND_SHIFT);
+		hi = _mm256_srai_epi32(hi, HALFBAND_SHIFT);
+		_mm256_storeu_si256((__m256i*)(out + 2*i), _mm256_packs_epi32(lo, hi));
+	}
+	halfband_scalar(ev + 2*i, od + 2*i, n - i, coef, k, out + 2*i);
+}
+
+static inline DSP_SSE2 __m128i fir_reverse_sse2(__m128i b, int ch)
+/* reverse the sample order, keeping I/Q pairs together */
+{
+	b = _mm_shuffle_epi32(b, _MM_SHUFFLE(0,1,2,3));
+	if (ch == 1) {
+		b = _mm_shufflelo_epi16(b, _MM_SHUFFLE(2,3,0,1));
+		b = _mm_shufflehi_epi16(b, _MM_SHUFFLE(2,3,0,1));}
+	return b;
+}
+
+static DSP_SSE2 void fir_sse2(const int16_t *x, int n, int step, int ch,
+	const int16_t *coef, int taps, int16_t *out)
+{
+	const int16_t *fc = coef + 1;
+	int g = 8 / ch, half = taps / 2;
+	int i, j;
+	int32_t acc[4];
+	__m128i a, b, h, s;
+	for (i = 0; i < n; i++) {
+		s = _mm_setzero_si128();
+		/* madd on (front, back) pairs folds the taps */
+		for (j = 0; j < half; j += g) {
+			a = _mm_loadu_si128((const __m128i*)(x + ch*j));
+			b = fir_reverse_sse2(_mm_loadu_si128((const __m128i*)(x + ch*(taps-g-j))), ch);
+			h = _mm_loadu_si128((const __m128i*)(fc + ch*j));
+			s = _mm_add_epi32(s, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), _mm_unpacklo_epi16(h, h)));
+			s = _mm_add_epi32(s, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), _mm_unpackhi_epi16(h, h)));
+		}
+		/* fold the lanes down to one per channel */
+		s = _mm_add_epi32(s, _mm_srli_si128(s, 8));
+		if (ch == 1) {
+			s = _mm_add_epi32(s, _mm_srli_si128(s, 4));}
+		_mm_storeu_si128((__m128i*)acc, s);
+		fir_finish(acc, ch, x, ch, coef, taps, out + ch*i);
+		x += ch * step;
+	}
+}
+
+static DSP_AVX2 void fir_avx2(const int16_t *x, int n, int step, int ch,
+	const int16_t *coef, int taps, int16_t *out)
+{
+	const __m256i rev = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+	const int16_t *fc = coef + 1;
+	int g = 16 / ch, half = taps / 2;
+	int i, j;
+	int32_t acc[4];
+	__m256i a, b, h, s;
+	__m128i t;
+	for (i = 0; i < n; i++) {
+		s = _mm256_setzero_si256();
+		for (j = 0; j < half; j += g) {
+			a = _mm256_loadu_si256((const __m256i*)(x + ch*j));
+			b = _mm256_loadu_si256((const __m256i*)(x + ch*(taps-g-j)));
+			b = _mm256_permutevar8x32_epi32(b, rev);
+			if (ch == 1) {
+				b = _mm256_shufflelo_epi16(b, _MM_SHUFFLE(2,3,0,1));
+				b = _mm256_shufflehi_epi16(b, _MM_SHUFFLE(2,3,0,1));}
+			h = _mm256_loadu_si256((const __m256i*)(fc + ch*j));
+			/* unpack works per 128 bit lane, the same for data and taps */
+			s = _mm256_add_epi32(s, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), _mm256_unpacklo_epi16(h, h)));
+			s = _mm256_add_epi32(s, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), _mm256_unpackhi_epi16(h, h)));
+		}
+		t = _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+		t = _mm_add_epi32(t, _mm_srli_si128(t, 8));
+		if (ch == 1) {
+			t = _mm_add_epi32(t, _mm_srli_si128(t, 4));}
+		_mm_storeu_si128((__m128i*)acc, t);
+		fir_finish(acc, ch, x, ch, coef, taps, out + ch*i);
+		x += ch * step;
+	}
+}
+
+static DSP_SSE2 int32_t dot_sse2(const int16_t *a, const int16_t *b, int n)
+{
+	__m128i s = _mm_setzero_si128();
+	int i;
+	for (i = 0; i < n; i += 8) {
+		s = _mm_add_epi32(s, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(a + i)),
+						    _mm_loadu_si128((const __m128i*)(b + i))));
+	}
+	s = _mm_add_epi32(s, _mm_srli_si128(s, 8));
+	s = _mm_add_epi32(s, _mm_srli_si128(s, 4));
+	return _mm_cvtsi128_si32(s);
+}
+
+static DSP_AVX2 int32_t dot_avx2(const int16_t *a, const int16_t *b, int n)
+{
+	__m256i s = _mm256_setzero_si256();
+	__m128i t;
+	int i;
+	for (i = 0; i < n; i += 16) {
+		s = _mm256_add_epi32(s, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(a + i)),
+							  _mm256_loadu_si256((const __m256i*)(b + i))));
+	}
+	t = _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+	t = _mm_add_epi32(t, _mm_srli_si128(t, 8));
+	t = _mm_add_epi32(t, _mm_srli_si128(t, 4));
+	return _mm_cvtsi128_si32(t);
+}
+
+static DSP_SSE2 void fm_disc_f32_sse2(const float *iq, int len, float pre_r, float pre_j, float *result)
+{
+	int i, n = len / 2;
+	__m128 a0, a1, b0, b1, ar, aj, br, bj, cr, cj;
+	if (n <= 0) {
+		return;}
+	result[0] = disc_f32(iq[0], iq[1], pre_r, pre_j);
+	/* 4 samples per pass, split I and Q with two shuffles */
+	for (i = 1; i + 4 <= n; i += 4) {
+		a0 = _mm_loadu_ps(iq + 2*i);
+		a1 = _mm_loadu_ps(iq + 2*i + 4);
+		b0 = _mm_loadu_ps(iq + 2*i - 2);
+		b1 = _mm_loadu_ps(iq + 2*i + 2);
+		ar = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2,0,2,0));
+		aj = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3,1,3,1));
+		br = _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2,0,2,0));
+		bj = _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3,1,3,1));
+		cr = _mm_add_ps(_mm_mul_ps(ar, br), _mm_mul_ps(aj, bj));
+		cj = _mm_sub_ps(_mm_mul_ps(aj, br), _mm_mul_ps(ar, bj));
+		_mm_storeu_ps(result + i, atan2_sse2(cj, cr));
+	}
+	for (; i < n; i++) {
+		result[i] = disc_f32(iq[2*i], iq[2*i+1], iq[2*i-2], iq[2*i-1]);}
+}
+
+static DSP_AVX2 void fm_disc_f32_avx2(const float *iq, int len, float pre_r, float pre_j, float *result)
+{
+	int i, n = len / 2;
+	__m256 a0, a1, b0, b1, ar, aj, br, bj, cr, cj, r;
+	if (n <= 0) {
+		return;}
+	result[0] = disc_f32(iq[0], iq[1], pre_r, pre_j);
+	/* 8 samples per pass, the shuffles work per 128 bit lane
+	   so the pairs of outputs come out as 0 2 1 3 */
+	for (i = 1; i + 8 <= n; i += 8) {
+		a0 = _mm256_loadu_ps(iq + 2*i);
+		a1 = _mm256_loadu_ps(iq + 2*i + 8);
+		b0 = _mm256_loadu_ps(iq + 2*i - 2);
+		b1 = _mm256_loadu_ps(iq + 2*i + 6);
+		ar = _mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(2,0,2,0));
+		aj = _mm256_shuffle_ps(a0, a1, _MM_SHUFFLE(3,1,3,1));
+		br = _mm256_shuffle_ps(b0, b1, _MM_SHUFFLE(2,0,2,0));
+		bj = _mm256_shuffle_ps(b0, b1, _MM_SHUFFLE(3,1,3,1));
+		cr = _mm256_add_ps(_mm256_mul_ps(ar, br), _mm256_mul_ps(aj, bj));
+		cj = _mm256_sub_ps(_mm256_mul_ps(aj, br), _mm256_mul_ps(ar, bj));
+		r = atan2_avx2(cj, cr);
+		r = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(r), _MM_SHUFFLE(3,1,2,0)));
+		_mm256_storeu_ps(result + i, r);
+	}
+	for (; i < n; i++) {
+		result[i] = disc_f32(iq[2*i], iq[2*i+1], iq[2*i-2], iq[2*i-1]);}
+}
+
+static DSP_SSE2 void halfband_f32_sse2(const float *ev, const float *od, int n,
+	const float *coef, int k, float *out)
+{
+	__m128 lo, hi, h;
+	int i, j;
+	/* 4 complex outputs per pass, I and Q ride along in the lanes */
+	for (i = 0; i + 4 <= n; i += 4) {
+		h = _mm_set1_ps(coef[k+1]);
+		lo = _mm_mul_ps(h, _mm_loadu_ps(od + 2*(i+k)));
+		hi = _mm_mul_ps(h, _mm_loadu_ps(od + 2*(i+k) + 4));
+		for (j = 0; j <= k; j++) {
+			h = _mm_set1_ps(coef[j]);
+			lo = _mm_add_ps(lo, _mm_mul_ps(h, _mm_add_ps(_mm_loadu_ps(ev + 2*(i+k-j)),
+								    _mm_loadu_ps(ev + 2*(i+k+1+j)))));
+			hi = _mm_add_ps(hi, _mm_mul_ps(h, _mm_add_ps(_mm_loadu_ps(ev + 2*(i+k-j) + 4),
+								    _mm_loadu_ps(ev + 2*(i+k+1+j) + 4))));
+		}
+		_mm_storeu_ps(out + 2*i, lo);
+		_mm_storeu_ps(out + 2*i + 4, hi);
+	}
+	halfband_f32_scalar(ev + 2*i, od + 2*i, n - i, coef, k, out + 2*i);
+}
+
+static DSP_AVX2 void halfband_f32_avx2(const float *ev, const float *od, int n,
+	const float *coef, int k, float *out)
+{
+	__m256 lo, hi, h;
+	int i, j;
+	/* 8 complex outputs per pass */
+	for (i = 0; i + 8 <= n; i += 8) {
+		h = _mm256_set1_ps(coef[k+1]);
+		lo = _mm256_mul_ps(h, _mm256_loadu_ps(od + 2*(i+k)));
+		hi = _mm256_mul_ps(h, _mm256_loadu_ps(od + 2*(i+k) + 8));
+		for (j = 0; j <= k; j++) {
+			h = _mm256_set1_ps(coef[j]);
+			lo = _mm256_add_ps(lo, _mm256_mul_ps(h, _mm256_add_ps(_mm256_loadu_ps(ev + 2*(i+k-j)),
+									     _mm256_loadu_ps(ev + 2*(i+k+1+j)))));
+			hi = _mm256_add_ps(hi, _mm256_mul_ps(h, _mm256_add_ps(_mm256_loadu_ps(ev + 2*(i+k-j) + 8),
+									     _mm256_loadu_ps(ev + 2*(i+k+1+j) + 8))));
+		}
+		_mm256_storeu_ps(out + 2*i, lo);
+		_mm256_storeu_ps(out + 2*i + 8, hi);
+	}
+	halfband_f32_scalar(ev + 2*i, od + 2*i, n - i, coef, k, out + 2*i);
+}
+
+static DSP_SSE2 float dot_f32_sse2(const float *a, const float *b, int n)
+{
+	__m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+	__m128 s2 = _mm_setzero_ps(), s3 = _mm_setzero_ps();
+	int i;
+	/* four sums so the adds do not wait on each other */
+	for (i = 0; i < n; i += 16) {
+		s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i),      _mm_loadu_ps(b + i)));
+		s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4),  _mm_loadu_ps(b + i + 4)));
+		s2 = _mm_add_ps(s2, _mm_mul_ps(_mm_loadu_ps(a + i + 8),  _mm_loadu_ps(b + i + 8)));
+		s3 = _mm_add_ps(s3, _mm_mul_ps(_mm_loadu_ps(a + i + 12), _mm_loadu_ps(b + i + 12)));
+	}
+	s0 = _mm_add_ps(_mm_add_ps(s0, s1), _mm_add_ps(s2, s3));
+	s0 = _mm_add_ps(s0, _mm_movehl_ps(s0, s0));
+	s0 = _mm_add_ss(s0, _mm_shuffle_ps(s0, s0, 1));
+	return _mm_cvtss_f32(s0);
+}
+
+static DSP_AVX2 float dot_f32_avx2(const float *a, const float *b, int n)
+{
+	__m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+	__m128 t;
+	int i;
+	for (i = 0; i < n; i += 16) {
+		s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(a + i),     _mm256_loadu_ps(b + i)));
+		s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+	}
+	s0 = _mm256_add_ps(s0, s1);
+	t = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+	t = _mm_add_ps(t, _mm_movehl_ps(t, t));
+	t = _mm_add_ss(t, _mm_shuffle_ps(t, t, 1));
+	return _mm_cvtss_f32(t);
+}
+
+#endif /* DSP_BUILD_X86 */
+
+#ifdef DSP_BUILD_NEON
+
+static inline float32x4_t atan2_neon(float32x4_t y, float32x4_t x)
+{
+	float32x4_t ax, ay, mn, mx, inv, a, s, r;
+	uint32x4_t m;
+	ax = vabsq_f32(x);
+	ay = vabsq_f32(y);
+	mn = vminq_f32(ax, ay);
+	mx = vmaxq_f32(vmaxq_f32(ax, ay), vdupq_n_f32(1.0f));
+	/* no vector divide on armv7, reciprocal estimate + 2 newton steps */
+	inv = vrecpeq_f32(mx);
+	inv = vmulq_f32(vrecpsq_f32(mx, inv), inv);
+	inv = vmulq_f32(vrecpsq_f32(mx, inv), inv);
+	a = vmulq_f32(mn, inv);
+	s = vmulq_f32(a, a);
+	r = vmlaq_f32(vdupq_n_f32(ATAN_P7), s, vdupq_n_f32(ATAN_P9));
+	r = vmlaq_f32(vdupq_n_f32(ATAN_P5), s, r);
+	r = vmlaq_f32(vdupq_n_f32(ATAN_P3), s, r);
+	r = vmlaq_f32(vdupq_n_f32(ATAN_P1), s, r);
+	r = vmulq_f32(a, r);
+	m = vcgtq_f32(ay, ax);
+	r = vbslq_f32(m, vsubq_f32(vdupq_n_f32(DISC_PI_2), r), r);
+	m = vcltq_f32(x, vdupq_n_f32(0.0f));
+	r = vbslq_f32(m, vsubq_f32(vdupq_n_f32(DISC_PI), r), r);
+	m = vandq_u32(vreinterpretq_u32_f32(y), vdupq_n_u32(0x80000000));
+	return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(r), m));
+}
+
+static inline int16x4_t disc_neon(int16x4_t ar, int16x4_t aj, int16x4_t br, int16x4_t bj)
+{
+	int32x4_t cr, cj;
+	float32x4_t r;
+	cr = vmlal_s16(vmull_s16(ar, br), aj, bj);
+	cj = vmlsl_s16(vmull_s16(aj, br), ar, bj);
+	r = atan2_neon(vcvtq_f32_s32(cj), vcvtq_f32_s32(cr));
+	return vqmovn_s32(vcvtq_s32_f32(vmulq_f32(r, vdupq_n_f32(DISC_SCALE))));
+}
+
+static void fm_disc_neon(const int16_t *lp, int len, int pre_r, int pre_j, int16_t *result)
+{
+	int i, n = len / 2;
+	int16x8x2_t a, b;
+	int16x4_t p0, p1;
+	if (n <= 0) {
+		return;}
+	result[0] = (int16_t)polar_disc_poly(lp[0], lp[1], pre_r, pre_j);
+	/* 8 samples per pass, vld2 splits I and Q for free */
+	for (i = 1; i + 8 <= n; i += 8) {
+		a = vld2q_s16(lp + 2*i);
+		b = vld2q_s16(lp + 2*i - 2);
+		p0 = disc_neon(vget_low_s16(a.val[0]), vget_low_s16(a.val[1]),
+			       vget_low_s16(b.val[0]), vget_low_s16(b.val[1]));
+		p1 = disc_neon(vget_high_s16(a.val[0]), vget_high_s16(a.val[1]),
+			       vget_high_s16(b.val[0]), vget_high_s16(b.val[1]));
+		vst1q_s16(result + i, vcombine_s16(p0, p1));
+	}
+	for (; i < n; i++) {
+		result[i] = (int16_t)polar_disc_poly(lp[2*i], lp[2*i+1], lp[2*i-2], lp[2*i-1]);
+	}
+}
+
+static void iq_convert_neon(const unsigned char *buf, uint32_t len, int rotate, int16_t *out)
+{
+	const uint16_t swap_lanes[8] = {0, 0, 0xffff, 0xffff, 0, 0, 0xffff, 0xffff};
+	uint16x8_t swap = vld1q_u16(swap_lanes);
+	int16x8_t neg = vdupq_n_s16(0);
+	int16x8_t off = vdupq_n_s16(-127);
+	uint8x16_t v;
+	int16x8_t lo, hi;
+	uint32_t i;
+	if (rotate) {
+		neg = vld1q_s16(rot_neg);
+		off = vld1q_s16(rot_off);
+	}
+	/* 16 bytes per pass */
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = vld1q_u8(buf + i);
+		lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(v)));
+		hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(v)));
+		if (rotate) {
+			lo = vbslq_s16(swap, vrev32q_s16(lo), lo);
+			hi = vbslq_s16(swap, vrev32q_s16(hi), hi);
+		}
+		vst1q_s16(out + i, vaddq_s16(veorq_s16(lo, neg), off));
+		vst1q_s16(out + i + 8, vaddq_s16(veorq_s16(hi, neg), off));
+	}
+	iq_convert_scalar(buf + i, len - i, rotate, out + i);
+}
+
+static void halfband_neon(const int16_t *ev, const int16_t *od, int n,
+	const int16_t *coef, int k, int16_t *out)
+{
+	const int32x4_t round = vdupq_n_s32(1 << (HALFBAND_SHIFT-1));
+	int16x8_t a, b;
+	int32x4_t lo, hi;
+	int i, j;
+	/* 4 complex outputs per pass */
+	for (i = 0; i + 4 <= n; i += 4) {
+		a = vld1q_s16(od + 2*(i+k));
+		lo = vmlal_n_s16(round, vget_low_s16(a), coef[k+1]);
+		hi = vmlal_n_s16(round, vget_high_s16(a), coef[k+1]);
+		for (j = 0; j <= k; j++) {
+			a = vld1q_s16(ev + 2*(i+k-j));
+			b = vld1q_s16(ev + 2*(i+k+1+j));
+			lo = vmlaq_n_s32(lo, vaddl_s16(vget_low_s16(a), vget_low_s16(b)), coef[j]);
+			hi = vmlaq_n_s32(hi, vaddl_s16(vget_high_s16(a), vget_high_s16(b)), coef[j]);
+		}
+		vst1q_s16(out + 2*i, vcombine_s16(vqshrn_n_s32(lo, HALFBAND_SHIFT),
+						  vqshrn_n_s32(hi, HALFBAND_SHIFT)));
+	}
+	halfband_scalar(ev + 2*i, od + 2*i, n - i, coef, k, out + 2*i);
+}
+
+static void fir_neon(const int16_t *x, int n, int step, int ch,
+	const int16_t *coef, int taps, int16_t *out)
+{
+	const int16_t *fc = coef + 1;
+	int g = 8 / ch, half = taps / 2;
+	int i, j;
+	int32_t acc[4];
+	int16x8_t a, b, h;
+	int32x4_t lo, hi;
+	for (i = 0; i < n; i++) {
+		lo = vdupq_n_s32(0);
+		hi = vdupq_n_s32(0);
+		for (j = 0; j < half; j += g) {
+			a = vld1q_s16(x + ch*j);
+			b = vld1q_s16(x + ch*(taps-g-j));
+			/* reverse the sample order, keeping I/Q pairs together */
+			if (ch == 1) {
+				b = vrev64q_s16(b);
+			} else {
+				b = vreinterpretq_s16_s32(vrev64q_s32(vreinterpretq_s32_s16(b)));}
+			b = vcombine_s16(vget_high_s16(b), vget_low_s16(b));
+			h = vld1q_s16(fc + ch*j);
+			lo = vmlal_s16(lo, vget_low_s16(a), vget_low_s16(h));
+			lo = vmlal_s16(lo, vget_low_s16(b), vget_low_s16(h));
+			hi = vmlal_s16(hi, vget_high_s16(a), vget_high_s16(h));
+			hi = vmlal_s16(hi, vget_high_s16(b), vget_high_s16(h));
+		}
+		lo = vaddq_s32(lo, hi);
+		lo = vaddq_s32(lo, vcombine_s32(vget_high_s32(lo), vget_low_s32(lo)));
+		vst1q_s32(acc, lo);
+		fir_finish(acc, 2, x, ch, coef, taps, out + ch*i);
+		x += ch * step;
+	}
+}
+
+static int32_t dot_neon(const int16_t *a, const int16_t *b, int n)
+{
+	int32x4_t s = vdupq_n_s32(0);
+	int16x8_t x, y;
+	int32x2_t t;
+	int i;
+	for (i = 0; i < n; i += 8) {
+		x = vld1q_s16(a + i);
+		y = vld1q_s16(b + i);
+		s = vmlal_s16(s, vget_low_s16(x), vget_low_s16(y));
+		s = vmlal_s16(s, vget_high_s16(x), vget_high_s16(y));
+	}
+	t = vadd_s32(vget_low_s32(s), vget_high_s32(s));
+	return vget_lane_s32(vpadd_s32(t, t), 0);
+}
+
+static void fm_disc_f32_neon(const float *iq, int len, float pre_r, float pre_j, float *result)
+{
+	int i, n = len / 2;
+	float32x4x2_t a, b;
+	float32x4_t cr, cj;
+	if (n <= 0) {
+		return;}
+	result[0] = disc_f32(iq[0], iq[1], pre_r, pre_j);
+	/* 4 samples per pass, vld2 splits I and Q for free */
+	for (i = 1; i + 4 <= n; i += 4) {
+		a = vld2q_f32(iq + 2*i);
+		b = vld2q_f32(iq + 2*i - 2);
+		cr = vmlaq_f32(vmulq_f32(a.val[0], b.val[0]), a.val[1], b.val[1]);
+		cj = vmlsq_f32(vmulq_f32(a.val[1], b.val[0]), a.val[0], b.val[1]);
+		vst1q_f32(result + i, atan2_neon(cj, cr));
+	}
+	for (; i < n; i++) {
+		result[i] = disc_f32(iq[2*i], iq[2*i+1], iq[2*i-2], iq[2*i-1]);}
+}
+
+static void halfband_f32_neon(const float *ev, const float *od, int n,
+	const float *coef, int k, float *out)
+{
+	float32x4_t lo, hi;
+	int i, j;
+	/* 4 complex outputs per pass */
+	for (i = 0; i + 4 <= n; i += 4) {
+		lo = vmulq_n_f32(vld1q_f32(od + 2*(i+k)), coef[k+1]);
+		hi = vmulq_n_f32(vld1q_f32(od + 2*(i+k) + 4), coef[k+1]);
+		for (j = 0; j <= k; j++) {
+			lo = vmlaq_n_f32(lo, vaddq_f32(vld1q_f32(ev + 2*(i+k-j)),
+						       vld1q_f32(ev + 2*(i+k+1+j))), coef[j]);
+			hi = vmlaq_n_f32(hi, vaddq_f32(vld1q_f32(ev + 2*(i+k-j) + 4),
+						       vld1q_f32(ev + 2*(i+k+1+j) + 4)), coef[j]);
+		}
+		vst1q_f32(out + 2*i, lo);
+		vst1q_f32(out + 2*i + 4, hi);
+	}
+	halfband_f32_scalar(ev + 2*i, od + 2*i, n - i, coef, k, out + 2*i);
+}
+
+static float dot_f32_neon(const float *a, const float *b, int n)
+{
+	float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+	float32x4_t s2 = vdupq_n_f32(0), s3 = vdupq_n_f32(0);
+	float32x2_t t;
+	int i;
+	for (i = 0; i < n; i += 16) {
+		s0 = vmlaq_f32(s0, vld1q_f32(a + i),      vld1q_f32(b + i));
+		s1 = vmlaq_f32(s1, vld1q_f32(a + i + 4),  vld1q_f32(b + i + 4));
+		s2 = vmlaq_f32(s2, vld1q_f32(a + i + 8),  vld1q_f32(b + i + 8));
+		s3 = vmlaq_f32(s3, vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+	}
+	s0 = vaddq_f32(vaddq_f32(s0, s1), vaddq_f32(s2, s3));
+	t = vadd_f32(vget_low_f32(s0), vget_high_f32(s0));
+	return vget_lane_f32(vpadd_f32(t, t), 0);
+}
+
+#ifdef DSP_NEON_PRAGMA
+#pragma GCC pop_options
+#endif
+
+#endif /* DSP_BUILD_NEON */
+
+int dsp_cpu_features(void)
+{
+	int features = 0;
+#if defined(DSP_BUILD_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		features |= DSP_CPU_SSE2;}
+	if (__builtin_cpu_supports("avx2")) {
+		features |= DSP_CPU_AVX2;}
+#elif defined(__aarch64__)
+	features |= DSP_CPU_NEON;
+#elif defined(DSP_BUILD_NEON)
+	if (getauxval(AT_HWCAP) & HWCAP_NEON) {
+		features |= DSP_CPU_NEON;}
+#endif
+	return features;
+}
+
+const char *dsp_cpu_name(int features)
+{
+	if (features & DSP_CPU_AVX2) {
+		return "avx2";}
+	if (features & DSP_CPU_SSE2) {
+		return "sse2";}
+	if (features & DSP_CPU_NEON) {
+		return "neon";}
+	return "scalar";
+}
+
+fm_disc_fn fm_disc_simd_select(int features)
+{
+#if defined(DSP_BUILD_X86)
+	if (features & DSP_CPU_AVX2) {
+		return &fm_disc_avx2;}
+	if (features & DSP_CPU_SSE2) {
+		return &fm_disc_sse2;}
+#elif defined(DSP_BUILD_NEON)
+	if (features & DSP_CPU_NEON) {
+		return &fm_disc_neon;}
+#endif
+	return NULL;
+}
+
+iq_convert_fn iq_convert_select(int features)
+{
+#if defined(DSP_BUILD_X86)
+	if (features & DSP_CPU_AVX2) {
+		return &iq_convert_avx2;}
+	if (features & DSP_CPU_SSE2) {
+		return &iq_convert_sse2;}
+#elif defined(DSP_BUILD_NEON)
+	if (features & DSP_CPU_NEON) {
+		return &iq_convert_neon;}
+#endif
+	return &iq_convert_scalar;
+}
+
+halfband_fn halfband_select(int features)
+{
+#if defined(DSP_BUILD_X86)
+	if (features & DSP_CPU_AVX2) {
+		return &halfband_avx2;}
+	if (features & DSP_CPU_SSE2) {
+		return &halfband_sse2;}
+#elif defined(DSP_BUILD_NEON)
+	if (features & DSP_CPU_NEON) {
+		return &halfband_neon;}
+#endif
+	return &halfband_scalar;
+}
+
+fir_fn fir_select(int features)
+{
+#if defined(DSP_BUILD_X86)
+	if (features & DSP_CPU_AVX2) {
+		return &fir_avx2;}
+	if (features & DSP_CPU_SSE2) {
+		return &fir_sse2;}
+#elif defined(DSP_BUILD_NEON)
+	if (features & DSP_CPU_NEON) {
+		return &fir_neon;}
+#endif
+	return &fir_scalar;
+}
+
+dot_fn dot_select(int features)
+{
+#if defined(DSP_BUILD_X86)
+	if (features & DSP_CPU_AVX2) {
+		return &dot_avx2;}
+	if (features & DSP_CPU_SSE2) {
+		return &dot_sse2;}
+#elif defined(DSP_BUILD_NEON)
+	if (features & DSP_CPU_NEON) {
+		return &dot_neon;}
+#endif
+	return &dot_scalar;
+}
+
+fm_disc_f32_fn fm_disc_f32_select(int features)
+{
+#if defined(DSP_BUILD_X86)
+	if (features & DSP_CPU_AVX2) {
+		return &fm_disc_f32_avx2;}
+	if (features & DSP_CPU_SSE2) {
+		return &fm_disc_f32_sse2;}
+#elif defined(DSP_BUILD_NEON)
+	if (features & DSP_CPU_NEON) {
+		return &fm_disc_f32_neon;}
+#endif
+	return &fm_disc_f32_scalar;
+}
+
+halfband_f32_fn halfband_f32_select(int features)
+{
+#if defined(DSP_BUILD_X86)
+	if (features & DSP_CPU_AVX2) {
+		return &halfband_f32_avx2;}
+	if (features & DSP_CPU_SSE2) {
+		return &halfband_f32_sse2;}
+#elif defined(DSP_BUILD_NEON)
+	if (features & DSP_CPU_NEON) {
+		return &halfband_f32_neon;}
+#endif
+	return &halfband_f32_scalar;
+}
+
+dot_f32_fn dot_f32_select(int features)
+{
+#if defined(DSP_BUILD_X86)
+	if (features & DSP_CPU_AVX2) {
+		return &dot_f32_avx2;}
+	if (features & DSP_CPU_SSE2) {
+		return &dot_f32_sse2;}
+#elif defined(DSP_BUILD_NEON)
+	if (features & DSP_CPU_NEON) {
+		return &dot_f32_neon;}
+#endif
+	return &dot_f32_scalar;
+}
@@ -0,0 +1,247 @@
+/*
+ * Vectorized DSP kernels for rtl_fm_lib with runtime CPU dispatch
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The same binary has to run on the ARMv6 Pi Zero (no NEON) and on
+ * the Pi 3/4 (NEON), so nothing in here may assume more than the
+ * baseline instruction set at compile time.  Each kernel is built
+ * once per instruction set and dsp_cpu_features() picks one at startup.
+ */
+
+#ifndef __RTL_FM_DSP_H
+#define __RTL_FM_DSP_H
+
+#include <stdint.h>
+
+#define DSP_CPU_SSE2		(1 << 0)
+#define DSP_CPU_AVX2		(1 << 1)
+#define DSP_CPU_NEON		(1 << 2)
+
+/*!
+ * FM discriminator over one block of interleaved I/Q
+ *
+ * \param lp interleaved int16 I/Q, len values (len/2 complex samples)
+ * \param len number of int16 values in lp
+ * \param pre_r real part of the last sample of the previous block
+ * \param pre_j imag part of the last sample of the previous block
+ * \param result len/2 phase differences, pi == 1<<14
+ */
+
+typedef void (*fm_disc_fn)(const int16_t *lp, int len, int pre_r, int pre_j, int16_t *result);
+
+/*!
+ * Convert one USB buffer of offset binary u8 I/Q to int16, optionally
+ * applying the fs/4 frequency shift (the old rotate_90()) on the way
+ *
+ * \param buf raw samples from librtlsdr, not modified
+ * \param len number of bytes in buf
+ * \param rotate non zero to shift by fs/4
+ * \param out len int16 values
+ */
+
+typedef void (*iq_convert_fn)(const unsigned char *buf, uint32_t len, int rotate, int16_t *out);
+
+/* half-band coefficients are scaled so the dc gain of a stage is 2,
+   a downsample should improve resolution, so don't fully shift */
+#define HALFBAND_SHIFT		14
+
+/*!
+ * One 2:1 half-band decimation over polyphase split interleaved I/Q,
+ * taps == 4*k+3 so only the centre tap and k+1 symmetric pairs are non zero
+ *
+ * out[i] = coef[k+1]*od[i+k] + sum(j=0..k) coef[j]*(ev[i+k-j] + ev[i+k+1+j])
+ *
+ * \param ev even input samples, n+2*k+1 complex
+ * \param od odd input samples, n+k complex
+ * \param n number of complex outputs
+ * \param coef k+1 folded side taps then the centre tap
+ * \param k stage size
+ * \param out n complex outputs, may alias neither ev nor od
+ */
+
+typedef void (*halfband_fn)(const int16_t *ev, const int16_t *od, int n,
+	const int16_t *coef, int k, int16_t *out);
+
+/* generic fir coefficients are scaled so 1<<FIR_SHIFT is unity gain */
+#define FIR_SHIFT		14
+
+/*!
+ * Symmetric FIR over interleaved channels, only the first half of the
+ * taps is stored and each pair of samples sharing a tap is added before
+ * the multiply.  Vector kernels work along the taps, so any tap count and
+ * output step are handled.  Reads up to 16 samples on either side of the
+ * window; those samples land on zero coefficients.
+ *
+ * \param x window of the first output, taps samples of ch values
+ * \param n number of outputs
+ * \param step input samples between outputs
+ * \param ch interleaved channels, 1 (real) or 2 (I/Q)
+ * \param coef centre tap (0 for even taps), then taps/2 folded taps each
+ *        repeated ch times, zero padded by 16 samples
+ * \param taps filter length
+ * \param out n samples of ch values
+ */
+
+typedef void (*fir_fn)(const int16_t *x, int n, int step, int ch,
+	const int16_t *coef, int taps, int16_t *out);
+
+/*!
+ * Dot product of two int16 vectors
+ *
+ * \param a first vector
+ * \param b second vector
+ * \param n length, a multiple of 16
+ * \return sum of a[i]*b[i]
+ */
+
+typedef int32_t (*dot_fn)(const int16_t *a, const int16_t *b, int n);
+
+/* -E float keeps the int16 units through the chain, radians times
+   this are the phases fm_disc_fn writes */
+#define DISC_SCALE		((float)(1<<14) / 3.14159f)
+
+/*!
+ * FM discriminator over one block of interleaved float I/Q
+ *
+ * \param iq interleaved I/Q, len values (len/2 complex samples), in
+ *        int16 units, the atan treats |a * conj(b)| < 1 as no signal
+ * \param len number of floats in iq
+ * \param pre_r real part of the last sample of the previous block
+ * \param pre_j imag part of the last sample of the previous block
+ * \param result len/2 phase differences in radians
+ */
+
+typedef void (*fm_disc_f32_fn)(const float *iq, int len, float pre_r, float pre_j, float *result);
+
+/*!
+ * Float version of halfband_fn, coef[k+1] is the centre tap and the
+ * dc gain of a stage is 2 as for the int16 one
+ */
+
+typedef void (*halfband_f32_fn)(const float *ev, const float *od, int n,
+	const float *coef, int k, float *out);
+
+/*!
+ * Dot product of two float vectors
+ *
+ * \param a first vector
+ * \param b second vector
+ * \param n length, a multiple of 16
+ * \return sum of a[i]*b[i], the order of the additions depends on the kernel
+ */
+
+typedef float (*dot_f32_fn)(const float *a, const float *b, int n);
+
+/*!
+ * Probe the instruction set extensions usable on this CPU
+ *
+ * \return mask of DSP_CPU_* flags
+ */
+
+extern int dsp_cpu_features(void);
+
+/*!
+ * Human readable name of the best extension in a feature mask
+ *
+ * \param features mask of DSP_CPU_* flags
+ * \return "avx2", "sse2", "neon" or "scalar"
+ */
+
+extern const char *dsp_cpu_name(int features);
+
+/*!
+ * Select the fastest vectorized polynomial discriminator
+ *
+ * \param features mask of DSP_CPU_* flags
+ * \return kernel, or NULL if no vector unit is available
+ */
+
+extern fm_disc_fn fm_disc_simd_select(int features);
+
+/*!
+ * Select the fastest u8 to int16 converter
+ *
+ * \param features mask of DSP_CPU_* flags
+ * \return kernel, the scalar one if no vector unit is available
+ */
+
+extern iq_convert_fn iq_convert_select(int features);
+
+/*!
+ * Select the fastest half-band decimator
+ *
+ * \param features mask of DSP_CPU_* flags
+ * \return kernel, the scalar one if no vector unit is available
+ */
+
+extern halfband_fn halfband_select(int features);
+
+/*!
+ * Select the fastest symmetric FIR
+ *
+ * \param features mask of DSP_CPU_* flags
+ * \return kernel, the scalar one if no vector unit is available
+ */
+
+extern fir_fn fir_select(int features);
+
+/*!
+ * Select the fastest dot product
+ *
+ * \param features mask of DSP_CPU_* flags
+ * \return kernel, the scalar one if no vector unit is available
+ */
+
+extern dot_fn dot_select(int features);
+
+/*!
+ * Select the fastest float discriminator
+ *
+ * \param features mask of DSP_CPU_* flags
+ * \return kernel, the scalar one if no vector unit is available
+ */
+
+extern fm_disc_f32_fn fm_disc_f32_select(int features);
+
+/*!
+ * Select the fastest float half-band decimator
+ *
+ * \param features mask of DSP_CPU_* flags
+ * \return kernel, the scalar one if no vector unit is available
+ */
+
+extern halfband_f32_fn halfband_f32_select(int features);
+
+/*!
+ * Select the fastest float dot product
+ *
+ * \param features mask of DSP_CPU_* flags
+ * \return kernel, the scalar one if no vector unit is available
+ */
+
+extern dot_f32_fn dot_f32_select(int features);
+
+/*!
+ * Scalar version of the polynomial discriminator, used for the
+ * block tails of the vector kernels
+ *
+ * \return phase difference of a * conj(b), pi == 1<<14
+ */
+
+extern int polar_disc_poly(int ar, int aj, int br, int bj);
+
+#endif /* #ifndef __RTL_FM_DSP_H */
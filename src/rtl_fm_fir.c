@@ -0,0 +1,314 @@
+/*
+ * FIR filter blocks for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "rtl_fm_fir.h"
+
+static double blackman(int n, int len)
+{
+	return 0.42 - 0.5 * cos(2.0 * M_PI * n / (len - 1))
+		+ 0.08 * cos(4.0 * M_PI * n / (len - 1));
+}
+
+static int halfband_proto(double *h, int taps)
+/* windowed sinc at fs/4, the even taps fall on the sinc zeros,
+   returns k, the k+1 side taps h[] add up to 1/2 per side */
+{
+	double x, sum = 0;
+	int c, j, k;
+
+	if (taps < 3) {
+		taps = 3;}
+	if (taps > HALFBAND_MAX_TAPS) {
+		taps = HALFBAND_MAX_TAPS;}
+	/* round up to 4*k+3 */
+	k = taps / 4;
+	taps = 4*k + 3;
+	c = 2*k + 1;
+
+	for (j = 0; j <= k; j++) {
+		x = (2*j + 1) / 2.0;
+		/* window one tap wider on each side so the end taps are not zero */
+		h[j] = 0.5 * sin(M_PI * x) / (M_PI * x) * blackman(c - (2*j + 1) + 1, taps + 2);
+		sum += 2.0 * h[j];
+	}
+	for (j = 0; j <= k; j++) {
+		h[j] /= sum;}
+	return k;
+}
+
+static void halfband_design(struct halfband_stage *st, int taps)
+{
+	double h[HALFBAND_MAX_TAPS / 4 + 1];
+	int j, k, q = 0;
+
+	k = halfband_proto(h, taps);
+	st->k = k;
+	st->taps = 4*k + 3;
+	/* the side taps carry exactly half the gain */
+	for (j = 0; j <= k; j++) {
+		st->coef[j] = (int16_t)round(h[j] * (1 << HALFBAND_SHIFT));
+		q += 2 * st->coef[j];
+	}
+	st->coef[0] += ((1 << HALFBAND_SHIFT) - q) / 2;
+	st->coef[k+1] = 1 << HALFBAND_SHIFT;
+}
+
+void halfband_init(struct halfband_cascade *hb, int stages, int last_taps)
+{
+	int i, taps;
+	if (stages > HALFBAND_MAX_STAGES) {
+		stages = HALFBAND_MAX_STAGES;}
+	if (last_taps <= 0) {
+		last_taps = HALFBAND_LAST_TAPS;}
+	memset(hb, 0, sizeof(struct halfband_cascade));
+	hb->stages = stages;
+	hb->last_taps = last_taps;
+	hb->kernel = halfband_select(dsp_cpu_features());
+	for (i = 0; i < stages; i++) {
+		taps = HALFBAND_EARLY_TAPS;
+		if (i == stages-2) {
+			taps = HALFBAND_NEXT_TAPS;}
+		if (i == stages-1) {
+			taps = last_taps;}
+		halfband_design(&hb->stage[i], taps);
+	}
+}
+
+static int halfband_stage_run(struct halfband_stage *st, halfband_fn kernel, int16_t *iq, int n)
+/* n complex in, n/2 complex out, in place */
+{
+	int h = 2*st->k + 1;
+	int done, m, i;
+	for (done = 0; done < n/2; done += m) {
+		m = n/2 - done;
+		if (m > HALFBAND_CHUNK) {
+			m = HALFBAND_CHUNK;}
+		/* polyphase split behind the history, reads stay ahead of the writes */
+		for (i = 0; i < m; i++) {
+			st->ev[2*(h+i)]   = iq[4*(done+i)];
+			st->ev[2*(h+i)+1] = iq[4*(done+i)+1];
+			st->od[2*(h+i)]   = iq[4*(done+i)+2];
+			st->od[2*(h+i)+1] = iq[4*(done+i)+3];
+		}
+		kernel(st->ev, st->od, m, st->coef, st->k, iq + 2*done);
+		memmove(st->ev, st->ev + 2*m, 2 * h * sizeof(int16_t));
+		memmove(st->od, st->od + 2*m, 2 * h * sizeof(int16_t));
+	}
+	return n/2;
+}
+
+int halfband_decimate(struct halfband_cascade *hb, int16_t *iq, int len)
+{
+	int i, n = len / 2;
+	for (i = 0; i < hb->stages; i++) {
+		n = halfband_stage_run(&hb->stage[i], hb->kernel, iq, n);
+	}
+	return 2 * n;
+}
+
+static void lowpass_proto(double *h, int taps, double cutoff)
+/* normalised to a dc gain of 1 */
+{
+	double x, sum = 0;
+	int i;
+	for (i = 0; i < taps; i++) {
+		x = i - (taps - 1) / 2.0;
+		h[i] = 2.0 * cutoff;
+		if (x != 0) {
+			h[i] = sin(2.0 * M_PI * cutoff * x) / (M_PI * x);}
+		h[i] *= blackman(i + 1, taps + 2);
+		sum += h[i];
+	}
+	for (i = 0; i < taps; i++) {
+		h[i] /= sum;}
+}
+
+void fir_lowpass(int16_t *coef, int taps, double cutoff, double gain)
+{
+	double h[FIR_MAX_TAPS];
+	double x;
+	int i, q = 0;
+	lowpass_proto(h, taps, cutoff);
+	for (i = 0; i < taps; i++) {
+		x = round(h[i] * gain * (1 << FIR_SHIFT));
+		if (x > 32767) {
+			x = 32767;}
+		if (x < -32767) {
+			x = -32767;}
+		coef[i] = (int16_t)x;
+		q += coef[i];
+	}
+	/* put the rounding error on the centre tap(s) */
+	q = (int)round(gain * (1 << FIR_SHIFT)) - q;
+	if (taps & 1) {
+		coef[taps/2] += q;
+	} else if (taps) {
+		coef[taps/2 - 1] += q / 2;
+		coef[taps/2]     += q / 2;
+	}
+}
+
+void fir_init(struct fir_filter *f, const int16_t *coef, int taps, int decim, int channels)
+{
+	int j, c;
+	if (taps < 1) {
+		taps = 1;}
+	if (taps > FIR_MAX_TAPS) {
+		taps = FIR_MAX_TAPS;}
+	memset(f, 0, sizeof(struct fir_filter));
+	f->taps = taps;
+	f->decim = decim < 1 ? 1 : decim;
+	f->channels = channels == 2 ? 2 : 1;
+	f->kernel = fir_select(dsp_cpu_features());
+	if (taps & 1) {
+		f->coef[0] = coef[taps/2];}
+	/* one copy per channel so the kernels can load them with the samples */
+	for (j = 0; j < taps/2; j++) {
+		for (c = 0; c < f->channels; c++) {
+			f->coef[1 + f->channels*j + c] = coef[j];}
+	}
+}
+
+int fir_process(struct fir_filter *f, int16_t *buf, int len)
+{
+	int ch = f->channels;
+	int hist = f->taps - 1;
+	int16_t *x = f->buf + ch * FIR_PAD;
+	int n = len / ch;
+	int done, m, outs, o = 0;
+	for (done = 0; done < n; done += m) {
+		m = n - done;
+		if (m > FIR_CHUNK) {
+			m = FIR_CHUNK;}
+		memcpy(x + ch*hist, buf + ch*done, ch * m * sizeof(int16_t));
+		/* the output on chunk sample i has its window starting at x[ch*i],
+		   outputs only ever overwrite samples already copied in */
+		outs = 0;
+		if (f->phase < m) {
+			outs = (m - 1 - f->phase) / f->decim + 1;
+			f->kernel(x + ch*f->phase, outs, f->decim, ch, f->coef, f->taps, buf + ch*o);
+			o += outs;
+		}
+		f->phase += outs * f->decim - m;
+		memmove(x, x + ch*m, ch * hist * sizeof(int16_t));
+	}
+	return ch * o;
+}
+
+void halfband_f32_init(struct halfband_cascade_f32 *hb, int stages, int last_taps)
+{
+	double h[HALFBAND_MAX_TAPS / 4 + 1];
+	struct halfband_stage_f32 *st;
+	int i, j, taps;
+	if (stages > HALFBAND_MAX_STAGES) {
+		stages = HALFBAND_MAX_STAGES;}
+	if (last_taps <= 0) {
+		last_taps = HALFBAND_LAST_TAPS;}
+	memset(hb, 0, sizeof(struct halfband_cascade_f32));
+	hb->stages = stages;
+	hb->kernel = halfband_f32_select(dsp_cpu_features());
+	for (i = 0; i < stages; i++) {
+		taps = HALFBAND_EARLY_TAPS;
+		if (i == stages-2) {
+			taps = HALFBAND_NEXT_TAPS;}
+		if (i == stages-1) {
+			taps = last_taps;}
+		st = &hb->stage[i];
+		st->k = halfband_proto(h, taps);
+		for (j = 0; j <= st->k; j++) {
+			st->coef[j] = (float)h[j];}
+		st->coef[st->k+1] = 1.0f;
+	}
+}
+
+static int halfband_f32_stage_run(struct halfband_stage_f32 *st, halfband_f32_fn kernel, float *iq, int n)
+/* n complex in, n/2 complex out, in place */
+{
+	int h = 2*st->k + 1;
+	int done, m, i;
+	for (done = 0; done < n/2; done += m) {
+		m = n/2 - done;
+		if (m > HALFBAND_CHUNK) {
+			m = HALFBAND_CHUNK;}
+		for (i = 0; i < m; i++) {
+			st->ev[2*(h+i)]   = iq[4*(done+i)];
+			st->ev[2*(h+i)+1] = iq[4*(done+i)+1];
+			st->od[2*(h+i)]   = iq[4*(done+i)+2];
+			st->od[2*(h+i)+1] = iq[4*(done+i)+3];
+		}
+		kernel(st->ev, st->od, m, st->coef, st->k, iq + 2*done);
+		memmove(st->ev, st->ev + 2*m, 2 * h * sizeof(float));
+		memmove(st->od, st->od + 2*m, 2 * h * sizeof(float));
+	}
+	return n/2;
+}
+
+int halfband_f32_decimate(struct halfband_cascade_f32 *hb, float *iq, int len)
+{
+	int i, n = len / 2;
+	for (i = 0; i < hb->stages; i++) {
+		n = halfband_f32_stage_run(&hb->stage[i], hb->kernel, iq, n);
+	}
+	return 2 * n;
+}
+
+void fir_lowpass_f32(float *coef, int taps, double cutoff, double gain)
+{
+	double h[FIR_MAX_TAPS];
+	int i;
+	lowpass_proto(h, taps, cutoff);
+	for (i = 0; i < taps; i++) {
+		coef[i] = (float)(h[i] * gain);}
+}
+
+void fir_f32_init(struct fir_filter_f32 *f, const float *coef, int taps, int decim)
+{
+	if (taps < 1) {
+		taps = 1;}
+	if (taps > FIR_MAX_TAPS) {
+		taps = FIR_MAX_TAPS;}
+	memset(f, 0, sizeof(struct fir_filter_f32));
+	f->taps = taps;
+	f->decim = decim < 1 ? 1 : decim;
+	f->dot = dot_f32_select(dsp_cpu_features());
+	/* symmetric, so no need to reverse them, the padding stays zero */
+	memcpy(f->coef, coef, taps * sizeof(float));
+}
+
+int fir_f32_process(struct fir_filter_f32 *f, float *buf, int len)
+{
+	int hist = f->taps - 1;
+	int n = (f->taps + 15) & ~15;
+	float *x = f->buf;
+	int done, m, i, o = 0;
+	for (done = 0; done < len; done += m) {
+		m = len - done;
+		if (m > FIR_CHUNK) {
+			m = FIR_CHUNK;}
+		memcpy(x + hist, buf + done, m * sizeof(float));
+		/* the output on chunk sample i has its window starting at x[i],
+		   the dot runs up to 15 samples past it onto zero taps */
+		for (i = f->phase; i < m; i += f->decim) {
+			buf[o++] = f->dot(f->coef, x + i, n);}
+		f->phase = i - m;
+		memmove(x, x + m, hist * sizeof(float));
+	}
+	return o;
+}
@@ -0,0 +1,205 @@
+/*
+ * FIR filter blocks for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RTL_FM_FIR_H
+#define __RTL_FM_FIR_H
+
+#include <stdint.h>
+
+#include "rtl_fm_dsp.h"
+
+#define HALFBAND_MAX_TAPS	31
+#define HALFBAND_MAX_STAGES	12
+/* the early stages alias onto the passband from >= 7/16 fs,
+   the one before the last from >= 3/8 fs */
+#define HALFBAND_EARLY_TAPS	11
+#define HALFBAND_NEXT_TAPS	15
+#define HALFBAND_LAST_TAPS	19
+/* complex outputs per chunk, keeps the polyphase split in L1 */
+#define HALFBAND_CHUNK		256
+#define HALFBAND_HIST		(HALFBAND_MAX_TAPS / 2)
+
+/* one 2:1 stage, taps == 4*k+3
+   the polyphase halves carry (taps-1)/2 samples of history in front,
+   moved once per chunk rather than shifted once per sample */
+struct halfband_stage
+{
+	int      taps;
+	int      k;
+	int16_t  coef[HALFBAND_MAX_TAPS / 4 + 2];
+	int16_t  ev[2 * (HALFBAND_HIST + HALFBAND_CHUNK)];
+	int16_t  od[2 * (HALFBAND_HIST + HALFBAND_CHUNK)];
+};
+
+struct halfband_cascade
+{
+	int      stages;
+	int      last_taps;
+	halfband_fn kernel;
+	struct halfband_stage stage[HALFBAND_MAX_STAGES];
+};
+
+/* -E float, the same cascade over float I/Q */
+struct halfband_stage_f32
+{
+	int      k;
+	float    coef[HALFBAND_MAX_TAPS / 4 + 2];
+	float    ev[2 * (HALFBAND_HIST + HALFBAND_CHUNK)];
+	float    od[2 * (HALFBAND_HIST + HALFBAND_CHUNK)];
+};
+
+struct halfband_cascade_f32
+{
+	int      stages;
+	halfband_f32_fn kernel;
+	struct halfband_stage_f32 stage[HALFBAND_MAX_STAGES];
+};
+
+#define FIR_MAX_TAPS		255
+/* input samples per pass */
+#define FIR_CHUNK		512
+/* samples of slack around the window for the vector kernels */
+#define FIR_PAD			16
+
+/* symmetric FIR with optional decimation over 1 or 2 interleaved channels
+   the last taps-1 input samples are kept in front of each chunk */
+struct fir_filter
+{
+	int      taps;
+	int      decim;
+	int      channels;
+	int      phase;
+	fir_fn   kernel;
+	int16_t  coef[1 + 2 * (FIR_MAX_TAPS / 2 + FIR_PAD)];
+	int16_t  buf[2 * (FIR_PAD + FIR_MAX_TAPS + FIR_CHUNK + FIR_PAD)];
+};
+
+/* real only, the taps are run as one dot product padded to a multiple
+   of 16, the last taps-1 input samples are kept in front of each chunk */
+struct fir_filter_f32
+{
+	int      taps;
+	int      decim;
+	int      phase;
+	dot_f32_fn dot;
+	float    coef[FIR_MAX_TAPS + FIR_PAD];
+	float    buf[FIR_MAX_TAPS + FIR_CHUNK + FIR_PAD];
+};
+
+/*!
+ * Design a cascade of 2:1 half-band decimators.  The early stages
+ * only have to reject what would alias onto the final passband, so
+ * they stay short; the last one sets the channel edge.
+ *
+ * \param hb cascade, history is cleared
+ * \param stages number of 2:1 stages
+ * \param last_taps size of the last stage, rounded up to 4*k+3, 0 for default
+ */
+
+extern void halfband_init(struct halfband_cascade *hb, int stages, int last_taps);
+
+/*!
+ * Decimate interleaved I/Q in place by 2^stages
+ *
+ * \param hb cascade from halfband_init()
+ * \param iq interleaved int16 I/Q
+ * \param len number of int16 values, a multiple of 2^(stages+1)
+ * \return number of int16 values left in iq
+ */
+
+extern int halfband_decimate(struct halfband_cascade *hb, int16_t *iq, int len);
+
+/*!
+ * Blackman windowed sinc low pass
+ *
+ * \param coef taps coefficients, scaled by 1<<FIR_SHIFT
+ * \param taps filter length
+ * \param cutoff -6 dB point as a fraction of the sample rate, below 0.5
+ * \param gain dc gain
+ */
+
+extern void fir_lowpass(int16_t *coef, int taps, double cutoff, double gain);
+
+/*!
+ * Set up a symmetric FIR, history is cleared
+ *
+ * \param f filter
+ * \param coef taps coefficients, only the first half is read
+ * \param taps filter length, 1 to FIR_MAX_TAPS
+ * \param decim keep every decim'th output, 1 for none
+ * \param channels 1 for real, 2 for interleaved I/Q
+ */
+
+extern void fir_init(struct fir_filter *f, const int16_t *coef, int taps, int decim, int channels);
+
+/*!
+ * Filter and decimate in place, any length, state carries over
+ *
+ * \param f filter from fir_init()
+ * \param buf interleaved int16 samples
+ * \param len number of int16 values
+ * \return number of int16 values left in buf
+ */
+
+extern int fir_process(struct fir_filter *f, int16_t *buf, int len);
+
+/*!
+ * Float version of halfband_init(), the same designs unquantized
+ */
+
+extern void halfband_f32_init(struct halfband_cascade_f32 *hb, int stages, int last_taps);
+
+/*!
+ * Decimate interleaved float I/Q in place by 2^stages
+ *
+ * \param hb cascade from halfband_f32_init()
+ * \param iq interleaved float I/Q
+ * \param len number of floats, a multiple of 2^(stages+1)
+ * \return number of floats left in iq
+ */
+
+extern int halfband_f32_decimate(struct halfband_cascade_f32 *hb, float *iq, int len);
+
+/*!
+ * Float version of fir_lowpass(), unity gain is 1.0
+ */
+
+extern void fir_lowpass_f32(float *coef, int taps, double cutoff, double gain);
+
+/*!
+ * Set up a real float FIR, history is cleared
+ *
+ * \param f filter
+ * \param coef taps coefficients
+ * \param taps filter length, 1 to FIR_MAX_TAPS
+ * \param decim keep every decim'th output, 1 for none
+ */
+
+extern void fir_f32_init(struct fir_filter_f32 *f, const float *coef, int taps, int decim);
+
+/*!
+ * Filter and decimate in place, any length, state carries over
+ *
+ * \param f filter from fir_f32_init()
+ * \param buf float samples
+ * \param len number of samples
+ * \return number of samples left in buf
+ */
+
+extern int fir_f32_process(struct fir_filter_f32 *f, float *buf, int len);
+
+#endif /* #ifndef __RTL_FM_FIR_H */
@@ -40,10 +40,8 @@
  *       fifo for active hop frequency
  *       clips
  *       noise squelch
- *       merge stereo patch
  *       merge soft agc patch
  *       merge udp patch
- *       testmode to detect overruns
  *       watchdog to reset bad dongle
  *       fix oversampling
  */
@@ -59,6 +57,7 @@
 #include <kissfft/kiss_fftr.h>
 
 #include "rtl_fm_lib.h"
+#include "rtl_fm_pool.h"
 
 /*
    Public Data
@@ -76,26 +75,11 @@ int ACTUAL_BUF_LENGTH;
    Private Data
 */
 
-static int *atan_lut = NULL;
-static int atan_lut_size = 131072; /* 512 KB */
-static int atan_lut_coef = 8;
-
-/* {length, coef, coef, coef}  and scaled by 2^15
-   for now, only length 9, optimal way to get +85% bandwidth */
-#define CIC_TABLE_MAX 10
-int cic_9_tables[][10] = {
-	{0,},
-	{9, -156,  -97, 2798, -15489, 61019, -15489, 2798,  -97, -156},
-	{9, -128, -568, 5593, -24125, 74126, -24125, 5593, -568, -128},
-	{9, -129, -639, 6187, -26281, 77511, -26281, 6187, -639, -129},
-	{9, -122, -612, 6082, -26353, 77818, -26353, 6082, -612, -122},
-	{9, -120, -602, 6015, -26269, 77757, -26269, 6015, -602, -120},
-	{9, -120, -582, 5951, -26128, 77542, -26128, 5951, -582, -120},
-	{9, -119, -580, 5931, -26094, 77505, -26094, 5931, -580, -119},
-	{9, -119, -578, 5921, -26077, 77484, -26077, 5921, -578, -119},
-	{9, -119, -577, 5917, -26067, 77473, -26067, 5917, -577, -119},
-	{9, -199, -362, 5303, -25505, 77489, -25505, 5303, -362, -199},
-};
+/* atan over one octant, 0..1 -> 0..pi/4, with ATAN_LUT_FRAC extra bits,
+   the last entry is there for the interpolation */
+static int16_t atan_lut[ATAN_LUT_SIZE + 1];
+/* 1/m for m in [1, 2), indexed by the 8 bits after the leading one, Q15 */
+static uint16_t recip_lut[256];
 
 #if defined(_MSC_VER) && (_MSC_VER < 1800)
 static double log2(double n)
@@ -104,175 +88,36 @@ static double log2(double n)
 }
 #endif
 
-static void rotate_90(unsigned char *buf, uint32_t len)
-/* 90 rotation is 1+0j, 0+1j, -1+0j, 0-1j
-   or [0, 1, -3, 2, -4, -5, 7, -6] */
-{
-    ////////// 27Mar2023 First Comment Update ///////////////////////
-    // https://dsp.stackexchange.com/questions/54950/90-degree-phase-shift-rotation-algorithm-for-sdr
-    // 
-    // I believe this algorithm isn’t a rotation (phase shift)
-    // by 90degrees but instead is a frequency shift of fsamp/4. 
-    // In this algorithm each sample is rotated 90 degrees with 
-    // respect to the last one causing a frequency shift:
-    //    
-    //    Samp1: no rotation
-    //    Samp2: 90 degree rotation
-    //    Samp3: 180 degree rotation
-    //    Samp4: 270 degree rotation
-    //    Samp5: 360 -> 0 degree rotation
-    //    Samp6: 90 degree rotation
-    ////////////////////////////////////////////////////////
-
-    ////////// 27Mar2023 2nd Comment Update ///////////////////////
-    // https://dsp.stackexchange.com/questions/51889/what-exactly-is-a-90-degree-phase-shift-of-a-digital-signal-in-fm-demodulation-a/51898#51898
-    //
-    // I want to mention the possibility that this may 
-    // actually be a delay element and not a phase shift in 
-    // the sense that phase shift implies a shift of that 
-    // phase at all frequencies, while a true delay has a 
-    // phase shift that is proportional to frequency. It is 
-    // this property that is exploited to form simple FM demodulator structures
-    //
-    // For a pure 90 degree phase shift all you need to do is:
-    //
-    //    Ir = -Qi, 
-    //    Qr = Ii 
-    //
-    // at every sample.
-    ////////////////////////////////////////////////////////
-
-    uint32_t i;
-    unsigned char tmp;
-    for (i=0; i<len; i+=8) {
-        /* uint8_t negation = 255 - x */
-        tmp = 255 - buf[i+3];
-        buf[i+3] = buf[i+2];
-        buf[i+2] = tmp;
-
-        buf[i+4] = 255 - buf[i+4];
-        buf[i+5] = 255 - buf[i+5];
-
-        tmp = 255 - buf[i+6];
-        buf[i+6] = buf[i+7];
-        buf[i+7] = tmp;
-    }
-}
-
-static void low_pass(struct demod_state *d)
-/* simple square window FIR */
+int low_pass(struct demod_state *d, int16_t *lp, int len)
+/* simple square window FIR, in place, returns the new length */
 {
 	int i=0, i2=0;
-	while (i < d->lp_len) {
-		d->now_r += d->lowpassed[i];
-		d->now_j += d->lowpassed[i+1];
+	while (i < len) {
+		d->now_r += lp[i];
+		d->now_j += lp[i+1];
 		i += 2;
 		d->prev_index++;
 		if (d->prev_index < d->downsample) {
 			continue;
 		}
-		d->lowpassed[i2]   = d->now_r; // * d->output_scale;
-		d->lowpassed[i2+1] = d->now_j; // * d->output_scale;
+		lp[i2]   = d->now_r; // * d->output_scale;
+		lp[i2+1] = d->now_j; // * d->output_scale;
 		d->prev_index = 0;
 		d->now_r = 0;
 		d->now_j = 0;
 		i2 += 2;
 	}
-	d->lp_len = i2;
+	return i2;
 }
 
-static int low_pass_simple(int16_t *signal2, int len, int step)
-// no wrap around, length must be multiple of step
+static void post_fir_init(struct demod_state *d)
+/* 8 taps per output, cut just inside the new nyquist,
+   keeps the gain of the old boxcar sum */
 {
-	int i, i2, sum;
-	for(i=0; i < len; i+=step) {
-		sum = 0;
-		for(i2=0; i2<step; i2++) {
-			sum += (int)signal2[i + i2];
-		}
-		//signal2[i/step] = (int16_t)(sum / step);
-		signal2[i/step] = (int16_t)(sum);
-	}
-	signal2[i/step + 1] = signal2[i/step];
-	return len / step;
-}
-
-static void low_pass_real(struct demod_state *s)
-/* simple square window FIR */
-// add support for upsampling?
-{
-	int i=0, i2=0;
-	int fast = (int)s->rate_out;
-	int slow = s->rate_out2;
-	while (i < s->result_len) {
-		s->now_lpr += s->result[i];
-		i++;
-		s->prev_lpr_index += slow;
-		if (s->prev_lpr_index < fast) {
-			continue;
-		}
-		s->result[i2] = (int16_t)(s->now_lpr / (fast/slow));
-		s->prev_lpr_index -= fast;
-		s->now_lpr = 0;
-		i2 += 1;
-	}
-	s->result_len = i2;
-}
-
-static void fifth_order(int16_t *data, int length, int16_t *hist)
-/* for half of interleaved data */
-{
-	int i;
-	int16_t a, b, c, d, e, f;
-	a = hist[1];
-	b = hist[2];
-	c = hist[3];
-	d = hist[4];
-	e = hist[5];
-	f = data[0];
-	/* a downsample should improve resolution, so don't fully shift */
-	data[0] = (a + (b+e)*5 + (c+d)*10 + f) >> 4;
-	for (i=4; i<length; i+=4) {
-		a = c;
-		b = d;
-		c = e;
-		d = f;
-		e = data[i-2];
-		f = data[i];
-		data[i/2] = (a + (b+e)*5 + (c+d)*10 + f) >> 4;
-	}
-	/* archive */
-	hist[0] = a;
-	hist[1] = b;
-	hist[2] = c;
-	hist[3] = d;
-	hist[4] = e;
-	hist[5] = f;
-}
-
-static void generic_fir(int16_t *data, int length, int *fir, int16_t *hist)
-/* Okay, not at all generic.  Assumes length 9, fix that eventually. */
-{
-	int d, temp, sum;
-	for (d=0; d<length; d+=2) {
-		temp = data[d];
-		sum = 0;
-		sum += (hist[0] + hist[8]) * fir[1];
-		sum += (hist[1] + hist[7]) * fir[2];
-		sum += (hist[2] + hist[6]) * fir[3];
-		sum += (hist[3] + hist[5]) * fir[4];
-		sum +=            hist[4]  * fir[5];
-		data[d] = sum >> 15 ;
-		hist[0] = hist[1];
-		hist[1] = hist[2];
-		hist[2] = hist[3];
-		hist[3] = hist[4];
-		hist[4] = hist[5];
-		hist[5] = hist[6];
-		hist[6] = hist[7];
-		hist[7] = hist[8];
-		hist[8] = temp;
-	}
+	int16_t coef[FIR_MAX_TAPS];
+	int taps = 8 * d->post_downsample + 1;
+	fir_lowpass(coef, taps, 0.45 / d->post_downsample, d->post_downsample);
+	fir_init(&d->post_fir, coef, taps, d->post_downsample, 1);
 }
 
 /* define our own complex math ops
@@ -340,79 +185,118 @@ static int polar_disc_fast(int ar, int aj, int br, int bj)
 
 int atan_lut_init(void)
 {
-	int i = 0;
-
-	atan_lut = (int*) malloc(atan_lut_size * sizeof(int));
-
-	for (i = 0; i < atan_lut_size; i++) {
-		atan_lut[i] = (int) (atan((double) i / (1<<atan_lut_coef)) / 3.14159 * (1<<14));
-	}
-
+	int i;
+	for (i = 0; i <= ATAN_LUT_SIZE; i++) {
+		atan_lut[i] = (int16_t)round(atan((double)i / ATAN_LUT_SIZE) / 3.14159
+			* (1 << (14 + ATAN_LUT_FRAC)));}
+	/* midpoint of each interval, so the error is at most half a step */
+	for (i = 0; i < 256; i++) {
+		recip_lut[i] = (uint16_t)round(32768.0 / (1.0 + (i + 0.5) / 256.0));}
 	return 0;
 }
 
-static int polar_disc_lut(int ar, int aj, int br, int bj)
+static inline int polar_disc_lut(int ar, int aj, int br, int bj)
+/* octant reduce, min/max by a reciprocal instead of a divide, interpolate.
+   The octant is random sample to sample, so the fixups are masks not branches */
 {
-	int cr, cj, x, x_abs;
+	int cr, cj, angle, shift, sx, sy, sw;
+	uint32_t ax, ay, mn, mx, r, e, t, idx;
 
 	multiply(ar, aj, br, -bj, &cr, &cj);
 
-	/* special cases */
-	if (cr == 0 || cj == 0) {
-		if (cr == 0 && cj == 0)
-			{return 0;}
-		if (cr == 0 && cj > 0)
-			{return 1 << 13;}
-		if (cr == 0 && cj < 0)
-			{return -(1 << 13);}
-		if (cj == 0 && cr > 0)
-			{return 0;}
-		if (cj == 0 && cr < 0)
-			{return 1 << 14;}
-	}
+	sx = cr >> 31;
+	sy = cj >> 31;
+	ax = (uint32_t)((cr ^ sx) - sx);
+	ay = (uint32_t)((cj ^ sy) - sy);
+	sw = -(int)(ay > ax);
+	mn = ay ^ ((ax ^ ay) & (uint32_t)sw);
+	mx = ax ^ ((ax ^ ay) & (uint32_t)sw);
+
+	/* mx << shift is m in [1, 2) as Q31, 0/0 comes out as angle 0 */
+	shift = __builtin_clz(mx | 1);
+	mx <<= shift;
+	mn <<= shift;
+	r = recip_lut[(mx >> 23) & 0xFF];
+	/* one newton step, r = r * (2 - m * r), Q15 keeps it all in 32 bits */
+	e = ((mx >> 16) * r) >> 15;
+	r = (r * ((2u << 15) - e)) >> 15;
+	/* t = mn / mx, Q16 */
+	t = ((mn >> 16) * r) >> 14;
+	t = t < (1u << 16) ? t : 1u << 16;
+
+	idx = t >> (16 - ATAN_LUT_BITS);
+	e = t & ((1u << (16 - ATAN_LUT_BITS)) - 1);
+	angle = atan_lut[idx];
+	angle += ((atan_lut[idx + 1] - angle) * (int)e) >> (16 - ATAN_LUT_BITS);
+	angle = (angle + (1 << (ATAN_LUT_FRAC - 1))) >> ATAN_LUT_FRAC;
+
+	/* pi/2 - a above the diagonal, pi - a left of the axis, then the sign */
+	angle = (angle ^ sw) - sw + (sw & (1 << 13));
+	angle = (angle ^ sx) - sx + (sx & (1 << 14));
+	return (angle ^ sy) - sy;
+}
 
-	/* real range -32768 - 32768 use 64x range -> absolute maximum: 2097152 */
-	x = (cj << atan_lut_coef) / cr;
-	x_abs = abs(x);
+/* one loop per atan flavour, keeps the switch out of the sample loop */
 
-	if (x_abs >= atan_lut_size) {
-		/* we can use linear range, but it is not necessary */
-		return (cj > 0) ? 1<<13 : -(1<<13);
+void fm_disc_std(const int16_t *lp, int len, int pre_r, int pre_j, int16_t *result)
+{
+	int i;
+	result[0] = (int16_t)polar_discriminant(lp[0], lp[1], pre_r, pre_j);
+	for (i = 2; i < (len-1); i += 2) {
+		result[i/2] = (int16_t)polar_discriminant(lp[i], lp[i+1], lp[i-2], lp[i-1]);
 	}
+}
 
-	if (x > 0) {
-		return (cj > 0) ? atan_lut[x] : atan_lut[x] - (1<<14);
-	} else {
-		return (cj > 0) ? (1<<14) - atan_lut[-x] : -atan_lut[-x];
+void fm_disc_fast(const int16_t *lp, int len, int pre_r, int pre_j, int16_t *result)
+{
+	int i;
+	result[0] = (int16_t)polar_disc_fast(lp[0], lp[1], pre_r, pre_j);
+	for (i = 2; i < (len-1); i += 2) {
+		result[i/2] = (int16_t)polar_disc_fast(lp[i], lp[i+1], lp[i-2], lp[i-1]);
 	}
+}
 
-	return 0;
+void fm_disc_lut(const int16_t *lp, int len, int pre_r, int pre_j, int16_t *result)
+{
+	int i;
+	result[0] = (int16_t)polar_disc_lut(lp[0], lp[1], pre_r, pre_j);
+	for (i = 2; i < (len-1); i += 2) {
+		result[i/2] = (int16_t)polar_disc_lut(lp[i], lp[i+1], lp[i-2], lp[i-1]);
+	}
 }
 
-void fm_demod(struct demod_state *fm)
+void fm_disc_select(struct demod_state *fm)
+/* call once the -A option is known */
 {
-	int i, pcm;
-	int16_t *lp = fm->lowpassed;
-	pcm = polar_discriminant(lp[0], lp[1],
-		fm->pre_r, fm->pre_j);
-	fm->result[0] = (int16_t)pcm;
-	for (i = 2; i < (fm->lp_len-1); i += 2) {
-		switch (fm->custom_atan) {
-		case 0:
-			pcm = polar_discriminant(lp[i], lp[i+1],
-				lp[i-2], lp[i-1]);
-			break;
-		case 1:
-			pcm = polar_disc_fast(lp[i], lp[i+1],
-				lp[i-2], lp[i-1]);
-			break;
-		case 2:
-			pcm = polar_disc_lut(lp[i], lp[i+1],
-				lp[i-2], lp[i-1]);
+	int features;
+	switch (fm->custom_atan) {
+	case 1:
+		fm->fm_disc = &fm_disc_fast;
+		break;
+	case 2:
+		fm->fm_disc = &fm_disc_lut;
+		break;
+	case 3:
+		features = dsp_cpu_features();
+		fm->fm_disc = fm_disc_simd_select(features);
+		if (fm->fm_disc) {
+			fprintf(stderr, "FM discriminator: %s\n", dsp_cpu_name(features));
 			break;
 		}
-		fm->result[i/2] = (int16_t)pcm;
+		/* no vector unit (Pi Zero), same as -A fast */
+		fprintf(stderr, "FM discriminator: scalar fast\n");
+		fm->fm_disc = &fm_disc_fast;
+		break;
+	default:
+		fm->fm_disc = &fm_disc_std;
+		break;
 	}
+}
+
+void fm_demod(struct demod_state *fm)
+{
+	int16_t *lp = fm->lowpassed;
+	fm->fm_disc(lp, fm->lp_len, fm->pre_r, fm->pre_j, fm->result);
 	fm->pre_r = lp[fm->lp_len - 2];
 	fm->pre_j = lp[fm->lp_len - 1];
 	fm->result_len = fm->lp_len/2;
@@ -468,24 +352,25 @@ void raw_demod(struct demod_state *fm)
 	fm->result_len = fm->lp_len;
 }
 
-static void deemph_filter(struct demod_state *fm)
+void deemph_filter(struct demod_state *fm, int16_t *buf, int len)
 {
-	static int avg;  // cheating...
+	int avg = fm->deemph_avg;
 	int i, d;
 	// de-emph IIR
 	// avg = avg * (1 - alpha) + sample * alpha;
-	for (i = 0; i < fm->result_len; i++) {
-		d = fm->result[i] - avg;
+	for (i = 0; i < len; i++) {
+		d = buf[i] - avg;
 		if (d > 0) {
 			avg += (d + fm->deemph_a/2) / fm->deemph_a;
 		} else {
 			avg += (d - fm->deemph_a/2) / fm->deemph_a;
 		}
-		fm->result[i] = (int16_t)avg;
+		buf[i] = (int16_t)avg;
 	}
+	fm->deemph_avg = avg;
 }
 
-static void dc_block_filter(struct demod_state *fm)
+void dc_block_filter(struct demod_state *fm)
 {
 	int i, avg;
 	int64_t sum = 0;
@@ -518,82 +403,38 @@ static int mad(int16_t *samples, int len, int step)
 }
 
 // squelch() was written by Jeff
-static void squelch(int16_t *samples, int len, int level)
+void squelch(struct demod_state *d, const int16_t *buf, int len)
+/* with no carrier the discriminator output is mostly noise,
+   measure it in the top quarter of the band, above the audio */
 {
-        fprintf(stderr, "squelch - Entry - len: %d\n", len);
-
-        static long count = 0;
-
-        int nfft = 4096;
-        int nfreqs=nfft/2+1;
-
-        kiss_fftr_cfg   cfg = kiss_fftr_alloc(nfft,0,0,0);
-        kiss_fft_scalar *tbuf = (kiss_fft_scalar*) malloc(sizeof(kiss_fft_scalar)*nfft);
-        kiss_fft_cpx    *fbuf = (kiss_fft_cpx*)malloc(sizeof(kiss_fft_cpx)*nfreqs);
-
-        int i;
-        for (i=0;i<len;++i)  {
-            tbuf[i] = samples[i];
-        }
-
-        // Add zero-pad samples 
-        for (i=len;i<nfft;++i) {
-            tbuf[i] = 0;
-        }
-
-        // Remove DC bias
-        float avg = 0;
-        for (i=0;i<nfft;++i)  avg += tbuf[i];
-        avg /= nfft;
-        for (i=0;i<nfft;++i)  tbuf[i] -= (kiss_fft_scalar)avg;
-
-        // Compute FFT
-        kiss_fftr(cfg, tbuf, fbuf);
-
-        // Calc squared magnitude (i.e power)  of complex bin value
-        float *mag2buf = (float*) malloc(nfreqs * sizeof(float));
-        for (i=0;i<nfreqs;++i) {
-            mag2buf[i] += (fbuf[i].r * fbuf[i].r) + (fbuf[i].i * fbuf[i].i);
-        }
-
-        fprintf(stderr, "mag2buf[0] = %f\n", mag2buf[0]);
-
-        static int squelch = 0;
-        static int unsquelch_cnt = 0;
-        if (!squelch) {
-            if (mag2buf[0] > level) {
-            //if ((mag2buf[0] > 10.0) && (avg_mag2_scaled < 40.0)) {
-                squelch = 1;
-                unsquelch_cnt = 0;
-                fprintf(stderr, "MUTE\n");
-            }
-        } else {
-            if (mag2buf[0] < level) {
-            //if ((mag2buf[0] < 10.0) && (avg_mag2_scaled > 40.0)) {
-                unsquelch_cnt++;
-            } else {
-                unsquelch_cnt = 0;
-            }
-            if (unsquelch_cnt == 2) {
-                squelch = 0;
-                fprintf(stderr, "UN-MUTE\n");
-            }
-        }
-
-        free (cfg);
-        free (tbuf);
-        free (fbuf);
-        free (mag2buf);
-
-        count = (count % INT_MAX) + 1;
+	float noise;
+	if (!spectrum_feed(&d->spec, buf, len)) {
+		return;}
+	noise = spectrum_band_power(&d->spec, d->spec.nbins * 3 / 4, d->spec.nbins - 1);
 
-	return;
+	if (!d->squelched) {
+		if (noise > d->squelch_level) {
+			d->squelched = 1;
+			d->squelch_hits = 0;
+			LOG_INFO("MUTE");
+		}
+	} else {
+		if (noise < d->squelch_level) {
+			d->squelch_hits++;
+		} else {
+			d->squelch_hits = 0;
+		}
+		if (d->squelch_hits == 2) {
+			d->squelched = 0;
+			LOG_INFO("UN-MUTE");
+		}
+	}
 }
 
 // pwr_mean_square_real() was written by Jeff
 static uint32_t pwr_mean_square_real(int16_t *samples, int len)
 {
-        fprintf(stderr, "pwr_mean_square_real - Entry - len: %d\n", len);
+        LOG_DEBUG("pwr_mean_square_real - Entry - len: %d", len);
 
         static long count = 0;
 
@@ -609,7 +450,7 @@ static uint32_t pwr_mean_square_real(int16_t *samples, int len)
 		p += s * s;
 
                 if ((count % 10) == 0) {
-                    fprintf(stderr, "sample[%d]: %d\n", i, samples[i]);
+                    LOG_DEBUG("sample[%d]: %d", i, samples[i]);
                 }
 	}
 
@@ -620,7 +461,7 @@ static uint32_t pwr_mean_square_real(int16_t *samples, int len)
         pms = (uint32_t) (p - (dc * dc)) / len;
 
         if (1) {
-            fprintf(stderr, "PMS: %d, DC Offset: %f\n", pms, dc);
+            LOG_DEBUG("PMS: %d, DC Offset: %f", pms, dc);
         }
         count = (count % INT_MAX) + 1;
 
@@ -630,7 +471,7 @@ static uint32_t pwr_mean_square_real(int16_t *samples, int len)
 // pwr_mean_square_complex() was written by Jeff
 static uint32_t pwr_mean_square_complex(int16_t *samples, int len)
 {
-        fprintf(stderr, "pwr_mean_square_complex - Entry - len: %d\n", len);
+        LOG_DEBUG("pwr_mean_square_complex - Entry - len: %d", len);
 
         static long count = 0;
 
@@ -655,7 +496,7 @@ static uint32_t pwr_mean_square_complex(int16_t *samples, int len)
 	    p += m_sq;
 
             if ((count % 10) == 0) {
-                fprintf(stderr, "sample[%d]: i = %d\tq = %d\n", k, samples[k], samples[k+1]);
+                LOG_DEBUG("sample[%d]: i = %d\tq = %d", k, samples[k], samples[k+1]);
             }
 	}
 
@@ -667,123 +508,303 @@ static uint32_t pwr_mean_square_complex(int16_t *samples, int len)
         pms = (uint32_t)(p - ((dci*dci) + (dcq*dcq))) / len;
 
         if (1) {
-            fprintf(stderr, "PMS: %d, DC Ibias: %d Qbias: %d\n", pms, dci, dcq);
+            LOG_DEBUG("PMS: %d, DC Ibias: %d Qbias: %d", pms, dci, dcq);
         }
         count = (count % INT_MAX) + 1;
 
 	return pms;
 }
 
-static void arbitrary_upsample(int16_t *buf1, int16_t *buf2, int len1, int len2)
-/* linear interpolation, len1 < len2 */
+static void float_stages_init(struct demod_state *d)
+/* stages_init() for the -E float chain, the taps that stay int16
+   (rds, squelch, stereo) are built there */
 {
-	int i = 1;
-	int j = 0;
-	int tick = 0;
-	double frac;  // use integers...
-	while (j < len2) {
-		frac = (double)tick / (double)len2;
-		buf2[j] = (int16_t)(buf1[i-1]*(1-frac) + buf1[i]*frac);
-		j++;
-		tick += len1;
-		if (tick > len2) {
-			tick -= len2;
-			i++;
+	struct float_chain *f = &d->fc;
+	float coef[FIR_MAX_TAPS];
+	int taps;
+	if (!f->iq) {
+		f->iq = (float*)malloc(FLOAT_BUF_LENGTH * sizeof(float));
+		f->mpx = (float*)malloc(FLOAT_BUF_LENGTH * sizeof(float));
+		f->fm_disc = fm_disc_f32_select(dsp_cpu_features());
+	}
+	if (d->downsample_passes && f->hb.stages != d->downsample_passes) {
+		halfband_f32_init(&f->hb, d->downsample_passes, d->comp_fir_size);}
+	if (d->post_downsample > 1 && f->post_fir.decim != d->post_downsample) {
+		/* same design as post_fir_init() */
+		taps = 8 * d->post_downsample + 1;
+		fir_lowpass_f32(coef, taps, 0.45 / d->post_downsample, d->post_downsample);
+		fir_f32_init(&f->post_fir, coef, taps, d->post_downsample);
+	}
+	if (!d->stereo && d->rate_out2 > 0) {
+		if (f->audio_rs.rate_in != d->rate_out || f->audio_rs.rate_out != d->rate_out2) {
+			resample_init_f32(&f->audio_rs, d->rate_out, d->rate_out2, 0);}
+	}
+	/* the same time constant as deemph_filter(), without its rounding */
+	f->deemph_alpha = d->deemph_a > 0 ? 1.0f / d->deemph_a : 1.0f;
+}
+
+static void stages_init(struct demod_state *d)
+/* filters only change with the rates, (re)build whatever is stale */
+{
+	int every, rate = d->rate_out2 > 0 ? d->rate_out2 : d->rate_out;
+	if (d->downsample_passes && d->hb.stages != d->downsample_passes) {
+		halfband_init(&d->hb, d->downsample_passes, d->comp_fir_size);}
+	if (d->workers > 1 && !d->pool) {
+		d->pool = pool_create(d->workers, d->verbose);}
+	if (d->rds && d->rds_dec.rate_in != d->rate_in) {
+		rds_init(&d->rds_dec, d->rate_in);}
+	if (d->post_downsample > 1 && d->post_fir.decim != d->post_downsample) {
+		post_fir_init(d);}
+	if (d->squelch_level > 0 && d->spec.nfft != SQUELCH_NFFT) {
+		/* about SQUELCH_FPS transforms a second whatever the rate */
+		every = d->rate_out / (SQUELCH_NFFT/2 * SQUELCH_FPS);
+		spectrum_init(&d->spec, SQUELCH_NFFT, SQUELCH_NFFT/2, SPECTRUM_HANN, every, 0.5f);
+	}
+	if (d->stereo) {
+		if (d->stereo_dec.rate_in != d->rate_out || d->stereo_dec.rate_out != rate) {
+			stereo_init(&d->stereo_dec, d->rate_out, rate, d->deemph ? STEREO_DEEMPH_US : 0);}
+	} else if (d->rate_out2 > 0) {
+		if (d->audio_rs.rate_in != d->rate_out || d->audio_rs.rate_out != d->rate_out2) {
+			resample_init(&d->audio_rs, d->rate_out, d->rate_out2, 0);}
+	}
+	if (d->fp) {
+		float_stages_init(d);}
+	/* here so the counters follow the demod thread */
+	if (d->perf_on && !d->perf) {
+		d->perf = perf_open();
+		d->perf_on = d->perf != NULL;
+	}
+}
+
+static void mono_audio(struct demod_state *d)
+{
+	if (d->deemph) {
+                //fprintf(stderr, "full_demod(): post-demod - call deemph_filter()\n");
+		deemph_filter(d, d->result, d->result_len);}
+	if (d->dc_block) {
+                //fprintf(stderr, "full_demod(): post-demod - call dc_block_filter()\n");
+		dc_block_filter(d);}
+	if (d->rate_out2 > 0) {
+		d->result_len = resample_process(&d->audio_rs, d->result, d->result_len, MAXIMUM_BUF_LENGTH);}
+}
+
+static void fused_demod(struct demod_state *d)
+/* the fm chain of full_demod() one tile at a time, each tile goes from
+   lowpassed[] to its place in result[] without leaving the cache.
+   Every stage keeps its own state, so tiles join up seamlessly.  The
+   stereo blend and the dc mean move once a block, those two go over
+   the whole of result[] after the tiles. */
+{
+	int16_t *lp, *out;
+	int off, n, m, len = 0, tile;
+	/* iq in for FUSED_OUT out, whole decimation periods for the cascade */
+	tile = 2 * FUSED_OUT * (d->downsample_passes ? 1 << d->downsample_passes : d->downsample);
+	for (off = 0; off < d->lp_len; off += tile) {
+		lp = d->lowpassed + off;
+		n = d->lp_len - off < tile ? d->lp_len - off : tile;
+		if (d->downsample_passes) {
+			n = halfband_decimate(&d->hb, lp, n);
+		} else {
+			n = low_pass(d, lp, n);
 		}
-		if (i >= len1) {
-			i = len1 - 1;
-			tick = len2;
+		if (n < 2) {
+			continue;}
+		out = d->result + len;
+		d->fm_disc(lp, n, d->pre_r, d->pre_j, out);
+		d->pre_r = lp[n - 2];
+		d->pre_j = lp[n - 1];
+		m = n / 2;
+		if (d->rds) {
+			rds_process(&d->rds_dec, out, m);}
+		if (d->post_downsample > 1) {
+			m = fir_process(&d->post_fir, out, m);}
+		if (d->squelch_level > 0) {
+			squelch(d, out, m);}
+		if (d->stereo) {
+			len += m;
+			continue;
 		}
+		if (d->deemph) {
+			deemph_filter(d, out, m);}
+		if (d->rate_out2 > 0 && !d->dc_block) {
+			m = resample_process(&d->audio_rs, out, m, MAXIMUM_BUF_LENGTH - len);}
+		len += m;
+	}
+	d->result_len = len;
+	if (d->stereo) {
+		d->result_len = stereo_process(&d->stereo_dec, d->result, len, MAXIMUM_BUF_LENGTH);
+	} else if (d->dc_block && len) {
+		dc_block_filter(d);
+		if (d->rate_out2 > 0) {
+			d->result_len = resample_process(&d->audio_rs, d->result, len, MAXIMUM_BUF_LENGTH);}
 	}
 }
 
-static void arbitrary_downsample(int16_t *buf1, int16_t *buf2, int len1, int len2)
-/* fractional boxcar lowpass, len1 > len2 */
+static int float_low_pass(struct demod_state *d, float *iq, int len)
+/* low_pass() in float */
 {
-	int i = 1;
-	int j = 0;
-	int tick = 0;
-	double remainder = 0;
-	double frac;  // use integers...
-	buf2[0] = 0;
-	while (j < len2) {
-		frac = 1.0;
-		if ((tick + len2) > len1) {
-			frac = (double)(len1 - tick) / (double)len2;}
-		buf2[j] += (int16_t)((double)buf1[i] * frac + remainder);
-		remainder = (double)buf1[i] * (1.0-frac);
-		tick += len2;
-		i++;
-		if (tick > len1) {
-			j++;
-			buf2[j] = 0;
-			tick -= len1;
-		}
-		if (i >= len1) {
-			i = len1 - 1;
-			tick = len1;
+	struct float_chain *f = &d->fc;
+	int i=0, i2=0;
+	while (i < len) {
+		f->now_r += iq[i];
+		f->now_j += iq[i+1];
+		i += 2;
+		f->prev_index++;
+		if (f->prev_index < d->downsample) {
+			continue;
 		}
+		iq[i2]   = f->now_r;
+		iq[i2+1] = f->now_j;
+		f->prev_index = 0;
+		f->now_r = 0;
+		f->now_j = 0;
+		i2 += 2;
+	}
+	return i2;
+}
+
+static void f32_to_s16(const float *in, int len, float scale, int16_t *out)
+{
+	int i;
+	float x;
+	for (i = 0; i < len; i++) {
+		x = in[i] * scale;
+		x = x < 32767.0f ? x : 32767.0f;
+		x = x > -32768.0f ? x : -32768.0f;
+		out[i] = (int16_t)lrintf(x);
 	}
-	for (j=0; j<len2; j++) {
-		buf2[j] = buf2[j] * len2 / len1;}
 }
 
-static void arbitrary_resample(int16_t *buf1, int16_t *buf2, int len1, int len2)
-/* up to you to calculate lengths and make sure it does not go OOB
- * okay for buffers to overlap, if you are downsampling */
+static void float_demod(struct demod_state *d)
+/* the fm chain of full_demod() in float32, nothing is shifted or
+   rounded between the stages.  The rds, squelch and stereo taps are
+   fixed point, they get an int16 copy in the discriminator units. */
 {
-	if (len1 < len2) {
-		arbitrary_upsample(buf1, buf2, len1, len2);
+	struct float_chain *f = &d->fc;
+	float *iq = f->iq, *mpx = f->mpx;
+	float avg;
+	double sum;
+	int i, n = d->lp_len, m;
+
+	for (i = 0; i < n; i++) {
+		iq[i] = (float)d->lowpassed[i];}
+	if (d->downsample_passes) {
+		n = halfband_f32_decimate(&f->hb, iq, n);
 	} else {
-		arbitrary_downsample(buf1, buf2, len1, len2);
+		n = float_low_pass(d, iq, n);
+	}
+	d->result_len = 0;
+	if (n < 2) {
+		return;}
+	f->fm_disc(iq, n, f->pre_r, f->pre_j, mpx);
+	f->pre_r = iq[n - 2];
+	f->pre_j = iq[n - 1];
+	m = n / 2;
+	if (d->rds) {
+		f32_to_s16(mpx, m, DISC_SCALE, d->result);
+		rds_process(&d->rds_dec, d->result, m);
+	}
+	if (d->post_downsample > 1) {
+		m = fir_f32_process(&f->post_fir, mpx, m);}
+	if (d->squelch_level > 0 || d->stereo) {
+		f32_to_s16(mpx, m, DISC_SCALE, d->result);}
+	if (d->squelch_level > 0) {
+		squelch(d, d->result, m);}
+	if (d->stereo) {
+		d->result_len = stereo_process(&d->stereo_dec, d->result, m, MAXIMUM_BUF_LENGTH);
+		return;
+	}
+	if (d->deemph) {
+		avg = f->deemph_avg;
+		for (i = 0; i < m; i++) {
+			avg += f->deemph_alpha * (mpx[i] - avg);
+			mpx[i] = avg;
+		}
+		f->deemph_avg = avg;
 	}
+	if (d->dc_block && m > 0) {
+		sum = 0;
+		for (i = 0; i < m; i++) {
+			sum += mpx[i];}
+		avg = ((float)(sum / m) + f->dc_avg * 9) / 10;
+		for (i = 0; i < m; i++) {
+			mpx[i] -= avg;}
+		f->dc_avg = avg;
+	}
+	if (d->rate_out2 > 0) {
+		m = resample_process_f32(&f->audio_rs, mpx, m, MAXIMUM_BUF_LENGTH);}
+	f32_to_s16(mpx, m, DISC_SCALE, d->result);
+	d->result_len = m;
 }
 
-static void full_demod(struct demod_state *d)
+void full_demod(struct demod_state *d)
 {
-	int i, ds_p;
+	int i, ds_p, pairs;
 	uint32_t sr = 0;
 	ds_p = d->downsample_passes;
-	if (ds_p) {
-		for (i=0; i < ds_p; i++) {
-			fifth_order(d->lowpassed,   (d->lp_len >> i), d->lp_i_hist[i]);
-			fifth_order(d->lowpassed+1, (d->lp_len >> i) - 1, d->lp_q_hist[i]);
-		}
-		d->lp_len = d->lp_len >> ds_p;
-		/* droop compensation */
-		if (d->comp_fir_size == 9 && ds_p <= CIC_TABLE_MAX) {
-			generic_fir(d->lowpassed, d->lp_len,
-				cic_9_tables[ds_p], d->droop_i_hist);
-			generic_fir(d->lowpassed+1, d->lp_len-1,
-				cic_9_tables[ds_p], d->droop_q_hist);
-		}
+	stages_init(d);
+	pairs = d->lp_len / 2;
+	if (d->perf) {
+		perf_start(d->perf);}
+	if (d->fp && d->mode_demod == &fm_demod && d->fc.iq) {
+		float_demod(d);
+		if (d->squelched) {
+			memset(d->result, 0, 2 * d->result_len);}
+		PERF_MARK(d->perf, PERF_CHAIN, pairs);
+		return;
+	}
+	if (d->fused && d->mode_demod == &fm_demod) {
+		fused_demod(d);
+		if (d->squelched) {
+			memset(d->result, 0, 2 * d->result_len);}
+		PERF_MARK(d->perf, PERF_CHAIN, pairs);
+		return;
+	}
+	if (d->pool) {
+		/* decimator and demodulator across the cores, see rtl_fm_pool.h */
+		pool_demod(d->pool, d);
+		PERF_MARK(d->perf, PERF_DECIM_DEMOD, pairs);
+	} else if (d->pipeline[0]) {
+		/* the same stages, specialised for the options, see DspPipeline.hh */
+		for (i = 0; i < DSP_SEGMENTS && d->pipeline[i]; i++) {
+			d->pipeline[i](d);}
+		return;
 	} else {
-		low_pass(d);
+		if (ds_p) {
+			d->lp_len = halfband_decimate(&d->hb, d->lowpassed, d->lp_len);
+		} else {
+			d->lp_len = low_pass(d, d->lowpassed, d->lp_len);
+		}
+		PERF_MARK(d->perf, PERF_DECIMATE, pairs);
+		d->mode_demod(d);  /* lowpassed -> result */
+		PERF_MARK(d->perf, PERF_DEMOD, d->lp_len / 2);
 	}
-	d->mode_demod(d);  /* lowpassed -> result */
 	if (d->mode_demod == &raw_demod) {
 		return;
 	}
-	/* todo, fm noise squelch */
-	// use nicer filter here too?
+	if (d->rds) {
+		/* taps the multiplex before anything decimates it */
+		rds_process(&d->rds_dec, d->result, d->result_len);
+		PERF_MARK(d->perf, PERF_RDS, d->result_len);
+	}
 	if (d->post_downsample > 1) {
-                //fprintf(stderr, "full_demod(): post-demod - call low_pass_simple()\n");
-		d->result_len = low_pass_simple(d->result, d->result_len, d->post_downsample);}
-	if (d->deemph) {
-                //fprintf(stderr, "full_demod(): post-demod - call deemph_filter()\n");
-		deemph_filter(d);}
-	if (d->dc_block) {
-                //fprintf(stderr, "full_demod(): post-demod - call dc_block_filter()\n");
-		dc_block_filter(d);}
-	if (d->rate_out2 > 0) {
-                //fprintf(stderr, "full_demod(): post-demod - call low_pass_real()\n");
-		low_pass_real(d);
-		//arbitrary_resample(d->result, d->result, d->result_len, d->result_len * d->rate_out2 / d->rate_out);
+		pairs = d->result_len;
+		d->result_len = fir_process(&d->post_fir, d->result, d->result_len);
+		PERF_MARK(d->perf, PERF_POST_FIR, pairs);
 	}
 	if (d->squelch_level > 0) {
-            //fprintf(stderr, "full_demod(): post-demod - call squelch()\n");
-            //squelch(d->result, d->result_len, d->squelch_level);
+		squelch(d, d->result, d->result_len);
+		PERF_MARK(d->perf, PERF_SQUELCH, d->result_len);
+	}
+	pairs = d->result_len;
+	if (d->stereo) {
+		d->result_len = stereo_process(&d->stereo_dec, d->result, d->result_len, MAXIMUM_BUF_LENGTH);
+	} else {
+		mono_audio(d);
 	}
+	if (d->squelched) {
+		memset(d->result, 0, 2 * d->result_len);}
+	PERF_MARK(d->perf, PERF_AUDIO, pairs);
 }
 
 static int get_bool_simple(char **ptr, char *str, int invert, int orig)
@@ -854,60 +875,112 @@ static void set_mixer(char* control) {
 static void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx)
 {
 	int i;
+	int16_t *lp;
 	struct dongle_state *s = (dongle_state*) ctx;
 	struct demod_state *d = s->demod_target;
+	uint64_t now = stamp_now_ns();
+	struct block_stamp *st;
+	uint32_t waits;
 
 	if (do_exit) {
 		return;}
 	if (!ctx) {
 		return;}
+	TRACE_BEGIN("usb callback");
+	PROF_STAGE("usb callback");
+	if (s->testmode) {
+		/* before the mute writes over it */
+		counter_check_block(&s->test, buf, len, s->rate, now);}
 	if (s->mute) {
 		for (i=0; i<s->mute; i++) {
 			buf[i] = 127;}
 		s->mute = 0;
 	}
-	if (!s->offset_tuning) {
-		rotate_90(buf, len);}
-	for (i=0; i<(int)len; i++) {
-		s->buf16[i] = (int16_t)buf[i] - 127;}
-	pthread_rwlock_wrlock(&d->rw);
-	memcpy(d->lowpassed, s->buf16, 2*len);
-	d->lp_len = len;
-	pthread_rwlock_unlock(&d->rw);
-	safe_cond_signal(&d->ready, &d->ready_m);
+	/* one pass from the usb buffer straight into a block of the demod
+	   ring, waits for the demod rather than writing over a block */
+	waits = d->ring.full_waits;
+	lp = ring_acquire(&d->ring);
+	if (!lp) {
+		TRACE_END("usb callback");
+		PROF_STAGE(NULL);
+		return;}
+	if (d->ring.full_waits != waits) {
+		METRIC_ADD(dongle_waits, 1);}
+	if (len > (uint32_t)d->ring.block_len) {
+		len = d->ring.block_len;}
+	st = ring_next_stamp(&d->ring);
+	st->usb_ns = now;
+	st->sample = s->samples;
+	s->samples += len / 2;
+	METRIC_ADD(dongle_blocks, 1);
+	METRIC_ADD(dongle_samples, len / 2);
+	s->iq_convert(buf, len, !s->offset_tuning, lp);
+	st->sent_ns = stamp_now_ns();
+	lat_add(&s->lat_ring, now, st->sent_ns);
+	ring_publish(&d->ring, len);
+	TRACE_END("usb callback");
+	PROF_STAGE(NULL);
 }
 
 void *dongle_thread_fn(void *arg)
 {
         fprintf(stderr, "dongle TID: %lu\n", gettid());
+	rt_enter(RT_DONGLE);
+	trace_thread("dongle");
+	prof_thread("dongle");
 
 	struct dongle_state *s = (dongle_state*) arg;
-	rtlsdr_read_async(s->dev, rtlsdr_callback, s, 0, s->buf_len);
+	rtlsdr_read_async(s->dev, rtlsdr_callback, s, s->buf_num, s->buf_len);
 	return 0;
 }
 
 void *demod_thread_fn(void *arg)
 {
         fprintf(stderr, "demod TID: %lu\n", gettid());
+	rt_enter(RT_DEMOD);
+	trace_thread("demod");
+	prof_thread("demod");
 
 	struct demod_state *d = (demod_state*) arg;
 	struct output_state *o = d->output_target;
+	struct block_stamp st, *out;
+	uint64_t now;
 	while (!do_exit) {
-		safe_cond_wait(&d->ready, &d->ready_m);
-		pthread_rwlock_wrlock(&d->rw);
+		/* demodulate from the dongle block into an output block */
+		d->lowpassed = ring_peek(&d->ring, &d->lp_len);
+		if (!d->lowpassed) {
+			break;}
+		now = stamp_now_ns();
+		st = *ring_stamp(&d->ring);
+		lat_add(&d->lat_queue, st.sent_ns, now);
+		d->result = ring_acquire(&o->ring);
+		if (!d->result) {
+			break;}
+		if (metrics_shared) {
+			METRIC_SET(rssi_cdb, metrics_rssi(d->lowpassed, d->lp_len, METRICS_RSSI_STEP));}
+		TRACE_BEGIN("full_demod");
+		PROF_STAGE("full_demod");
 		full_demod(d);
-		pthread_rwlock_unlock(&d->rw);
+		PROF_STAGE(NULL);
+		TRACE_END("full_demod");
+		ring_release(&d->ring);
 		if (d->exit_flag) {
 			do_exit = 1;
 		}
 		//if (this block was squelched) {
 		//	continue;  // don't output
 		//}
-		pthread_rwlock_wrlock(&o->rw);
-		memcpy(o->result, d->result, 2*d->result_len);
-		o->result_len = d->result_len;
-		pthread_rwlock_unlock(&o->rw);
-		safe_cond_signal(&o->ready, &o->ready_m);
+		out = ring_next_stamp(&o->ring);
+		*out = st;
+		out->sent_ns = stamp_now_ns();
+		lat_add(&d->lat_dsp, now, out->sent_ns);
+		METRIC_ADD(demod_blocks, 1);
+		METRIC_ADD(demod_dsp_ns, out->sent_ns - now);
+		METRIC_SET(dsp_ns, (int64_t)(out->sent_ns - now));
+		METRIC_SET(squelched, (int64_t)d->squelched);
+		if (d->squelched) {
+			METRIC_ADD(demod_squelched, 1);}
+		ring_publish(&o->ring, d->result_len);
 	}
 	return 0;
 }
@@ -915,14 +988,42 @@ void *demod_thread_fn(void *arg)
 void *output_thread_fn(void *arg)
 {
         fprintf(stderr, "output TID: %lu\n", gettid());
+	rt_enter(RT_OUTPUT);
+	trace_thread("output");
+	prof_thread("output");
 
 	struct output_state *s = (output_state*) arg;
+	int16_t *buf;
+	int len;
+	const struct block_stamp *st;
+	uint64_t now, done;
 	while (!do_exit) {
-		// use timedwait and pad out under runs
-		safe_cond_wait(&s->ready, &s->ready_m);
-		pthread_rwlock_rdlock(&s->rw);
-		fwrite(s->result, 2, s->result_len, s->file);
-		pthread_rwlock_unlock(&s->rw);
+		// pad out under runs
+		buf = ring_peek(&s->ring, &len);
+		if (!buf) {
+			break;}
+		now = stamp_now_ns();
+		st = ring_stamp(&s->ring);
+		lat_add(&s->lat_queue, st->sent_ns, now);
+		TRACE_BEGIN("write");
+		PROF_STAGE("write");
+		if (s->alsa.pcm) {
+			if (alsa_sink_write(&s->alsa, buf, len) < 0) {
+				METRIC_ADD(output_drops, 1);}
+			METRIC_SET(xruns, (int64_t)s->alsa.xruns);
+		} else if (fwrite(buf, 2, len, s->file) != (size_t)len) {
+			METRIC_ADD(output_drops, 1);
+		}
+		PROF_STAGE(NULL);
+		TRACE_END("write");
+		METRIC_ADD(output_blocks, 1);
+		done = stamp_now_ns();
+		lat_add(&s->lat_write, now, done);
+		if (s->alsa.pcm) {
+			/* on through the card's queue, to when the block is heard */
+			done += alsa_sink_delay_ns(&s->alsa);}
+		lat_add(&s->lat_total, st->usb_ns, done);
+		ring_release(&s->ring);
 	}
 	return 0;
 }
@@ -955,11 +1056,16 @@ void optimal_settings(int freq, int rate)
 		dm->output_scale = 1;}
 	d->freq = (uint32_t)capture_freq;
 	d->rate = (uint32_t)capture_rate;
+	METRIC_SET(freq_hz, (int64_t)freq);
+	METRIC_ADD(tunes, 1);
 }
 
 void *controller_thread_fn(void *arg)
 {
         fprintf(stderr, "controller TID: %lu\n", gettid());
+	rt_enter(RT_CONTROLLER);
+	trace_thread("controller");
+	prof_thread("controller");
 
 	// thoughts for multiple dongles
 	// might be no good using a controller thread if retune/rate blocks
@@ -992,9 +1098,11 @@ void *controller_thread_fn(void *arg)
 			continue;}
 		/* hacky hopping */
 		s->freq_now = (s->freq_now + 1) % s->freq_len;
+		TRACE_BEGIN("retune");
 		optimal_settings(s->freqs[s->freq_now], demod.rate_in);
 		rtlsdr_set_center_freq(dongle.dev, dongle.freq);
 		dongle.mute = BUFFER_DUMP;
+		TRACE_END("retune");
 	}
 	return 0;
 }
@@ -1019,6 +1127,40 @@ void frequency_range(struct controller_state *s, char *arg)
 	step[-1] = ':';
 }
 
+int rings_init(void)
+/* librtlsdr hands over up to MAXIMUM_BUF_LENGTH bytes per callback,
+   the demod writes up to MAXIMUM_BUF_LENGTH int16 per block */
+{
+	if (ring_init(&demod.ring, RING_BLOCKS, MAXIMUM_BUF_LENGTH) < 0) {
+		return -1;}
+	return ring_init(&output.ring, RING_BLOCKS, MAXIMUM_BUF_LENGTH);
+}
+
+void rings_close(void)
+{
+	ring_close(&demod.ring);
+	ring_close(&output.ring);
+}
+
+void rings_report(void)
+{
+	struct ring_latency l;
+	memset(&l, 0, sizeof(l));
+	ring_latency_print("dongle", &demod.ring.full_lat);
+	ring_latency_add(&l, &demod.ring.empty_lat);
+	ring_latency_add(&l, &output.ring.full_lat);
+	ring_latency_print("demod", &l);
+	ring_latency_print("output", &output.ring.empty_lat);
+	lat_print("usb to ring", &dongle.lat_ring);
+	lat_print("demod queue", &demod.lat_queue);
+	lat_print("demod dsp", &demod.lat_dsp);
+	lat_print("output queue", &output.lat_queue);
+	lat_print("output write", &output.lat_write);
+	lat_print(output.alsa.device ? "usb to played" : "usb to written", &output.lat_total);
+	if (dongle.testmode) {
+		counter_check_print(&dongle.test);}
+}
+
 void dongle_init(struct dongle_state *s)
 {
 	s->rate = DEFAULT_SAMPLE_RATE;
@@ -1026,6 +1168,8 @@ void dongle_init(struct dongle_state *s)
 	s->mute = 0;
 	s->direct_sampling = 0;
 	s->offset_tuning = 0;
+	s->buf_num = 0;
+	s->iq_convert = iq_convert_select(dsp_cpu_features());
 	s->demod_target = &demod;
 }
 
@@ -1034,6 +1178,20 @@ void demod_init(struct demod_state *s)
 	s->rate_in = DEFAULT_SAMPLE_RATE;
 	s->rate_out = DEFAULT_SAMPLE_RATE;
 	s->squelch_level = 0;
+	s->squelched = 0;
+	s->stereo = 0;
+	s->rds = 0;
+	s->fused = 0;
+	s->fp = 0;
+	s->workers = 0;
+	s->verbose = 0;
+	s->pool = NULL;
+	s->fc.pre_r = s->fc.pre_j = s->fc.now_r = s->fc.now_j = 0;
+	s->fc.prev_index = 0;
+	s->fc.deemph_avg = 0;
+	s->fc.dc_avg = 0;
+	memset(s->pipeline, 0, sizeof(s->pipeline));
+	s->squelch_hits = 0;
 	s->downsample_passes = 0;
 	s->comp_fir_size = 0;
 	s->prev_index = 0;
@@ -1042,38 +1200,35 @@ void demod_init(struct demod_state *s)
 	s->deemph = 0;
 	s->rate_out2 = -1;  // flag for disabled
 	s->mode_demod = &fm_demod;
+	s->fm_disc = &fm_disc_std;
 	s->pre_j = s->pre_r = s->now_r = s->now_j = 0;
-	s->prev_lpr_index = 0;
 	s->deemph_a = 0;
-	s->now_lpr = 0;
+	s->deemph_avg = 0;
 	s->dc_block = 0;
 	s->dc_avg = 0;
-	pthread_rwlock_init(&s->rw, NULL);
-	pthread_cond_init(&s->ready, NULL);
-	pthread_mutex_init(&s->ready_m, NULL);
 	s->output_target = &output;
 }
 
 void demod_cleanup(struct demod_state *s)
 {
-	pthread_rwlock_destroy(&s->rw);
-	pthread_cond_destroy(&s->ready);
-	pthread_mutex_destroy(&s->ready_m);
+	if (s->pool) {
+		pool_free(s->pool);
+		s->pool = NULL;
+	}
+	perf_close(s->perf);
+	s->perf = NULL;
+	ring_free(&s->ring);
 }
 
 void output_init(struct output_state *s)
 {
 	s->rate = DEFAULT_SAMPLE_RATE;
-	pthread_rwlock_init(&s->rw, NULL);
-	pthread_cond_init(&s->ready, NULL);
-	pthread_mutex_init(&s->ready_m, NULL);
 }
 
 void output_cleanup(struct output_state *s)
 {
-	pthread_rwlock_destroy(&s->rw);
-	pthread_cond_destroy(&s->ready);
-	pthread_mutex_destroy(&s->ready_m);
+	alsa_sink_close(&s->alsa);
+	ring_free(&s->ring);
 }
 
 void controller_init(struct controller_state *s)
@@ -40,10 +40,8 @@
  *       fifo for active hop frequency
  *       clips
  *       noise squelch
- *       merge stereo patch
  *       merge soft agc patch
  *       merge udp patch
- *       testmode to detect overruns
  *       watchdog to reset bad dongle
  *       fix oversampling
  */
@@ -77,6 +75,22 @@
 
 #include "rtl-sdr.h"
 #include "rtl_convenience.h"
+#include "rtl_fm_dsp.h"
+#include "rtl_fm_fir.h"
+#include "rtl_fm_resample.h"
+#include "rtl_fm_spectrum.h"
+#include "rtl_fm_stereo.h"
+#include "rtl_fm_rds.h"
+#include "rtl_fm_stamp.h"
+#include "rtl_fm_metrics.h"
+#include "rtl_fm_trace.h"
+#include "rtl_fm_perf.h"
+#include "rtl_fm_log.h"
+#include "rtl_fm_prof.h"
+#include "rtl_fm_testmode.h"
+#include "rtl_fm_ring.h"
+#include "rtl_fm_rt.h"
+#include "rtl_fm_alsa.h"
 
 #define DEFAULT_SAMPLE_RATE		24000
 #define DEFAULT_BUF_LENGTH		(1 * 16384)
@@ -87,6 +101,34 @@
 
 #define FREQUENCIES_LIMIT		1000
 
+#define SQUELCH_NFFT			512
+#define SQUELCH_FPS			50
+
+/* -E fused, fm samples per tile after the decimation.  The decimator
+   reads its input once whatever the tile, what stays in the cache is
+   what the later stages hand on, 16 KB of iq and 8 KB of audio; fewer
+   and the calls per tile cost more than the cache saves */
+#define FUSED_OUT			4096
+
+/* -E float, the fm chain in float32 for cores with an FPU (Pi 2/3/4),
+   the float buffers hold a whole block */
+#define FLOAT_BUF_LENGTH		MAXIMUM_BUF_LENGTH
+
+/* the specialised pipeline, front, taps and audio, see DspPipeline.hh */
+#define DSP_SEGMENTS			3
+
+/* -S, the signal power gauge looks at every 16th iq pair of a block */
+#define METRICS_RSSI_STEP		16
+
+/* librtlsdr's default, transfers queued in the kernel */
+#define DEFAULT_BUF_NUMBER		15
+
+/* -A lut, 2 KB of int16 that stays in L1, for accuracy and not speed:
+   no divide, but on x86 it runs at about 0.6x -A fast */
+#define ATAN_LUT_BITS			10
+#define ATAN_LUT_SIZE			(1 << ATAN_LUT_BITS)
+#define ATAN_LUT_FRAC			2
+
 /* more cond dumbness */
 #define safe_cond_signal(n, m) pthread_mutex_lock(m); pthread_cond_signal(n); pthread_mutex_unlock(m)
 #define safe_cond_wait(n, m) pthread_mutex_lock(m); pthread_cond_wait(n, m); pthread_mutex_unlock(m)
@@ -100,26 +142,46 @@ struct dongle_state
 	uint32_t freq;
 	uint32_t rate;
 	int      gain;
-	uint16_t buf16[MAXIMUM_BUF_LENGTH];
 	uint32_t buf_len;
+	uint32_t buf_num;
 	int      ppm_error;
 	int      offset_tuning;
 	int      direct_sampling;
 	int      mute;
+	int      testmode;         /* -E testmode, the chip's counter instead of samples */
+	struct counter_check test;
+	iq_convert_fn iq_convert;
+	uint64_t samples;          /* iq pairs handed to the demod so far */
+	struct lat_hist lat_ring;  /* usb arrival to published, convert and ring full */
 	struct demod_state *demod_target;
 };
 
+struct float_chain
+{
+	float    *iq;           /* lowpassed[], decimated in place */
+	float    *mpx;          /* discriminator out in radians, then audio */
+	float    pre_r, pre_j;
+	float    now_r, now_j;
+	int      prev_index;
+	struct halfband_cascade_f32 hb;
+	struct fir_filter_f32 post_fir;
+	struct resampler audio_rs;
+	float    deemph_alpha, deemph_avg;
+	float    dc_avg;
+	fm_disc_f32_fn fm_disc;
+};
+
+struct demod_pool;
+
 struct demod_state
 {
 	int      exit_flag;
 	pthread_t thread;
-	int16_t  lowpassed[MAXIMUM_BUF_LENGTH];
+	struct block_ring ring;    /* blocks from the dongle */
+	int16_t  *lowpassed;       /* MAXIMUM_BUF_LENGTH, the block being demodulated */
 	int      lp_len;
-	int16_t  lp_i_hist[10][6];
-	int16_t  lp_q_hist[10][6];
-	int16_t  result[MAXIMUM_BUF_LENGTH];
-	int16_t  droop_i_hist[9];
-	int16_t  droop_q_hist[9];
+	struct halfband_cascade hb;
+	int16_t  *result;          /* MAXIMUM_BUF_LENGTH, a block of the output ring */
 	int      result_len;
 	int      rate_in;
 	int      rate_out;
@@ -129,19 +191,34 @@ struct demod_state
 	int      prev_index;
 	int      downsample;    /* min 1, max 256 */
 	int      post_downsample;
+	struct fir_filter post_fir;
 	int      output_scale;
 	int      squelch_level;
+	int      squelched, squelch_hits;
+	struct spectrum spec;
 	int      downsample_passes;
 	int      comp_fir_size;
 	int      custom_atan;
-	int      deemph, deemph_a;
-	int      now_lpr;
-	int      prev_lpr_index;
+	fm_disc_fn fm_disc;
+	int      deemph, deemph_a, deemph_avg;
+	int      stereo;
+	struct stereo_decoder stereo_dec;
+	int      rds;
+	struct rds_decoder rds_dec;
+	int      fused;
+	int      fp;
+	struct float_chain fc;
+	void     (*pipeline[DSP_SEGMENTS])(struct demod_state*);
+	int      workers;
+	int      verbose;          /* threads it starts print their TID, not under -B */
+	struct demod_pool *pool;
+	struct resampler audio_rs;
 	int      dc_block, dc_avg;
 	void     (*mode_demod)(struct demod_state*);
-	pthread_rwlock_t rw;
-	pthread_cond_t ready;
-	pthread_mutex_t ready_m;
+	struct lat_hist lat_queue; /* in the dongle ring */
+	struct lat_hist lat_dsp;   /* peek to the output block published */
+	int      perf_on;          /* -E perf, opened by the demod thread itself */
+	struct perf_counters *perf;
 	struct output_state *output_target;
 };
 
@@ -151,12 +228,12 @@ struct output_state
 	pthread_t thread;
 	FILE     *file;
 	const char     *filename;
-	int16_t  result[MAXIMUM_BUF_LENGTH];
-	int      result_len;
+	struct block_ring ring;    /* blocks from the demod */
+	struct alsa_sink alsa;     /* -D, in place of file */
 	int      rate;
-	pthread_rwlock_t rw;
-	pthread_cond_t ready;
-	pthread_mutex_t ready_m;
+	struct lat_hist lat_queue; /* in the output ring */
+	struct lat_hist lat_write; /* fwrite() or alsa_sink_write() */
+	struct lat_hist lat_total; /* usb arrival to written, to played with -D */
 };
 
 struct controller_state
@@ -193,6 +270,28 @@ extern void *demod_thread_fn(void *arg);
 extern void *output_thread_fn(void *arg);
 extern void *controller_thread_fn(void *arg);
 
+/*!
+ * Allocate the rings between the threads, once the options are known
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+
+extern int rings_init(void);
+
+/*!
+ * Wake every thread blocked on a ring and make it return, for exit
+ */
+
+extern void rings_close(void);
+
+/*!
+ * Print how long each stage thread waited for the cpu once woken, and
+ * the percentiles of each stage a block goes through, after the threads
+ * are joined
+ */
+
+extern void rings_report(void);
+
 extern void dongle_init(struct dongle_state *s);
 extern void demod_init(struct demod_state *s);
 extern void demod_cleanup(struct demod_state *s);
@@ -205,12 +304,33 @@ extern void frequency_range(struct controller_state *s, char *arg);
 extern int atan_lut_init(void);
 extern void sanity_checks(void);
 
+extern void fm_disc_select(struct demod_state *fm);
+
+/*!
+ * Demodulate the block in lowpassed[] into result[], what the demod
+ * thread runs per block, exposed for the benchmark
+ *
+ * \param d demod state, lp_len samples in lowpassed[]
+ */
+
+extern void full_demod(struct demod_state *d);
+
 extern void fm_demod(struct demod_state *fm);
 extern void am_demod(struct demod_state *fm);
 extern void usb_demod(struct demod_state *fm);
 extern void lsb_demod(struct demod_state *fm);
 extern void raw_demod(struct demod_state *fm);
 
+/* the stages full_demod() is built from, DspPipeline.hh composes them too */
+
+extern int low_pass(struct demod_state *d, int16_t *lp, int len);
+extern void fm_disc_std(const int16_t *lp, int len, int pre_r, int pre_j, int16_t *result);
+extern void fm_disc_fast(const int16_t *lp, int len, int pre_r, int pre_j, int16_t *result);
+extern void fm_disc_lut(const int16_t *lp, int len, int pre_r, int pre_j, int16_t *result);
+extern void deemph_filter(struct demod_state *fm, int16_t *buf, int len);
+extern void dc_block_filter(struct demod_state *fm);
+extern void squelch(struct demod_state *d, const int16_t *buf, int len);
+
 extern void optimal_settings(int freq, int rate);
 
 #endif /* #ifndef __RTL_FM_LIB_H */
@@ -0,0 +1,315 @@
+/*
+ * Leveled logging off the real-time threads
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+
+#include "rtl_fm_stamp.h"
+#include "rtl_fm_log.h"
+
+struct log_ring
+{
+	uint32_t head;              /* written by its thread */
+	uint32_t tail __attribute__((aligned(64)));  /* written by the writer */
+	uint64_t dropped;           /* ring full, written by its thread */
+	uint64_t dropped_told;
+	int      tid;
+	struct log_record rec[LOG_RECORDS] __attribute__((aligned(64)));
+};
+
+int log_level = LOG_LEVEL_INFO;
+
+static const char log_levels[] = "EWID";
+static __thread struct log_ring *log_tls;
+static struct log_ring *log_rings[LOG_MAX_THREADS];
+static int log_nrings;
+static int log_running;
+static int log_closing;
+static uint64_t log_t0;
+static pthread_t log_writer;
+
+static void log_parse(struct log_site *s)
+/* the argument types, from the conversions, for va_arg() now and for
+   snprintf() in the writer */
+{
+	const char *f = s->fmt;
+	int n = 0, longs;
+	char t;
+	while ((f = strchr(f, '%'))) {
+		f++;
+		if (*f == '%') {
+			f++;
+			continue;
+		}
+		f += strspn(f, "-+ #0123456789.");
+		longs = 0;
+		t = 0;
+		for (; *f && strchr("hlqjzt", *f); f++) {
+			if (*f == 'l') {
+				longs++;}
+			if (*f == 'q' || *f == 'j') {
+				longs = 2;}
+			if (*f == 'z' || *f == 't') {
+				t = 'z';}
+		}
+		switch (*f) {
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			t = 'd'; break;
+		case 's':
+			t = 's'; break;
+		case 'p':
+			t = 'p'; break;
+		default:
+			if (!t) {
+				t = longs > 1 ? 'L' : longs ? 'l' : 'i';}
+		}
+		if (*f) {
+			f++;}
+		if (n < LOG_MAX_ARGS) {
+			s->types[n] = t;}
+		n++;
+	}
+	__atomic_store_n(&s->nargs, n < LOG_MAX_ARGS ? n : LOG_MAX_ARGS, __ATOMIC_RELEASE);
+}
+
+static int log_format(char *buf, int size, const struct log_record *r)
+/* the format a conversion at a time, each with its own argument */
+{
+	const struct log_site *s = r->site;
+	const char *f = s->fmt, *c;
+	char spec[32];
+	int len, n, a = 0;
+	uint64_t us = (r->ts_ns - log_t0) / 1000;
+	size -= 1;  /* for the newline */
+	len = snprintf(buf, size, "%llu.%06llu %c ", (unsigned long long)(us / 1000000),
+		(unsigned long long)(us % 1000000), log_levels[s->level]);
+	while (*f && len < size) {
+		c = strchr(f, '%');
+		if (!c) {
+			len += snprintf(buf + len, size - len, "%s", f);
+			break;
+		}
+		if (c[1] == '%') {
+			len += snprintf(buf + len, size - len, "%.*s", (int)(c - f + 1), f);
+			f = c + 2;
+			continue;
+		}
+		len += snprintf(buf + len, size - len, "%.*s", (int)(c - f), f);
+		if (len >= size) {
+			break;}
+		n = strspn(c + 1, "-+ #0123456789.hlqjzt") + 2;
+		if (n >= (int)sizeof(spec)) {
+			n = sizeof(spec) - 1;}
+		memcpy(spec, c, n);
+		spec[n] = 0;
+		f = c + n;
+		if (a >= s->nargs) {
+			/* past LOG_MAX_ARGS, left as it is */
+			len += snprintf(buf + len, size - len, "%s", spec);
+			continue;
+		}
+		switch (s->types[a]) {
+		case 'd': len += snprintf(buf + len, size - len, spec, r->arg[a].d); break;
+		case 's': len += snprintf(buf + len, size - len, spec, (const char*)r->arg[a].p); break;
+		case 'p': len += snprintf(buf + len, size - len, spec, r->arg[a].p); break;
+		case 'l': len += snprintf(buf + len, size - len, spec, (long)r->arg[a].i); break;
+		case 'L': len += snprintf(buf + len, size - len, spec, (long long)r->arg[a].i); break;
+		case 'z': len += snprintf(buf + len, size - len, spec, (size_t)r->arg[a].i); break;
+		default:  len += snprintf(buf + len, size - len, spec, (int)r->arg[a].i); break;
+		}
+		a++;
+	}
+	if (len > size - 1) {
+		len = size - 1;}
+	if (len > 0 && buf[len - 1] == '\n') {
+		len--;}
+	if (r->missed && len < size) {
+		len += snprintf(buf + len, size - len, " (%u before this not shown)", r->missed);
+		if (len > size - 1) {
+			len = size - 1;}
+	}
+	buf[len++] = '\n';
+	buf[len] = 0;
+	return len;
+}
+
+static struct log_ring *log_ring_get(void)
+{
+	struct log_ring *r;
+	int i;
+	if (log_tls) {
+		return log_tls;}
+	r = (struct log_ring*)calloc(1, sizeof(struct log_ring));
+	if (!r) {
+		return NULL;}
+	i = __atomic_fetch_add(&log_nrings, 1, __ATOMIC_RELAXED);
+	if (i >= LOG_MAX_THREADS) {
+		free(r);
+		return NULL;
+	}
+	r->tid = (int)syscall(SYS_gettid);
+	__atomic_store_n(&log_rings[i], r, __ATOMIC_RELEASE);
+	log_tls = r;
+	return r;
+}
+
+void log_write(struct log_site *s, ...)
+{
+	struct log_record rec, *e = &rec;
+	struct log_ring *r = NULL;
+	char buf[512];
+	uint64_t now = stamp_now_ns(), zero = 0;
+	int i, nargs;
+	uint32_t head;
+	va_list ap;
+	if (now - __atomic_load_n(&s->window_ns, __ATOMIC_RELAXED) >= 1000000000ULL) {
+		__atomic_store_n(&s->window_ns, now, __ATOMIC_RELAXED);
+		__atomic_store_n(&s->count, 0, __ATOMIC_RELAXED);
+	}
+	if (__atomic_add_fetch(&s->count, 1, __ATOMIC_RELAXED) > (uint32_t)s->rate) {
+		__atomic_add_fetch(&s->suppressed, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	nargs = __atomic_load_n(&s->nargs, __ATOMIC_ACQUIRE);
+	if (nargs < 0) {
+		log_parse(s);
+		nargs = s->nargs;
+	}
+	if (!__atomic_load_n(&log_t0, __ATOMIC_RELAXED)) {
+		__atomic_compare_exchange_n(&log_t0, &zero, now, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);}
+	if (__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)) {
+		r = log_ring_get();}
+	if (r) {
+		head = r->head;
+		if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= LOG_RECORDS) {
+			r->dropped++;
+			return;
+		}
+		e = &r->rec[head & (LOG_RECORDS - 1)];
+	}
+	e->ts_ns = now;
+	e->site = s;
+	e->missed = __atomic_exchange_n(&s->suppressed, 0, __ATOMIC_RELAXED);
+	va_start(ap, s);
+	for (i = 0; i < nargs; i++) {
+		switch (s->types[i]) {
+		case 'd': e->arg[i].d = va_arg(ap, double); break;
+		case 's':
+		case 'p': e->arg[i].p = va_arg(ap, const void*); break;
+		case 'l': e->arg[i].i = va_arg(ap, long); break;
+		case 'L': e->arg[i].i = va_arg(ap, long long); break;
+		case 'z': e->arg[i].i = (int64_t)va_arg(ap, size_t); break;
+		default:  e->arg[i].i = va_arg(ap, int); break;
+		}
+	}
+	va_end(ap);
+	if (r) {
+		__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+		return;
+	}
+	/* no writer, or no ring for this thread */
+	log_format(buf, sizeof(buf), e);
+	fputs(buf, stderr);
+}
+
+static int log_drain(void)
+/* oldest first across the rings, so the lines come out in order */
+{
+	char buf[512];
+	struct log_ring *r, *oldest;
+	const struct log_record *e;
+	uint64_t ts = 0, dropped;
+	int i, n, lines = 0;
+	n = __atomic_load_n(&log_nrings, __ATOMIC_ACQUIRE);
+	if (n > LOG_MAX_THREADS) {
+		n = LOG_MAX_THREADS;}
+	for (;;) {
+		oldest = NULL;
+		for (i = 0; i < n; i++) {
+			r = __atomic_load_n(&log_rings[i], __ATOMIC_ACQUIRE);
+			if (!r || r->tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) {
+				continue;}
+			e = &r->rec[r->tail & (LOG_RECORDS - 1)];
+			if (!oldest || e->ts_ns < ts) {
+				oldest = r;
+				ts = e->ts_ns;
+			}
+		}
+		if (!oldest) {
+			break;}
+		log_format(buf, sizeof(buf), &oldest->rec[oldest->tail & (LOG_RECORDS - 1)]);
+		__atomic_store_n(&oldest->tail, oldest->tail + 1, __ATOMIC_RELEASE);
+		fputs(buf, stderr);
+		lines++;
+	}
+	for (i = 0; i < n; i++) {
+		r = __atomic_load_n(&log_rings[i], __ATOMIC_ACQUIRE);
+		if (!r) {
+			continue;}
+		dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+		if (dropped != r->dropped_told) {
+			fprintf(stderr, "log: %llu lines lost, thread %i logs faster than they are written\n",
+				(unsigned long long)(dropped - r->dropped_told), r->tid);
+			r->dropped_told = dropped;
+		}
+	}
+	if (lines) {
+		fflush(stderr);}
+	return lines;
+}
+
+static void *log_writer_fn(void *arg)
+{
+	(void)arg;
+	/* behind everything else that wants the cpu */
+	setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+	while (!__atomic_load_n(&log_closing, __ATOMIC_ACQUIRE)) {
+		log_drain();
+		usleep(LOG_POLL_US);
+	}
+	__atomic_store_n(&log_running, 0, __ATOMIC_RELEASE);
+	log_drain();
+	return 0;
+}
+
+int log_open(void)
+{
+	if (!log_t0) {
+		log_t0 = stamp_now_ns();}
+	__atomic_store_n(&log_running, 1, __ATOMIC_RELEASE);
+	if (pthread_create(&log_writer, NULL, log_writer_fn, NULL)) {
+		__atomic_store_n(&log_running, 0, __ATOMIC_RELEASE);
+		fprintf(stderr, "log: no writer thread, logging from the callers\n");
+		return -1;
+	}
+	return 0;
+}
+
+void log_close(void)
+/* the rings stay, a thread not joined yet may still hold one */
+{
+	if (!__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)) {
+		return;}
+	__atomic_store_n(&log_closing, 1, __ATOMIC_RELEASE);
+	pthread_join(log_writer, NULL);
+}
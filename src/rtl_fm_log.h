@@ -0,0 +1,111 @@
+/*
+ * Leveled logging off the real-time threads
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * LOG_ERROR() to LOG_DEBUG() take a printf format and its arguments,
+ * but nothing is formatted by the caller: the arguments are copied raw
+ * into a 64 byte record on a ring only the calling thread writes, and
+ * a writer thread at a low priority formats them and writes stderr.
+ * So a log line costs a real-time thread a clock read and a few
+ * stores, no lock, no syscall, and when the ring is full the record
+ * is dropped rather than waited for.
+ *
+ * Since formatting happens later, a %s argument must still be there
+ * then, a string literal or something static, never a buffer on the
+ * stack.  At most LOG_MAX_ARGS arguments, no '*' width or precision.
+ *
+ * Each call site lets through LOG_RATE lines a second (LOG_AT() takes
+ * another rate), the rest are counted and the next line let through
+ * says how many were held back before it.  Until log_open() and after log_close() the
+ * lines that get through are written straight away.
+ */
+
+#ifndef __RTL_FM_LOG_H
+#define __RTL_FM_LOG_H
+
+#include <stdint.h>
+
+enum log_level
+{
+	LOG_LEVEL_ERROR,
+	LOG_LEVEL_WARN,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_DEBUG
+};
+
+#define LOG_MAX_ARGS		6
+#define LOG_RECORDS		256	/* per thread, 18 KB */
+#define LOG_MAX_THREADS		32
+#define LOG_RATE		10	/* lines a second per call site */
+#define LOG_POLL_US		20000
+
+union log_arg
+{
+	int64_t  i;
+	double   d;
+	const void *p;
+};
+
+struct log_site
+{
+	const char *fmt;
+	int      level;
+	int      rate;
+	int      nargs;             /* -1 until the format is parsed */
+	char     types[LOG_MAX_ARGS];
+	uint64_t window_ns;         /* start of the current second */
+	uint32_t count;             /* let through in it */
+	uint32_t suppressed;        /* since the last line let through */
+};
+
+struct log_record
+{
+	uint64_t ts_ns;
+	const struct log_site *site;
+	uint32_t missed;            /* held back at the site since the last one */
+	union log_arg arg[LOG_MAX_ARGS];
+};
+
+extern int log_level;
+
+extern void log_write(struct log_site *site, ...);
+
+#define LOG_AT(level, rate, fmt, ...) do { \
+	static struct log_site log_site_ = {fmt, level, rate, -1}; \
+	if ((level) <= log_level) log_write(&log_site_, ##__VA_ARGS__); } while (0)
+
+#define LOG_ERROR(fmt, ...)	LOG_AT(LOG_LEVEL_ERROR, LOG_RATE, fmt, ##__VA_ARGS__)
+#define LOG_WARN(fmt, ...)	LOG_AT(LOG_LEVEL_WARN, LOG_RATE, fmt, ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...)	LOG_AT(LOG_LEVEL_INFO, LOG_RATE, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(fmt, ...)	LOG_AT(LOG_LEVEL_DEBUG, LOG_RATE, fmt, ##__VA_ARGS__)
+
+/*!
+ * Start the writer thread, before the threads that log
+ *
+ * \return 0, -1 if it could not start, the lines are then written
+ *         by the callers
+ */
+
+extern int log_open(void);
+
+/*!
+ * Write what is left and stop the writer, after the threads are joined
+ */
+
+extern void log_close(void);
+
+#endif /* #ifndef __RTL_FM_LOG_H */
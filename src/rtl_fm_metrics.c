@@ -0,0 +1,189 @@
+/*
+ * Counters and gauges for rtl_fm_lib, in shared memory and on a socket
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "rtl_fm_metrics.h"
+
+static struct metrics metrics_local;
+struct metrics *metrics = &metrics_local;
+int metrics_shared = 0;
+
+static char metrics_shm[METRICS_NAME_MAX + 2];
+static struct sockaddr_un metrics_addr;
+static int metrics_fd = -1;
+static pthread_t metrics_thread;
+
+#define COUNTER(f)	{#f, offsetof(struct metrics, f), 0}
+#define GAUGE(f)	{#f, offsetof(struct metrics, f), 1}
+
+static const struct metrics_field
+{
+	const char *name;
+	size_t   offset;
+	int      gauge;
+} metrics_fields[] = {
+	COUNTER(dongle_blocks),
+	COUNTER(dongle_samples),
+	COUNTER(dongle_waits),
+	COUNTER(demod_blocks),
+	COUNTER(demod_dsp_ns),
+	COUNTER(demod_squelched),
+	GAUGE(dsp_ns),
+	GAUGE(rssi_cdb),
+	GAUGE(squelched),
+	COUNTER(output_blocks),
+	COUNTER(output_drops),
+	GAUGE(xruns),
+	COUNTER(tunes),
+	GAUGE(freq_hz),
+};
+
+#define METRICS_FIELDS	(int)(sizeof(metrics_fields) / sizeof(metrics_fields[0]))
+
+int metrics_format(char *buf, int size)
+/* each field read on its own, a snapshot of a moving pipeline anyway */
+{
+	const struct metrics_field *f;
+	const char *base = (const char*)metrics;
+	int64_t v;
+	int i, n = 0;
+	n += snprintf(buf + n, size - n, "pid %lld\n", (long long)metrics->pid);
+	for (i = 0; i < METRICS_FIELDS && n < size; i++) {
+		f = &metrics_fields[i];
+		v = __atomic_load_n((const int64_t*)(base + f->offset), __ATOMIC_RELAXED);
+		if (f->gauge) {
+			n += snprintf(buf + n, size - n, "%s %lld\n", f->name, (long long)v);
+		} else {
+			n += snprintf(buf + n, size - n, "%s %llu\n", f->name, (unsigned long long)v);
+		}
+	}
+	return n < size ? n : size - 1;
+}
+
+static void *metrics_thread_fn(void *arg)
+/* one snapshot per connection, then closed, a scraper reconnects */
+{
+	char buf[2048];
+	int c, n;
+	(void)arg;
+	for (;;) {
+		c = accept(metrics_fd, NULL, NULL);
+		if (c < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;}
+			break;
+		}
+		n = metrics_format(buf, sizeof(buf));
+		if (send(c, buf, n, MSG_NOSIGNAL) < 0) {}
+		close(c);
+	}
+	return 0;
+}
+
+int metrics_open(const char *name)
+{
+	struct metrics *m;
+	int fd;
+	if (strlen(name) > METRICS_NAME_MAX || strchr(name, '/')) {
+		fprintf(stderr, "metrics: bad name %s\n", name);
+		return -1;
+	}
+	snprintf(metrics_shm, sizeof(metrics_shm), "/%s", name);
+	fd = shm_open(metrics_shm, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, sizeof(struct metrics)) < 0) {
+		fprintf(stderr, "metrics: /dev/shm%s: %s\n", metrics_shm, strerror(errno));
+		if (fd >= 0) {
+			close(fd);}
+		return -1;
+	}
+	m = (struct metrics*)mmap(NULL, sizeof(struct metrics), PROT_READ | PROT_WRITE,
+		MAP_SHARED, fd, 0);
+	close(fd);
+	if (m == MAP_FAILED) {
+		fprintf(stderr, "metrics: mmap: %s\n", strerror(errno));
+		return -1;
+	}
+	/* before the stage threads start, nothing counted yet is lost */
+	memcpy(m, &metrics_local, sizeof(struct metrics));
+	m->magic = METRICS_MAGIC;
+	m->size = sizeof(struct metrics);
+	m->pid = getpid();
+	metrics = m;
+	metrics_shared = 1;
+
+	memset(&metrics_addr, 0, sizeof(metrics_addr));
+	metrics_addr.sun_family = AF_UNIX;
+	snprintf(metrics_addr.sun_path, sizeof(metrics_addr.sun_path), "%s/%s.sock",
+		METRICS_SOCK_DIR, name);
+	unlink(metrics_addr.sun_path);
+	metrics_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (metrics_fd < 0
+		|| bind(metrics_fd, (struct sockaddr*)&metrics_addr, sizeof(metrics_addr)) < 0
+		|| listen(metrics_fd, 4) < 0) {
+		fprintf(stderr, "metrics: %s: %s\n", metrics_addr.sun_path, strerror(errno));
+		if (metrics_fd >= 0) {
+			close(metrics_fd);}
+		metrics_fd = -1;
+		return -1;
+	}
+	pthread_create(&metrics_thread, NULL, metrics_thread_fn, NULL);
+	fprintf(stderr, "metrics: /dev/shm%s, snapshot on %s\n", metrics_shm, metrics_addr.sun_path);
+	return 0;
+}
+
+void metrics_close(void)
+{
+	if (metrics_fd >= 0) {
+		/* wakes the accept() */
+		shutdown(metrics_fd, SHUT_RDWR);
+		pthread_join(metrics_thread, NULL);
+		close(metrics_fd);
+		unlink(metrics_addr.sun_path);
+		metrics_fd = -1;
+	}
+	if (metrics_shared) {
+		/* after the joins, nothing adds to the segment any more */
+		memcpy(&metrics_local, metrics, sizeof(struct metrics));
+		munmap(metrics, sizeof(struct metrics));
+		metrics = &metrics_local;
+		shm_unlink(metrics_shm);
+		metrics_shared = 0;
+	}
+}
+
+int64_t metrics_rssi(const int16_t *iq, int len, int step)
+/* the converted samples are +-128, a full scale tone is 0 dBFS */
+{
+	int64_t sum = 0;
+	int i, n = 0;
+	for (i = 0; i + 1 < len; i += 2 * step, n++) {
+		sum += iq[i] * iq[i] + iq[i+1] * iq[i+1];}
+	if (!n || !sum) {
+		return -10000;}
+	return (int64_t)(1000.0 * log10((double)sum / n / (128.0 * 128.0)));
+}
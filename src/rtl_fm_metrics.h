@@ -0,0 +1,111 @@
+/*
+ * Counters and gauges for rtl_fm_lib, in shared memory and on a socket
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The stage threads update one struct metrics with relaxed atomics,
+ * METRIC_ADD() and METRIC_SET(), a single add or store on the cache
+ * line each field is on, no lock, no syscall.  Without -S it is a
+ * static struct nobody reads.  With -S name it is mapped from
+ * /dev/shm/name, so a tool can mmap it read-only and poll it, and a
+ * thread of its own serves a text snapshot, one "name value" line per
+ * field, to each connection on /tmp/name.sock:
+ *
+ *   socat - UNIX-CONNECT:/tmp/rtl_fm.sock
+ *
+ * The fields only ever get added at the end, magic and size tell a
+ * reader which ones it has.
+ */
+
+#ifndef __RTL_FM_METRICS_H
+#define __RTL_FM_METRICS_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define METRICS_MAGIC		0x6d667472  /* "rtfm" */
+#define METRICS_SOCK_DIR	"/tmp"
+#define METRICS_NAME_MAX	64
+#define METRICS_ALIGN		64
+
+struct metrics
+{
+	uint32_t magic;
+	uint32_t size;              /* sizeof(struct metrics) */
+	int64_t  pid;
+	/* each thread's fields on a cache line of their own */
+	/* dongle */
+	uint64_t dongle_blocks __attribute__((aligned(METRICS_ALIGN)));
+	uint64_t dongle_samples;    /* iq pairs */
+	uint64_t dongle_waits;      /* transfers that waited for a free block */
+	/* demod */
+	uint64_t demod_blocks __attribute__((aligned(METRICS_ALIGN)));
+	uint64_t demod_dsp_ns;      /* total, over demod_blocks */
+	uint64_t demod_squelched;   /* blocks demodulated while muted */
+	int64_t  dsp_ns;            /* gauge, the last block */
+	int64_t  rssi_cdb;          /* gauge, dBFS x 100 of the last block in */
+	int64_t  squelched;         /* gauge */
+	/* output */
+	uint64_t output_blocks __attribute__((aligned(METRICS_ALIGN)));
+	uint64_t output_drops;      /* blocks not (all) written */
+	int64_t  xruns;             /* gauge, -D, the sink's count */
+	/* controller and main */
+	uint64_t tunes __attribute__((aligned(METRICS_ALIGN)));
+	int64_t  freq_hz;           /* gauge */
+};
+
+extern struct metrics *metrics;
+
+#define METRIC_ADD(field, n)	__atomic_fetch_add(&metrics->field, (n), __ATOMIC_RELAXED)
+#define METRIC_SET(field, v)	__atomic_store_n(&metrics->field, (v), __ATOMIC_RELAXED)
+
+/* the gauges that take work to compute are only kept with -S */
+extern int metrics_shared;
+
+/*!
+ * Move the metrics into shared memory and start serving snapshots
+ *
+ * \param name of the segment in /dev/shm and of the socket in /tmp
+ * \return 0, -1 if either could not be set up
+ */
+
+extern int metrics_open(const char *name);
+
+/*!
+ * Stop the socket thread and remove the socket and the segment
+ */
+
+extern void metrics_close(void);
+
+/*!
+ * Write the snapshot text
+ *
+ * \param buf at least 2 KB
+ * \return chars written
+ */
+
+extern int metrics_format(char *buf, int size);
+
+/*!
+ * Signal power of a block of interleaved iq as converted from the dongle
+ *
+ * \param step look at every step-th pair
+ * \return dBFS x 100
+ */
+
+extern int64_t metrics_rssi(const int16_t *iq, int len, int step);
+
+#endif /* #ifndef __RTL_FM_METRICS_H */
@@ -0,0 +1,166 @@
+/*
+ * Hardware counters around each stage of full_demod()
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+
+#include "rtl_fm_stamp.h"
+#include "rtl_fm_perf.h"
+
+static const char *perf_counter_names[PERF_COUNTERS] = {
+	"cycles", "instructions", "cache-misses", "branch-misses"};
+
+static const uint64_t perf_configs[PERF_COUNTERS] = {
+	PERF_COUNT_HW_CPU_CYCLES,
+	PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES,
+	PERF_COUNT_HW_BRANCH_MISSES};
+
+static const char *perf_stage_names[PERF_STAGES] = {
+	"decimate", "demod", "decim+demod", "whole chain", "rds", "post fir", "squelch", "audio"};
+
+static int perf_event_open(struct perf_event_attr *attr, int group)
+{
+	return (int)syscall(SYS_perf_event_open, attr, 0, -1, group, 0);
+}
+
+struct perf_counters *perf_open(void)
+{
+	struct perf_counters *p;
+	struct perf_event_attr attr;
+	int i;
+	p = (struct perf_counters*)calloc(1, sizeof(struct perf_counters));
+	if (!p) {
+		return NULL;}
+	p->leader = -1;
+	for (i = 0; i < PERF_COUNTERS; i++) {
+		p->slot[i] = -1;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = perf_configs[i];
+		attr.disabled = p->leader < 0;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+			| PERF_FORMAT_TOTAL_TIME_RUNNING;
+		p->fd[i] = perf_event_open(&attr, p->leader);
+		if (p->fd[i] < 0) {
+			fprintf(stderr, "perf: %s: %s\n", perf_counter_names[i], strerror(errno));
+			continue;
+		}
+		/* the first one that opens leads the group */
+		if (p->leader < 0) {
+			p->leader = p->fd[i];}
+		p->slot[i] = p->n++;
+	}
+	if (p->leader < 0) {
+		fprintf(stderr, "perf: no counters (kernel.perf_event_paranoid, or no PMU), "
+			"stage times only\n");
+		return p;
+	}
+	ioctl(p->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(p->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return p;
+}
+
+static void perf_read(struct perf_counters *p, uint64_t *now)
+/* nr, time_enabled, time_running, then each counter, scaled if the
+   kernel only let the group run part of the time */
+{
+	uint64_t buf[3 + PERF_COUNTERS];
+	double scale = 1.0;
+	int i;
+	if (p->leader < 0 || read(p->leader, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t))) {
+		memset(now, 0, PERF_COUNTERS * sizeof(uint64_t));
+		return;
+	}
+	if (buf[2] && buf[2] < buf[1]) {
+		scale = (double)buf[1] / buf[2];}
+	for (i = 0; i < PERF_COUNTERS; i++) {
+		now[i] = p->slot[i] < 0 ? 0 : (uint64_t)(buf[3 + p->slot[i]] * scale);}
+}
+
+void perf_start(struct perf_counters *p)
+{
+	perf_read(p, p->last);
+	p->last_ns = stamp_now_ns();
+}
+
+void perf_mark(struct perf_counters *p, enum perf_stage s, int samples)
+{
+	struct perf_stage_count *c = &p->stage[s];
+	uint64_t now[PERF_COUNTERS];
+	uint64_t ns;
+	int i;
+	perf_read(p, now);
+	ns = stamp_now_ns();
+	c->calls++;
+	c->samples += samples;
+	c->ns += ns - p->last_ns;
+	for (i = 0; i < PERF_COUNTERS; i++) {
+		if (now[i] > p->last[i]) {
+			c->count[i] += now[i] - p->last[i];}
+		p->last[i] = now[i];
+	}
+	p->last_ns = ns;
+}
+
+void perf_close(struct perf_counters *p)
+{
+	struct perf_stage_count *c;
+	char cyc[16], ipc[16], cm[16], bm[16];
+	double n;
+	int i;
+	if (!p) {
+		return;}
+	fprintf(stderr, "%-12s %8s %9s %7s %6s %12s %13s\n", "stage", "calls", "ns/sample",
+		"cyc/smp", "IPC", "cache-miss/k", "branch-miss/k");
+	for (i = 0; i < PERF_STAGES; i++) {
+		c = &p->stage[i];
+		if (!c->calls) {
+			continue;}
+		n = c->samples ? (double)c->samples : 1.0;
+		snprintf(cyc, sizeof(cyc), "n/a");
+		snprintf(ipc, sizeof(ipc), "n/a");
+		snprintf(cm, sizeof(cm), "n/a");
+		snprintf(bm, sizeof(bm), "n/a");
+		if (p->slot[PERF_CYCLES] >= 0) {
+			snprintf(cyc, sizeof(cyc), "%.1f", c->count[PERF_CYCLES] / n);}
+		if (p->slot[PERF_CYCLES] >= 0 && p->slot[PERF_INSTRUCTIONS] >= 0 && c->count[PERF_CYCLES]) {
+			snprintf(ipc, sizeof(ipc), "%.2f",
+				(double)c->count[PERF_INSTRUCTIONS] / c->count[PERF_CYCLES]);}
+		/* per thousand samples, a miss per sample would be 1000 */
+		if (p->slot[PERF_CACHE_MISSES] >= 0) {
+			snprintf(cm, sizeof(cm), "%.2f", 1000.0 * c->count[PERF_CACHE_MISSES] / n);}
+		if (p->slot[PERF_BRANCH_MISSES] >= 0) {
+			snprintf(bm, sizeof(bm), "%.2f", 1000.0 * c->count[PERF_BRANCH_MISSES] / n);}
+		fprintf(stderr, "%-12s %8llu %9.2f %7s %6s %12s %13s\n", perf_stage_names[i],
+			(unsigned long long)c->calls, c->ns / n, cyc, ipc, cm, bm);
+	}
+	for (i = 0; i < PERF_COUNTERS; i++) {
+		if (p->fd[i] >= 0) {
+			close(p->fd[i]);}
+	}
+	free(p);
+}
@@ -0,0 +1,109 @@
+/*
+ * Hardware counters around each stage of full_demod()
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * -E perf, cycles, instructions, cache misses and branch misses of the
+ * demod thread, read as one group (one read() per stage boundary) and
+ * charged to the stage that just ran.  At exit each stage gets its IPC
+ * and misses per sample in: a low IPC with many cache misses per sample
+ * is waiting on memory, a high IPC is bound by the arithmetic.
+ *
+ * Whatever the kernel refuses is left out: without a PMU, or with
+ * perf_event_paranoid above 2, the stages still get their time.  The
+ * counts are user space only (paranoid 2 allows that much), and scaled
+ * up when the kernel had to multiplex the counters.  The -E parallel
+ * pool threads are not counted, only the demod thread's part.
+ */
+
+#ifndef __RTL_FM_PERF_H
+#define __RTL_FM_PERF_H
+
+#include <stdint.h>
+
+enum perf_counter
+{
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_COUNTERS
+};
+
+enum perf_stage
+{
+	PERF_DECIMATE,          /* halfband_decimate() or low_pass() */
+	PERF_DEMOD,             /* d->mode_demod */
+	PERF_DECIM_DEMOD,       /* -E parallel, both of the above */
+	PERF_CHAIN,             /* -E fused/float, all of it at once */
+	PERF_RDS,
+	PERF_POST_FIR,
+	PERF_SQUELCH,
+	PERF_AUDIO,             /* stereo or mono, de-emphasis and resampling */
+	PERF_STAGES
+};
+
+struct perf_stage_count
+{
+	uint64_t calls;
+	uint64_t samples;       /* into the stage */
+	uint64_t ns;
+	uint64_t count[PERF_COUNTERS];
+};
+
+struct perf_counters
+{
+	int      fd[PERF_COUNTERS];     /* -1 where the kernel refused */
+	int      leader;
+	int      n;                     /* open, in the group's read order */
+	int      slot[PERF_COUNTERS];   /* position in the read, -1 if not open */
+	uint64_t last[PERF_COUNTERS];
+	uint64_t last_ns;
+	struct perf_stage_count stage[PERF_STAGES];
+};
+
+/*!
+ * Open the counters for the calling thread
+ *
+ * \return counters, even with none open, NULL if out of memory
+ */
+
+extern struct perf_counters *perf_open(void);
+
+/*!
+ * Take the counts as a block starts
+ */
+
+extern void perf_start(struct perf_counters *p);
+
+/*!
+ * Charge what was counted since the last call to a stage
+ *
+ * \param samples into the stage, for the per-sample figures
+ */
+
+extern void perf_mark(struct perf_counters *p, enum perf_stage s, int samples);
+
+/* without -E perf a test of a pointer already in a register */
+#define PERF_MARK(p, s, samples)	do { if (__builtin_expect((p) != NULL, 0)) perf_mark(p, s, samples); } while (0)
+
+/*!
+ * Print each stage and close the counters
+ */
+
+extern void perf_close(struct perf_counters *p);
+
+#endif /* #ifndef __RTL_FM_PERF_H */
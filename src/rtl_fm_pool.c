@@ -0,0 +1,259 @@
+/*
+ * Block-parallel decimation and demodulation for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rtl_fm_pool.h"
+
+static int cascade_overlap(const struct halfband_cascade *hb)
+/* complex samples in front of a chunk that leave every stage's history
+   as the serial cascade has it.  A stage keeps its last 2*(2k+1) inputs,
+   so it needs that many right outputs from the stage before, each of
+   which needs a window of right inputs there. */
+{
+	int s, need = 0;
+	for (s = hb->stages - 1; s >= 0; s--) {
+		need = 2 * need + 2 * (2 * hb->stage[s].k + 1) + 2;}
+	/* whole outputs of the cascade */
+	return (need + (1 << hb->stages) - 1) & ~((1 << hb->stages) - 1);
+}
+
+static void chunk_decimate(struct pool_chunk *c)
+{
+	struct demod_pool *p = c->pool;
+	struct demod_state *d = p->d;
+	struct demod_state *w = c->w;
+	if (!c->len) {
+		return;}
+	if (d->downsample_passes) {
+		/* only the histories this leaves behind are wanted */
+		halfband_decimate(&w->hb, c->overlap, 2 * p->overlap);
+		c->len = halfband_decimate(&w->hb, c->lp, c->len);
+	} else {
+		c->len = low_pass(w, c->lp, c->len);
+	}
+}
+
+static void chunk_demod(struct pool_chunk *c)
+/* every chunk is decimated by now, the ones before place this one */
+{
+	struct demod_pool *p = c->pool;
+	struct demod_state *d = p->d;
+	struct demod_state *w = c->w;
+	struct pool_chunk *b;
+	int j, out = 0;
+	if (!c->len) {
+		return;}
+	w->pre_r = d->pre_r;
+	w->pre_j = d->pre_j;
+	for (j = 0; j < c->index; j++) {
+		b = &p->chunk[j];
+		if (!b->len) {
+			continue;}
+		w->pre_r = b->lp[b->len - 2];
+		w->pre_j = b->lp[b->len - 1];
+		out += d->mode_demod == &raw_demod ? b->len : b->len / 2;
+	}
+	w->lowpassed = c->lp;
+	w->lp_len = c->len;
+	w->result = d->result + out;
+	d->mode_demod(w);
+}
+
+static void *pool_thread_fn(void *arg)
+{
+	struct pool_chunk *c = (struct pool_chunk*)arg;
+	struct demod_pool *p = c->pool;
+	if (p->verbose) {
+		fprintf(stderr, "demod worker TID: %d\n", (int)gettid());}
+	rt_enter(RT_WORKER);
+	trace_thread("demod worker");
+	prof_thread("demod worker");
+
+	for (;;) {
+		pthread_barrier_wait(&p->step);
+		if (p->closed) {
+			break;}
+		TRACE_BEGIN("decimate");
+		PROF_STAGE("decimate");
+		chunk_decimate(c);
+		PROF_STAGE(NULL);
+		TRACE_END("decimate");
+		pthread_barrier_wait(&p->step);
+		TRACE_BEGIN("demodulate");
+		PROF_STAGE("demodulate");
+		chunk_demod(c);
+		PROF_STAGE(NULL);
+		TRACE_END("demodulate");
+		pthread_barrier_wait(&p->step);
+	}
+	return 0;
+}
+
+static void pool_release(struct demod_pool *p)
+{
+	int k;
+	for (k = 0; k < POOL_MAX_WORKERS; k++) {
+		free(p->chunk[k].w);
+		free(p->chunk[k].overlap);
+	}
+	free(p->tail);
+	free(p);
+}
+
+struct demod_pool *pool_create(int workers, int verbose)
+{
+	struct demod_pool *p;
+	struct pool_chunk *c;
+	int k;
+	if (workers > POOL_MAX_WORKERS) {
+		workers = POOL_MAX_WORKERS;}
+	if (workers < 1) {
+		workers = 1;}
+	p = (struct demod_pool*)calloc(1, sizeof(struct demod_pool));
+	if (!p) {
+		return NULL;}
+	p->workers = workers;
+	p->verbose = verbose;
+	p->tail = (int16_t*)calloc(2 * POOL_MAX_OVERLAP, sizeof(int16_t));
+	if (!p->tail) {
+		pool_release(p);
+		return NULL;
+	}
+	for (k = 0; k < workers; k++) {
+		c = &p->chunk[k];
+		c->pool = p;
+		c->index = k;
+		c->w = (struct demod_state*)calloc(1, sizeof(struct demod_state));
+		c->overlap = (int16_t*)malloc(2 * POOL_MAX_OVERLAP * sizeof(int16_t));
+		if (!c->w || !c->overlap) {
+			pool_release(p);
+			return NULL;
+		}
+	}
+	pthread_barrier_init(&p->step, NULL, workers);
+	for (k = 1; k < workers; k++) {
+		pthread_create(&p->chunk[k].thread, NULL, pool_thread_fn, &p->chunk[k]);}
+	return p;
+}
+
+void pool_free(struct demod_pool *p)
+{
+	int k;
+	p->closed = 1;
+	pthread_barrier_wait(&p->step);
+	for (k = 1; k < p->workers; k++) {
+		pthread_join(p->chunk[k].thread, NULL);}
+	pthread_barrier_destroy(&p->step);
+	pool_release(p);
+}
+
+static void pool_rebuild(struct demod_pool *p, struct demod_state *d)
+/* the cascade was (re)designed, its histories start from silence again */
+{
+	int k;
+	for (k = 0; k < p->workers; k++) {
+		memcpy(&p->chunk[k].w->hb, &d->hb, sizeof(struct halfband_cascade));}
+	p->overlap = cascade_overlap(&d->hb);
+	memset(p->tail, 0, 2 * POOL_MAX_OVERLAP * sizeof(int16_t));
+}
+
+void pool_demod(struct demod_pool *p, struct demod_state *d)
+{
+	struct pool_chunk *c;
+	struct demod_state *w;
+	int n = d->lp_len / 2;
+	int start[POOL_MAX_WORKERS + 1];
+	int unit, off = 0, min, k, b;
+
+	p->d = d;
+	if (d->downsample_passes) {
+		w = p->chunk[0].w;
+		if (w->hb.stages != d->hb.stages || w->hb.last_taps != d->hb.last_taps) {
+			pool_rebuild(p, d);}
+		unit = 1 << d->hb.stages;
+	} else {
+		p->overlap = 0;
+		unit = d->downsample;
+		off = (d->downsample - d->prev_index) % d->downsample;
+	}
+	if (p->overlap > POOL_MAX_OVERLAP) {
+		/* a long cascade, the overlap would cost more than it saves */
+		d->lp_len = halfband_decimate(&d->hb, d->lowpassed, d->lp_len);
+		d->mode_demod(d);
+		return;
+	}
+
+	/* cut where the decimator has nothing pending */
+	min = p->overlap + 2 * unit;
+	p->chunks = p->workers;
+	while (p->chunks > 1 && n / p->chunks < min) {
+		p->chunks--;}
+	start[0] = 0;
+	for (k = 1; k < p->chunks; k++) {
+		b = (int)((long long)k * n / p->chunks);
+		start[k] = off + (b - off + unit - 1) / unit * unit;
+	}
+	start[p->chunks] = n;
+
+	for (k = 0; k < p->workers; k++) {
+		c = &p->chunk[k];
+		c->len = 0;
+		if (k >= p->chunks) {
+			continue;}
+		c->lp = d->lowpassed + 2 * start[k];
+		c->len = 2 * (start[k+1] - start[k]);
+		w = c->w;
+		w->downsample = d->downsample;
+		w->output_scale = d->output_scale;
+		w->fm_disc = d->fm_disc;
+		w->now_r = k ? 0 : d->now_r;
+		w->now_j = k ? 0 : d->now_j;
+		w->prev_index = k ? 0 : d->prev_index;
+		/* copied now, the chunk before decimates over it */
+		if (p->overlap) {
+			memcpy(c->overlap, k ? c->lp - 2 * p->overlap : p->tail,
+				2 * p->overlap * sizeof(int16_t));}
+	}
+	if (p->overlap && n >= p->overlap) {
+		memcpy(p->tail, d->lowpassed + 2 * (n - p->overlap), 2 * p->overlap * sizeof(int16_t));
+	} else if (p->overlap) {
+		memmove(p->tail, p->tail + 2 * n, 2 * (p->overlap - n) * sizeof(int16_t));
+		memcpy(p->tail + 2 * (p->overlap - n), d->lowpassed, 2 * n * sizeof(int16_t));
+	}
+
+	pthread_barrier_wait(&p->step);
+	chunk_decimate(&p->chunk[0]);
+	pthread_barrier_wait(&p->step);
+	chunk_demod(&p->chunk[0]);
+	pthread_barrier_wait(&p->step);
+
+	/* stitch, the chunks' results already sit in order in result[] */
+	d->lp_len = 0;
+	d->result_len = 0;
+	for (k = 0; k < p->chunks; k++) {
+		c = &p->chunk[k];
+		if (!c->len) {
+			continue;}
+		d->lp_len += c->len;
+		d->result_len += c->w->result_len;
+		d->pre_r = c->lp[c->len - 2];
+		d->pre_j = c->lp[c->len - 1];
+	}
+	w = p->chunk[p->chunks - 1].w;
+	d->now_r = w->now_r;
+	d->now_j = w->now_j;
+	d->prev_index = w->prev_index;
+}
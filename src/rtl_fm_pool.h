@@ -0,0 +1,99 @@
+/*
+ * Block-parallel decimation and demodulation for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The block from the dongle is cut into one chunk per worker, the demod
+ * thread runs the first and the pool threads the rest, in two steps:
+ *
+ *   decimate  each chunk in place.  The half-band cascade only remembers
+ *             the last few samples of each stage, so a worker runs its
+ *             own copy of the cascade over the samples just in front of
+ *             its chunk first (the overlap) and drops what that makes,
+ *             after which its history is exactly what the serial cascade
+ *             would have had.  The boxcar only remembers a part sum, the
+ *             chunks are cut where it is empty.
+ *   demodulate  each chunk into its place in result[], the fm
+ *             discriminator starting from the last sample of the chunk
+ *             before (pre_r/pre_j).
+ *
+ * The overlap of the first chunk is the end of the block before, kept
+ * here.  Everything after the demodulator feeds back on itself per
+ * sample (de-emphasis, pll, resampler phase) and stays serial in
+ * full_demod().  The output is bit-identical to the serial path.
+ */
+
+#ifndef __RTL_FM_POOL_H
+#define __RTL_FM_POOL_H
+
+#include "rtl_fm_lib.h"
+
+#define POOL_MAX_WORKERS	8
+/* complex samples of overlap at most, 64 KB per worker */
+#define POOL_MAX_OVERLAP	16384
+
+struct demod_pool;
+
+struct pool_chunk
+{
+	struct demod_pool *pool;
+	int      index;
+	pthread_t thread;
+	struct demod_state *w;  /* the stages' state for this chunk */
+	int16_t  *lp;           /* the chunk in d->lowpassed */
+	int      len;           /* int16 in, then int16 decimated */
+	int16_t  *overlap;      /* POOL_MAX_OVERLAP complex */
+};
+
+struct demod_pool
+{
+	int      workers;
+	int      chunks;        /* used for this block, up to workers */
+	int      overlap;       /* complex samples, 0 for the boxcar */
+	int16_t  *tail;         /* the end of the last block */
+	struct demod_state *d;
+	pthread_barrier_t step;
+	int      closed;
+	int      verbose;
+	struct pool_chunk chunk[POOL_MAX_WORKERS];
+};
+
+/*!
+ * Start the pool threads
+ *
+ * \param workers threads including the caller, up to POOL_MAX_WORKERS
+ * \param verbose the threads print their TID, as the others do
+ * \return pool, NULL if out of memory
+ */
+
+extern struct demod_pool *pool_create(int workers, int verbose);
+
+/*!
+ * Stop the threads and free the pool
+ */
+
+extern void pool_free(struct demod_pool *p);
+
+/*!
+ * Decimate d->lowpassed and demodulate it into d->result, what
+ * full_demod() does up to and including d->mode_demod
+ *
+ * \param d demod state, the stages built by stages_init()
+ */
+
+extern void pool_demod(struct demod_pool *p, struct demod_state *d);
+
+#endif /* #ifndef __RTL_FM_POOL_H */
@@ -0,0 +1,408 @@
+/*
+ * Sampling profiler of the pipeline threads, started by SIGUSR1
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <ucontext.h>
+#include <cxxabi.h>
+#include <sys/syscall.h>
+
+#include "rtl_fm_prof.h"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* distinct pcs named per profile */
+#define PROF_SYMS		16384
+
+struct prof_sample
+{
+	const char *stage;
+	int      depth;
+	void     *pc[PROF_DEPTH];   /* the interrupted pc, then return addresses */
+};
+
+struct prof_thread_state
+{
+	pthread_t thread;
+	int      tid;
+	char     name[16];
+	timer_t  timer;
+	struct prof_sample *samples;    /* only while a profile runs */
+	uint32_t n, max, lost;
+};
+
+struct prof_sym
+{
+	void     *pc;
+	char     *name;
+};
+
+__thread const char *prof_stage;
+
+static __thread struct prof_thread_state *prof_tls;
+static struct prof_thread_state *prof_threads[PROF_MAX_THREADS];
+static int prof_nthreads;
+static int prof_on;
+static int prof_seconds;
+static int prof_closing;
+static int prof_runs;
+static pthread_t prof_sampler;
+static sigset_t prof_set;
+static struct prof_sym *prof_syms;
+
+static void *prof_pc(void *uc)
+{
+	ucontext_t *u = (ucontext_t*)uc;
+#if defined(__x86_64__)
+	return (void*)u->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+	return (void*)u->uc_mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+	return (void*)u->uc_mcontext.pc;
+#elif defined(__arm__)
+	return (void*)u->uc_mcontext.arm_pc;
+#else
+	return NULL;
+#endif
+}
+
+static void prof_handler(int sig, siginfo_t *si, void *uc)
+/* in the thread the timer interrupted.  prof_open() called backtrace()
+   once, so libgcc is loaded already and it does not allocate here.
+   Where it cannot unwind through the signal frame only the pc is kept. */
+{
+	struct prof_thread_state *t = prof_tls;
+	struct prof_sample *s, *samples;
+	void *frames[PROF_DEPTH + 4];
+	void *pc = prof_pc(uc);
+	int saved = errno, n, i, from = -1;
+	(void)sig;
+	(void)si;
+	if (!t || !(samples = __atomic_load_n(&t->samples, __ATOMIC_ACQUIRE))) {
+		return;}
+	if (t->n >= t->max) {
+		t->lost++;
+		return;
+	}
+	s = &samples[t->n];
+	s->stage = prof_stage;
+	/* this handler, the signal trampoline, then the interrupted pc */
+	n = backtrace(frames, PROF_DEPTH + 4);
+	for (i = 0; i < n && i < 4; i++) {
+		if (frames[i] == pc) {
+			from = i;
+			break;
+		}
+	}
+	if (from < 0) {
+		s->pc[0] = pc;
+		s->depth = 1;
+	} else {
+		s->depth = n - from < PROF_DEPTH ? n - from : PROF_DEPTH;
+		memcpy(s->pc, frames + from, s->depth * sizeof(void*));
+	}
+	t->n++;
+	errno = saved;
+}
+
+static void prof_short_name(char *name)
+/* "ns::f(int, char*) const" to "ns::f", templates keep their <> */
+{
+	int len = strlen(name), depth = 0;
+	if (len > 6 && !strcmp(name + len - 6, " const")) {
+		len -= 6;
+		name[len] = 0;
+	}
+	if (!len || name[len - 1] != ')') {
+		return;}
+	while (len-- > 0) {
+		if (name[len] == ')') {
+			depth++;}
+		if (name[len] == '(' && !--depth) {
+			break;}
+	}
+	if (len > 0) {
+		name[len] = 0;}
+}
+
+static const char *prof_name(void *pc, int ret)
+/* a return address is looked up a byte back, in the call it returns
+   from rather than whatever follows it */
+{
+	char buf[256], *dem;
+	const char *base;
+	unsigned int h = (unsigned int)(((uintptr_t)pc >> 2) * 2654435761u) % PROF_SYMS;
+	void *look = ret ? (char*)pc - 1 : pc;
+	int i, status;
+	Dl_info info;
+	for (i = 0; i < PROF_SYMS; i++, h = (h + 1) % PROF_SYMS) {
+		if (prof_syms[h].pc == pc) {
+			return prof_syms[h].name;}
+		if (!prof_syms[h].pc) {
+			break;}
+	}
+	if (i == PROF_SYMS) {
+		return "?";}
+	if (dladdr(look, &info) && info.dli_sname) {
+		dem = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+		snprintf(buf, sizeof(buf), "%s", dem && !status ? dem : info.dli_sname);
+		free(dem);
+		prof_short_name(buf);
+	} else if (info.dli_fname) {
+		/* not exported, one box per library rather than one per pc */
+		base = strrchr(info.dli_fname, '/');
+		snprintf(buf, sizeof(buf), "[%s]", base ? base + 1 : info.dli_fname);
+	} else {
+		snprintf(buf, sizeof(buf), "[unknown]");
+	}
+	prof_syms[h].pc = pc;
+	prof_syms[h].name = strdup(buf);
+	return prof_syms[h].name ? prof_syms[h].name : "?";
+}
+
+static int prof_cmp_str(const void *a, const void *b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+struct prof_count
+{
+	const char *name;
+	int      n;
+};
+
+static int prof_cmp_count(const void *a, const void *b)
+{
+	return ((const struct prof_count*)b)->n - ((const struct prof_count*)a)->n;
+}
+
+static void prof_write(struct prof_thread_state **ts, struct prof_sample **samples, int nt)
+/* sort the folded stacks and count the runs, the same for the leaves */
+{
+	char file[256], line[4096];
+	char **lines;
+	const char **leaves;
+	struct prof_count *top;
+	struct prof_thread_state *t;
+	struct prof_sample *s;
+	FILE *f;
+	int total = 0, n = 0, ntop = 0, i, j, k, len, lost = 0;
+	for (i = 0; i < nt; i++) {
+		total += ts[i]->n;
+		lost += ts[i]->lost;
+	}
+	snprintf(file, sizeof(file), "%s/rtl_fm-%i-%i.folded", PROF_DIR, (int)getpid(), prof_runs);
+	prof_syms = (struct prof_sym*)calloc(PROF_SYMS, sizeof(struct prof_sym));
+	lines = (char**)calloc(total + 1, sizeof(char*));
+	leaves = (const char**)calloc(total + 1, sizeof(char*));
+	top = (struct prof_count*)calloc(total + 1, sizeof(struct prof_count));
+	f = fopen(file, "w");
+	if (!prof_syms || !lines || !leaves || !top || !f) {
+		fprintf(stderr, "prof: %s: %s\n", file, strerror(errno));
+		goto done;
+	}
+	for (i = 0; i < nt; i++) {
+		t = ts[i];
+		for (j = 0; j < (int)t->n; j++) {
+			s = &samples[i][j];
+			len = snprintf(line, sizeof(line), "%s;%s", t->name, s->stage ? s->stage : "other");
+			for (k = s->depth - 1; k >= 0 && len < (int)sizeof(line); k--) {
+				len += snprintf(line + len, sizeof(line) - len, ";%s", prof_name(s->pc[k], k > 0));}
+			lines[n] = strdup(line);
+			leaves[n] = prof_name(s->pc[0], 0);
+			if (lines[n]) {
+				n++;}
+		}
+	}
+	qsort(lines, n, sizeof(char*), prof_cmp_str);
+	for (i = 0; i < n; i = j) {
+		for (j = i + 1; j < n && !strcmp(lines[i], lines[j]); j++) {}
+		fprintf(f, "%s %i\n", lines[i], j - i);
+	}
+	/* by name, each pc in a function has its own */
+	qsort(leaves, n, sizeof(char*), prof_cmp_str);
+	for (i = 0; i < n; i = j) {
+		for (j = i + 1; j < n && !strcmp(leaves[i], leaves[j]); j++) {}
+		top[ntop].name = leaves[i];
+		top[ntop++].n = j - i;
+	}
+	qsort(top, ntop, sizeof(struct prof_count), prof_cmp_count);
+	fprintf(stderr, "prof: %i samples%s, %s\n", n, lost ? " (some threads ran out of room)" : "", file);
+	for (i = 0; i < ntop && i < PROF_TOP; i++) {
+		fprintf(stderr, "  %5.1f%%  %s\n", 100.0 * top[i].n / n, top[i].name);}
+done:
+	if (f) {
+		fclose(f);}
+	for (i = 0; lines && i < n; i++) {
+		free(lines[i]);}
+	for (i = 0; prof_syms && i < PROF_SYMS; i++) {
+		free(prof_syms[i].name);}
+	free(prof_syms);
+	prof_syms = NULL;
+	free(lines);
+	free(leaves);
+	free(top);
+}
+
+static void prof_run(void)
+{
+	struct prof_thread_state *ts[PROF_MAX_THREADS], *t;
+	struct prof_sample *samples[PROF_MAX_THREADS];
+	struct sigevent sev;
+	struct itimerspec its;
+	clockid_t clock;
+	uint64_t left;
+	int i, nt = 0, n;
+	n = __atomic_load_n(&prof_nthreads, __ATOMIC_ACQUIRE);
+	if (n > PROF_MAX_THREADS) {
+		n = PROF_MAX_THREADS;}
+	prof_runs++;
+	memset(&its, 0, sizeof(its));
+	its.it_interval.tv_nsec = 1000000000 / PROF_HZ;
+	its.it_value = its.it_interval;
+	for (i = 0; i < n; i++) {
+		t = __atomic_load_n(&prof_threads[i], __ATOMIC_ACQUIRE);
+		if (!t || pthread_getcpuclockid(t->thread, &clock)) {
+			continue;}
+		/* a thread gets no more cpu than the wall clock */
+		samples[nt] = (struct prof_sample*)malloc((prof_seconds + 1) * PROF_HZ * sizeof(struct prof_sample));
+		if (!samples[nt]) {
+			continue;}
+		memset(&sev, 0, sizeof(sev));
+		sev.sigev_notify = SIGEV_THREAD_ID;
+		sev.sigev_signo = SIGPROF;
+		sev.sigev_notify_thread_id = t->tid;
+		if (timer_create(clock, &sev, &t->timer) < 0) {
+			fprintf(stderr, "prof: %s: %s\n", t->name, strerror(errno));
+			free(samples[nt]);
+			continue;
+		}
+		t->n = t->lost = 0;
+		t->max = (prof_seconds + 1) * PROF_HZ;
+		__atomic_store_n(&t->samples, samples[nt], __ATOMIC_RELEASE);
+		timer_settime(t->timer, 0, &its, NULL);
+		ts[nt++] = t;
+	}
+	fprintf(stderr, "prof: %i threads for %i s\n", nt, prof_seconds);
+	/* a tenth at a time, prof_close() does not wait the rest */
+	for (left = prof_seconds * 10; left && !__atomic_load_n(&prof_closing, __ATOMIC_ACQUIRE); left--) {
+		usleep(100000);}
+	for (i = 0; i < nt; i++) {
+		timer_delete(ts[i]->timer);}
+	/* a signal already on its way still finds the samples */
+	usleep(20000);
+	for (i = 0; i < nt; i++) {
+		__atomic_store_n(&ts[i]->samples, (struct prof_sample*)NULL, __ATOMIC_RELEASE);}
+	prof_write(ts, samples, nt);
+	for (i = 0; i < nt; i++) {
+		free(samples[i]);}
+}
+
+static void *prof_fn(void *arg)
+{
+	int sig;
+	(void)arg;
+	while (!sigwait(&prof_set, &sig)) {
+		if (__atomic_load_n(&prof_closing, __ATOMIC_ACQUIRE)) {
+			break;}
+		prof_run();
+	}
+	return 0;
+}
+
+int prof_open(int seconds)
+/* the sampler starts with every signal blocked, as the trace dump
+   thread does, so each of SIGUSR1 and SIGUSR2 has one taker */
+{
+	struct sigaction sa;
+	sigset_t all, old;
+	void *frames[2];
+	int r;
+	if (seconds < 1) {
+		seconds = 1;}
+	if (seconds > PROF_MAX_SECONDS) {
+		seconds = PROF_MAX_SECONDS;}
+	prof_seconds = seconds;
+	backtrace(frames, 2);
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = prof_handler;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGPROF, &sa, NULL) < 0) {
+		fprintf(stderr, "prof: SIGPROF: %s\n", strerror(errno));
+		return -1;
+	}
+	sigemptyset(&prof_set);
+	sigaddset(&prof_set, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &prof_set, NULL);
+	prof_on = 1;
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	r = pthread_create(&prof_sampler, NULL, prof_fn, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (r) {
+		fprintf(stderr, "prof: no sampler thread\n");
+		prof_on = 0;
+		return -1;
+	}
+	fprintf(stderr, "prof: kill -USR1 %i for %i s of samples\n", (int)getpid(), seconds);
+	return 0;
+}
+
+void prof_thread(const char *name)
+{
+	struct prof_thread_state *t;
+	int i;
+	if (!prof_on || prof_tls) {
+		return;}
+	t = (struct prof_thread_state*)calloc(1, sizeof(struct prof_thread_state));
+	if (!t) {
+		return;}
+	i = __atomic_fetch_add(&prof_nthreads, 1, __ATOMIC_RELAXED);
+	if (i >= PROF_MAX_THREADS) {
+		fprintf(stderr, "prof: more than %i threads, %s not profiled\n", PROF_MAX_THREADS, name);
+		free(t);
+		return;
+	}
+	t->thread = pthread_self();
+	t->tid = (int)syscall(SYS_gettid);
+	snprintf(t->name, sizeof(t->name), "%s", name);
+	prof_tls = t;
+	__atomic_store_n(&prof_threads[i], t, __ATOMIC_RELEASE);
+}
+
+void prof_close(void)
+/* a profile running is cut short and written */
+{
+	if (!prof_on) {
+		return;}
+	__atomic_store_n(&prof_closing, 1, __ATOMIC_RELEASE);
+	pthread_kill(prof_sampler, SIGUSR1);
+	pthread_join(prof_sampler, NULL);
+	prof_on = 0;
+}
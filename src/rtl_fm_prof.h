@@ -0,0 +1,75 @@
+/*
+ * Sampling profiler of the pipeline threads, started by SIGUSR1
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * -Q seconds, kill -USR1 <pid> then gives each thread that called
+ * prof_thread() a timer on its own cpu clock, PROF_HZ samples a second
+ * of cpu it uses.  Each SIGPROF stores, in the thread it interrupted,
+ * the stage that thread was in (PROF_STAGE()) and the call stack from
+ * the interrupted pc up.  After the seconds the timers go and
+ *
+ *   /tmp/rtl_fm-<pid>-<n>.folded
+ *
+ * is written, one "thread;stage;outer;...;function count" line per
+ * distinct stack, what flamegraph.pl and speedscope read, and the
+ * functions the samples landed in most are printed.  Names come from
+ * dladdr(), the binary is linked -rdynamic for the static ones to have
+ * a name; without, or in a library, they show as [a.out], [libc.so.6].
+ *
+ * Nothing is taken while no profile runs but a store per PROF_STAGE().
+ */
+
+#ifndef __RTL_FM_PROF_H
+#define __RTL_FM_PROF_H
+
+#define PROF_HZ			1000
+#define PROF_DEPTH		24
+#define PROF_MAX_THREADS	32
+#define PROF_MAX_SECONDS	60
+#define PROF_DIR		"/tmp"
+#define PROF_TOP		15
+
+extern __thread const char *prof_stage;
+
+#define PROF_STAGE(name)	(prof_stage = (name))
+
+/*!
+ * Block SIGUSR1 and start the thread that waits for it, before any
+ * thread that is profiled is started
+ *
+ * \param seconds of each profile, up to PROF_MAX_SECONDS
+ * \return 0, -1 if the thread or the SIGPROF handler could not be set up
+ */
+
+extern int prof_open(int seconds);
+
+/*!
+ * Let the calling thread be profiled, nothing without -Q
+ *
+ * \param name first frame of its stacks
+ */
+
+extern void prof_thread(const char *name);
+
+/*!
+ * Stop a profile running and the thread, after the stage threads are
+ * joined
+ */
+
+extern void prof_close(void);
+
+#endif /* #ifndef __RTL_FM_PROF_H */
@@ -0,0 +1,438 @@
+/*
+ * RDS decoder for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * RDS is 1187.5 bit/s differential biphase BPSK on a suppressed 57 kHz
+ * carrier, three times the stereo pilot.
+ *
+ * Only the mix down and a 3rd order cic run at the multiplex rate, a table
+ * lookup, two multiplies and a handful of adds per sample.  After the cic
+ * there are about 16 samples a bit and the rest (costas loop, matched
+ * filter, bit clock, block sync) can afford floats.
+ *
+ * Blocks are 16 bits of data and a 10 bit checkword, the checkword xor'd
+ * with an offset word that says which of the four blocks of a group it is.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "rtl_fm_rds.h"
+#include "rtl_fm_stereo.h"
+
+#define RDS_POLY		0x5B9
+#define BLOCK_BITS		26
+
+/* A, B, C, D and C' */
+static const uint16_t rds_offset[5] = {0x0FC, 0x198, 0x168, 0x1B4, 0x350};
+
+/* syndrome to error pattern, 0 when the syndrome is not a short burst */
+static uint32_t rds_burst[1024];
+static int rds_burst_ready = 0;
+
+static uint16_t rds_syndrome(uint32_t w)
+/* remainder of the 26 bit block mod g(x) */
+{
+	int i;
+	for (i = BLOCK_BITS - 1; i >= 10; i--) {
+		if (w & (1u << i)) {
+			w ^= RDS_POLY << (i - 10);}
+	}
+	return (uint16_t)(w & 0x3FF);
+}
+
+static void rds_burst_table(void)
+{
+	int len, pos;
+	uint32_t pat, inner, e;
+	uint16_t s;
+	if (rds_burst_ready) {
+		return;}
+	for (len = 1; len <= RDS_MAX_BURST; len++) {
+		for (inner = 0; inner < (len > 2 ? 1u << (len - 2) : 1u); inner++) {
+			pat = len == 1 ? 1 : (1u << (len - 1)) | (inner << 1) | 1;
+			for (pos = 0; pos + len <= BLOCK_BITS; pos++) {
+				e = pat << pos;
+				s = rds_syndrome(e);
+				if (!rds_burst[s]) {
+					rds_burst[s] = e;}
+			}
+		}
+	}
+	rds_burst_ready = 1;
+}
+
+static void rds_clear(struct rds_decoder *r)
+/* forget the station, keep the rate dependent setup */
+{
+	memset(r->hist_i, 0, sizeof(r->hist_i));
+	memset(r->hist_q, 0, sizeof(r->hist_q));
+	r->sum_i = r->sum_q = 0.0f;
+	r->carrier_freq = 0.0f;
+	r->bit_phase = 0.0f;
+	r->y[0] = r->y[1] = r->y[2] = 0.0f;
+	r->bits = 0;
+	r->synced = 0;
+	r->last_found = 0;
+	r->bad_run = 0;
+	r->ok = 0;
+	r->fixed = 0;
+	memset(r->ps, ' ', RDS_PS_LEN);
+	r->ps[RDS_PS_LEN] = '\0';
+	r->ps_mask = 0;
+	memset(r->rt, ' ', RDS_RT_LEN);
+	r->rt[RDS_RT_LEN] = '\0';
+	r->rt_ab = -1;
+	memset(&r->info, 0, sizeof(struct rds_info));
+}
+
+static void rds_publish(struct rds_decoder *r)
+/* seqlock writer, only the dsp thread gets here */
+{
+	unsigned int seq = r->seq;
+	__atomic_store_n(&r->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(&r->shared, &r->info, sizeof(struct rds_info));
+	__atomic_store_n(&r->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+int rds_init(struct rds_decoder *r, int rate_in)
+{
+	double low, wn;
+	memset(r, 0, sizeof(struct rds_decoder));
+	r->rate_in = rate_in;
+	r->usable = rate_in >= RDS_MIN_RATE && rate_in <= RDS_MAX_RATE;
+	rds_burst_table();
+	nco_table();
+	rds_clear(r);
+	rds_publish(r);
+	if (!r->usable) {
+		fprintf(stderr, "RDS needs a multiplex rate of %i to %i Hz, disabled.\n",
+			RDS_MIN_RATE, RDS_MAX_RATE);
+		return -1;
+	}
+
+	r->freq = (uint32_t)((double)RDS_CARRIER / rate_in * 4294967296.0);
+	r->decim = (int)round((double)rate_in / RDS_LOW_RATE);
+	/* growth is decim^order, 16^3 on a 15 bit product still fits 32 bits */
+	r->cic_gain = (float)(1.0 / pow(r->decim, RDS_CIC_ORDER));
+	low = (double)rate_in / r->decim;
+	r->half = (int)round(low / RDS_BITRATE / 2.0);
+	r->bit_step = (float)(RDS_BITRATE / low);
+	/* costas loop, 10 Hz, damping 0.707, error is normalised */
+	wn = 2.0 * M_PI * 10.0 / low;
+	r->kp = (float)(2.0 * 0.707 * wn);
+	r->ki = (float)(wn * wn);
+	/* the subcarrier is locked to the pilot, only our sample clock is off */
+	r->freq_lim = (float)(2.0 * M_PI * 20.0 / low);
+	return 0;
+}
+
+void rds_reset(struct rds_decoder *r)
+{
+	__atomic_store_n(&r->reset_req, 1, __ATOMIC_RELEASE);
+}
+
+unsigned int rds_snapshot(struct rds_decoder *r, struct rds_info *out)
+{
+	unsigned int s1, s2;
+	do {
+		s1 = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+		memcpy(out, &r->shared, sizeof(struct rds_info));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		s2 = __atomic_load_n(&r->seq, __ATOMIC_RELAXED);
+	} while ((s1 & 1) || s1 != s2);
+	return s1;
+}
+
+static char rds_char(int c)
+/* the RDS character set matches ascii in the printable range */
+{
+	if (c < 0x20 || c > 0x7E) {
+		return ' ';}
+	return (char)c;
+}
+
+static void rds_group(struct rds_decoder *r)
+/* PI, PTY, PS (group 0) and RadioText (group 2) */
+{
+	uint16_t b = r->block[1], c = r->block[2], d = r->block[3];
+	int type, version_b, addr, ab, i, n;
+	char text[4];
+	/* a miscorrected PI would be shown as a different station */
+	if ((r->ok & ~r->fixed) & 1) {
+		r->info.pi = r->block[0];}
+	if (!(r->ok & 2)) {
+		return;}
+	r->info.groups++;
+	type = b >> 12;
+	version_b = (b >> 11) & 1;
+	r->info.tp = (b >> 10) & 1;
+	r->info.pty = (b >> 5) & 0x1F;
+	if (version_b && ((r->ok & ~r->fixed) & 4)) {
+		/* block C' repeats PI */
+		r->info.pi = c;}
+
+	switch (type) {
+	case 0:
+		r->info.ta = (b >> 4) & 1;
+		if (!(r->ok & 8)) {
+			break;}
+		addr = b & 3;
+		r->ps[2*addr]   = rds_char(d >> 8);
+		r->ps[2*addr+1] = rds_char(d & 0xFF);
+		r->ps_mask |= 1 << addr;
+		/* only show complete names, stations scroll text through PS */
+		if (r->ps_mask == 0xF) {
+			memcpy(r->info.ps, r->ps, RDS_PS_LEN + 1);
+			r->ps_mask = 0;
+		}
+		break;
+	case 2:
+		ab = (b >> 4) & 1;
+		if (ab != r->rt_ab) {
+			memset(r->rt, ' ', RDS_RT_LEN);
+			r->rt_ab = ab;
+		}
+		if (!version_b) {
+			if ((r->ok & 12) != 12) {
+				break;}
+			addr = (b & 0xF) * 4;
+			text[0] = c >> 8; text[1] = c & 0xFF;
+			text[2] = d >> 8; text[3] = d & 0xFF;
+			n = 4;
+		} else {
+			if (!(r->ok & 8)) {
+				break;}
+			addr = (b & 0xF) * 2;
+			text[0] = d >> 8; text[1] = d & 0xFF;
+			n = 2;
+		}
+		for (i = 0; i < n; i++) {
+			if (text[i] == 0x0D) {
+				/* end of message, the rest is padding */
+				memset(r->rt + addr + i, ' ', RDS_RT_LEN - addr - i);
+				break;
+			}
+			r->rt[addr + i] = rds_char(text[i]);
+		}
+		memcpy(r->info.rt, r->rt, RDS_RT_LEN + 1);
+		break;
+	default:
+		break;
+	}
+}
+
+static int rds_check(uint32_t *word, int block)
+/* 1 if the word is a good block, 2 if a short burst was fixed in place */
+{
+	uint16_t s = rds_syndrome(*word);
+	uint32_t e;
+	int i, n = block == 2 ? 2 : 1;
+	/* block C may be C', exact matches first so neither gets miscorrected */
+	for (i = 0; i < n; i++) {
+		if (s == rds_offset[i ? 4 : block]) {
+			return 1;}
+	}
+	for (i = 0; i < n; i++) {
+		e = rds_burst[s ^ rds_offset[i ? 4 : block]];
+		if (e) {
+			*word ^= e;
+			return 2;
+		}
+	}
+	return 0;
+}
+
+static void rds_bit(struct rds_decoder *r, int bit)
+{
+	uint32_t word;
+	uint16_t s;
+	int i, block = -1;
+	r->reg = ((r->reg << 1) | (uint32_t)bit) & ((1u << BLOCK_BITS) - 1);
+	r->bits++;
+
+	if (!r->synced) {
+		/* two blocks in order, 26 bits apart */
+		if (r->bits > BLOCK_BITS) {
+			r->bits = BLOCK_BITS + 1;}
+		s = rds_syndrome(r->reg);
+		for (i = 0; i < 5; i++) {
+			if (s == rds_offset[i]) {
+				block = i == 4 ? 2 : i;}
+		}
+		if (block < 0) {
+			return;}
+		if (r->last_found && r->bits == BLOCK_BITS
+		    && block == (r->last_block + 1) % 4) {
+			r->synced = 1;
+			r->bad_run = 0;
+			r->bits = 0;
+			r->ok = 0;
+			r->fixed = 0;
+			r->block[block] = (uint16_t)(r->reg >> 10);
+			r->ok |= 1 << block;
+			r->expect = (block + 1) % 4;
+			r->info.synced = 1;
+			rds_publish(r);
+			return;
+		}
+		r->last_found = 1;
+		r->last_block = block;
+		r->bits = 0;
+		return;
+	}
+
+	if (r->bits < BLOCK_BITS) {
+		return;}
+	r->bits = 0;
+	word = r->reg;
+	i = rds_check(&word, r->expect);
+	if (i) {
+		r->block[r->expect] = (uint16_t)(word >> 10);
+		r->ok |= 1 << r->expect;
+		if (i == 2) {
+			r->fixed |= 1 << r->expect;}
+		r->bad_run = 0;
+	} else {
+		r->info.blocks_bad++;
+		r->bad_run++;
+	}
+	if (r->expect == 3) {
+		rds_group(r);
+		r->ok = 0;
+		r->fixed = 0;
+		rds_publish(r);
+	}
+	r->expect = (r->expect + 1) % 4;
+	if (r->bad_run >= RDS_SYNC_LOSS) {
+		r->synced = 0;
+		r->last_found = 0;
+		r->bits = 0;
+		r->info.synced = 0;
+		rds_publish(r);
+	}
+}
+
+static void rds_symbol(struct rds_decoder *r, float i, float q)
+/* one sample at the low rate */
+{
+	const int16_t *tab = nco_table();
+	int idx = r->carrier >> (32 - NCO_BITS);
+	float s = tab[idx] * (1.0f / 32768.0f);
+	float c = tab[(idx + NCO_SIZE/4) & (NCO_SIZE-1)] * (1.0f / 32768.0f);
+	float vi = i * c + q * s;
+	float vq = q * c - i * s;
+	int h = r->half, p = r->hist_pos, mid, old, k;
+	float yi, yq, e, e_t, mag;
+	int raw;
+
+	/* biphase matched filter: first half bit minus second half bit,
+	   running sums over a ring of two half bits */
+	mid = (p + h) % (2 * h);
+	old = p;
+	r->sum_i += r->hist_i[mid] * 2.0f - r->hist_i[old] - vi;
+	r->sum_q += r->hist_q[mid] * 2.0f - r->hist_q[old] - vq;
+	r->hist_i[p] = vi;
+	r->hist_q[p] = vq;
+	r->hist_pos = (p + 1) % (2 * h);
+	if (!r->hist_pos) {
+		/* start over once a bit so float rounding cannot pile up */
+		r->sum_i = r->sum_q = 0.0f;
+		for (k = 0; k < 2 * h; k++) {
+			r->sum_i += k < h ? r->hist_i[k] : -r->hist_i[k];
+			r->sum_q += k < h ? r->hist_q[k] : -r->hist_q[k];
+		}
+	}
+	/* oldest half bit minus newest half bit */
+	yi = r->sum_i;
+	yq = r->sum_q;
+
+	/* costas, bpsk puts everything on i */
+	mag = yi * yi + yq * yq + 1e-12f;
+	e = yi * yq / mag;
+	r->carrier_freq += r->ki * e;
+	if (r->carrier_freq > r->freq_lim) {
+		r->carrier_freq = r->freq_lim;}
+	if (r->carrier_freq < -r->freq_lim) {
+		r->carrier_freq = -r->freq_lim;}
+	r->carrier += (uint32_t)(int32_t)((r->carrier_freq + r->kp * e) * (float)(4294967296.0 / (2.0 * M_PI)));
+
+	/* bit clock, early/late on the matched filter peak one sample back */
+	r->y[0] = r->y[1];
+	r->y[1] = r->y[2];
+	r->y[2] = yi;
+	r->bit_phase += r->bit_step;
+	if (r->bit_phase < 1.0f) {
+		return;}
+	r->bit_phase -= 1.0f;
+	mag = fabsf(r->y[1]) + 1e-12f;
+	e_t = (fabsf(r->y[2]) - fabsf(r->y[0])) / mag;
+	if (e_t > 1.0f) {
+		e_t = 1.0f;}
+	if (e_t < -1.0f) {
+		e_t = -1.0f;}
+	/* peak is later than this sample, take the next bit later */
+	r->bit_phase -= 0.05f * e_t * r->bit_step;
+	raw = r->y[1] > 0.0f;
+	rds_bit(r, raw ^ r->prev_raw);
+	r->prev_raw = raw;
+}
+
+void rds_process(struct rds_decoder *r, const int16_t *mpx, int len)
+{
+	const int16_t *tab = nco_table();
+	uint32_t phase = r->phase;
+	uint32_t a0 = r->integ_i[0], a1 = r->integ_i[1], a2 = r->integ_i[2];
+	uint32_t b0 = r->integ_q[0], b1 = r->integ_q[1], b2 = r->integ_q[2];
+	uint32_t ci, cq, t;
+	int i, idx, x, k;
+	if (!r->usable) {
+		return;}
+	if (__atomic_exchange_n(&r->reset_req, 0, __ATOMIC_ACQUIRE)) {
+		rds_clear(r);
+		rds_publish(r);
+	}
+	for (i = 0; i < len; i++) {
+		x = mpx[i];
+		idx = phase >> (32 - NCO_BITS);
+		phase += r->freq;
+		/* integrators wrap, the combs undo it */
+		a0 += (uint32_t)(x * tab[(idx + NCO_SIZE/4) & (NCO_SIZE-1)] >> 15);
+		a1 += a0;
+		a2 += a1;
+		b0 -= (uint32_t)(x * tab[idx] >> 15);
+		b1 += b0;
+		b2 += b1;
+		if (++r->count < r->decim) {
+			continue;}
+		r->count = 0;
+		ci = a2;
+		cq = b2;
+		for (k = 0; k < RDS_CIC_ORDER; k++) {
+			t = ci; ci -= r->comb_i[k]; r->comb_i[k] = t;
+			t = cq; cq -= r->comb_q[k]; r->comb_q[k] = t;
+		}
+		rds_symbol(r, (float)(int32_t)ci * r->cic_gain,
+		              (float)(int32_t)cq * r->cic_gain);
+	}
+	r->phase = phase;
+	r->integ_i[0] = a0; r->integ_i[1] = a1; r->integ_i[2] = a2;
+	r->integ_q[0] = b0; r->integ_q[1] = b1; r->integ_q[2] = b2;
+}
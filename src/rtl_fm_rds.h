@@ -0,0 +1,138 @@
+/*
+ * RDS decoder for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RTL_FM_RDS_H
+#define __RTL_FM_RDS_H
+
+#include <stdint.h>
+
+#define RDS_CARRIER		57000
+#define RDS_BITRATE		1187.5
+/* the cic brings the multiplex down to about this, 16 samples a bit */
+#define RDS_LOW_RATE		19000
+/* multiplex rates the cic handles */
+#define RDS_MIN_RATE		120000
+#define RDS_MAX_RATE		304000
+#define RDS_CIC_ORDER		3
+/* longest error burst corrected per block */
+#define RDS_MAX_BURST		2
+/* bad blocks in a row before sync is dropped */
+#define RDS_SYNC_LOSS		10
+
+#define RDS_PS_LEN		8
+#define RDS_RT_LEN		64
+
+/* what the display gets to see */
+struct rds_info
+{
+	int      synced;
+	uint16_t pi;
+	uint8_t  pty;
+	uint8_t  tp, ta;
+	char     ps[RDS_PS_LEN + 1];
+	char     rt[RDS_RT_LEN + 1];
+	unsigned long groups;       /* decoded */
+	unsigned long blocks_bad;   /* after correction */
+};
+
+struct rds_decoder
+{
+	int      rate_in;
+	int      usable;
+	/* 57 kHz mix and cic decimation, integer */
+	uint32_t phase;
+	uint32_t freq;
+	int      decim;
+	int      count;
+	uint32_t integ_i[RDS_CIC_ORDER], integ_q[RDS_CIC_ORDER];
+	uint32_t comb_i[RDS_CIC_ORDER], comb_q[RDS_CIC_ORDER];
+	float    cic_gain;
+	/* costas loop, biphase matched filter and bit clock, float at the low rate */
+	uint32_t carrier;
+	float    carrier_freq;
+	float    kp, ki;
+	float    freq_lim;
+	int      half;              /* samples per half bit */
+	float    hist_i[32], hist_q[32];
+	int      hist_pos;
+	float    sum_i, sum_q;      /* first half minus second half, running */
+	float    bit_step;          /* bits per low rate sample */
+	float    bit_phase;
+	float    y[3];              /* last matched filter outputs */
+	int      prev_raw;
+	/* block sync */
+	uint32_t reg;
+	int      bits;
+	int      synced;
+	int      expect;            /* 0..3, A B C D */
+	int      last_found;        /* a block was seen, last_block */
+	int      last_block;
+	int      bad_run;
+	uint16_t block[4];
+	int      ok;                /* blocks of this group received */
+	int      fixed;             /* ... of those, corrected */
+	/* text assembly */
+	char     ps[RDS_PS_LEN + 1];
+	int      ps_mask;
+	char     rt[RDS_RT_LEN + 1];
+	int      rt_ab;
+	struct rds_info info;
+	/* lock free snapshot, seqlock: odd while being written */
+	unsigned int seq;
+	struct rds_info shared;
+	int      reset_req;
+};
+
+/*!
+ * Set up the decoder, state is cleared
+ *
+ * \param r decoder
+ * \param rate_in multiplex (discriminator output) sample rate
+ * \return 0 on success, -1 if the rate cannot carry RDS
+ */
+
+extern int rds_init(struct rds_decoder *r, int rate_in);
+
+/*!
+ * Run one block of multiplex through the decoder, call from the dsp thread
+ *
+ * \param r decoder from rds_init()
+ * \param mpx discriminator output, not modified
+ * \param len number of samples
+ */
+
+extern void rds_process(struct rds_decoder *r, const int16_t *mpx, int len);
+
+/*!
+ * Ask the dsp thread to forget the station, e.g. after a retune.
+ * Safe from any thread.
+ */
+
+extern void rds_reset(struct rds_decoder *r);
+
+/*!
+ * Copy out what has been decoded so far without blocking the dsp thread.
+ * Safe from any thread.
+ *
+ * \param r decoder from rds_init()
+ * \param out snapshot
+ * \return snapshot sequence number, changes when the contents do
+ */
+
+extern unsigned int rds_snapshot(struct rds_decoder *r, struct rds_info *out);
+
+#endif /* #ifndef __RTL_FM_RDS_H */
@@ -0,0 +1,303 @@
+/*
+ * Polyphase rational resampler for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "rtl_fm_resample.h"
+
+static void resample_ratio(int rate_in, int rate_out, int *up, int *down)
+/* continued fraction convergents of rate_out/rate_in,
+   exact unless the reduced ratio needs too many phases */
+{
+	long a = rate_out, b = rate_in, q, t;
+	long p0 = 0, q0 = 1, p1 = 1, q1 = 0, p2, q2;
+	while (b) {
+		q = a / b;
+		p2 = q*p1 + p0;
+		q2 = q*q1 + q0;
+		if (p2 > RESAMPLE_MAX_PHASES) {
+			break;}
+		p0 = p1; q0 = q1;
+		p1 = p2; q1 = q2;
+		t = a - q*b;
+		a = b;
+		b = t;
+	}
+	if (p1 < 1 || q1 < 1) {
+		p1 = q1 = 1;}
+	*up = (int)p1;
+	*down = (int)q1;
+}
+
+static void resample_design(struct resampler *r)
+/* Blackman windowed sinc at the upsampled rate, split into banks */
+{
+	int n = r->up * RESAMPLE_TAPS;
+	double fc = 0.45 / (r->up > r->down ? r->up : r->down);
+	if (r->cutoff > 0) {
+		fc = (double)r->cutoff / ((double)r->rate_in * r->up);}
+	double h[RESAMPLE_TAPS];
+	double x, sum;
+	int p, j, i, q;
+	int16_t *bank;
+	float *bank_f32;
+	for (p = 0; p < r->up; p++) {
+		sum = 0;
+		for (j = 0; j < RESAMPLE_TAPS; j++) {
+			/* tap j of phase p is proto[p + j*up], it meets x[newest - j] */
+			i = p + j * r->up;
+			x = i - (n - 1) / 2.0;
+			h[j] = 2.0 * fc;
+			if (x != 0) {
+				h[j] = sin(2.0 * M_PI * fc * x) / (M_PI * x);}
+			h[j] *= 0.42 - 0.5 * cos(2.0 * M_PI * (i + 1) / (n + 1))
+				+ 0.08 * cos(4.0 * M_PI * (i + 1) / (n + 1));
+			sum += h[j];
+		}
+		/* every phase has unity gain, otherwise the dc level wobbles */
+		if (r->bank_f32) {
+			bank_f32 = r->bank_f32 + p * RESAMPLE_TAPS;
+			for (j = 0; j < RESAMPLE_TAPS; j++) {
+				bank_f32[RESAMPLE_TAPS - 1 - j] = (float)(h[j] / sum);}
+			continue;
+		}
+		bank = r->bank + p * RESAMPLE_TAPS;
+		q = 0;
+		for (j = 0; j < RESAMPLE_TAPS; j++) {
+			bank[RESAMPLE_TAPS - 1 - j] = (int16_t)round(h[j] / sum * (1 << RESAMPLE_SHIFT));
+			q += bank[RESAMPLE_TAPS - 1 - j];
+		}
+		bank[RESAMPLE_TAPS / 2] += (1 << RESAMPLE_SHIFT) - q;
+	}
+	for (p = 0; p < r->up; p++) {
+		r->adv[p] = (p + r->down) / r->up;
+		r->next[p] = (p + r->down) % r->up;
+	}
+}
+
+static int resample_setup(struct resampler *r, int rate_in, int rate_out, int cutoff, int f32)
+{
+	free(r->bank);
+	free(r->adv);
+	free(r->next);
+	free(r->buf);
+	free(r->bank_f32);
+	free(r->buf_f32);
+	memset(r, 0, sizeof(struct resampler));
+	r->rate_in = rate_in;
+	r->rate_out = rate_out;
+	r->cutoff = cutoff;
+	resample_ratio(rate_in, rate_out, &r->up, &r->down);
+	r->adv = (int*)malloc(r->up * sizeof(int));
+	r->next = (int*)malloc(r->up * sizeof(int));
+	r->buf_size = 4 * RESAMPLE_TAPS;
+	if (f32) {
+		r->bank_f32 = (float*)malloc(r->up * RESAMPLE_TAPS * sizeof(float));
+		r->buf_f32 = (float*)calloc(r->buf_size, sizeof(float));
+		if (!r->bank_f32 || !r->adv || !r->next || !r->buf_f32) {
+			return -1;}
+	} else {
+		r->bank = (int16_t*)malloc(r->up * RESAMPLE_TAPS * sizeof(int16_t));
+		r->buf = (int16_t*)calloc(r->buf_size, sizeof(int16_t));
+		if (!r->bank || !r->adv || !r->next || !r->buf) {
+			return -1;}
+	}
+	resample_design(r);
+	r->dot = dot_select(dsp_cpu_features());
+	r->dot_f32 = dot_f32_select(dsp_cpu_features());
+	if ((long)rate_in * r->up != (long)rate_out * r->down) {
+		fprintf(stderr, "Resampling %i Hz to %.1f Hz (%i/%i).\n", rate_in,
+			(double)rate_in * r->up / r->down, r->up, r->down);
+	}
+	return 0;
+}
+
+int resample_init(struct resampler *r, int rate_in, int rate_out, int cutoff)
+{
+	return resample_setup(r, rate_in, rate_out, cutoff, 0);
+}
+
+int resample_init_f32(struct resampler *r, int rate_in, int rate_out, int cutoff)
+{
+	return resample_setup(r, rate_in, rate_out, cutoff, 1);
+}
+
+int resample_process(struct resampler *r, int16_t *buf, int len, int max_len)
+{
+	int hist = RESAMPLE_TAPS - 1;
+	int o = 0, s;
+	int16_t *tmp;
+	if (hist + len > r->buf_size) {
+		tmp = (int16_t*)realloc(r->buf, (hist + len) * sizeof(int16_t));
+		if (!tmp) {
+			return 0;}
+		r->buf = tmp;
+		r->buf_size = hist + len;
+	}
+	memcpy(r->buf + hist, buf, len * sizeof(int16_t));
+	/* the output on input sample pos reads buf[pos .. pos+hist] */
+	while (r->pos < len) {
+		if (o < max_len) {
+			s = (r->dot(r->bank + r->phase * RESAMPLE_TAPS, r->buf + r->pos, RESAMPLE_TAPS)
+				+ (1 << (RESAMPLE_SHIFT-1))) >> RESAMPLE_SHIFT;
+			if (s > 32767) {
+				s = 32767;}
+			if (s < -32768) {
+				s = -32768;}
+			buf[o++] = (int16_t)s;
+		}
+		r->pos += r->adv[r->phase];
+		r->phase = r->next[r->phase];
+	}
+	r->pos -= len;
+	memmove(r->buf, r->buf + len, hist * sizeof(int16_t));
+	return o;
+}
+
+int resample_process_f32(struct resampler *r, float *buf, int len, int max_len)
+{
+	int hist = RESAMPLE_TAPS - 1;
+	int o = 0;
+	float *tmp;
+	if (hist + len > r->buf_size) {
+		tmp = (float*)realloc(r->buf_f32, (hist + len) * sizeof(float));
+		if (!tmp) {
+			return 0;}
+		r->buf_f32 = tmp;
+		r->buf_size = hist + len;
+	}
+	memcpy(r->buf_f32 + hist, buf, len * sizeof(float));
+	while (r->pos < len) {
+		if (o < max_len) {
+			buf[o++] = r->dot_f32(r->bank_f32 + r->phase * RESAMPLE_TAPS, r->buf_f32 + r->pos, RESAMPLE_TAPS);}
+		r->pos += r->adv[r->phase];
+		r->phase = r->next[r->phase];
+	}
+	r->pos -= len;
+	memmove(r->buf_f32, r->buf_f32 + len, hist * sizeof(float));
+	return o;
+}
+
+static void drift_design(int16_t *bank)
+/* windowed sinc for each delay mu, the window moves with it so bank
+   DRIFT_PHASES is bank 0 one sample later */
+{
+	int c = DRIFT_TAPS / 2 - 1;
+	double half = DRIFT_TAPS / 2 + 1;
+	double fc = 0.45;
+	double h[DRIFT_TAPS];
+	double mu, x, sum;
+	int p, k, q;
+	for (p = 0; p <= DRIFT_PHASES; p++) {
+		mu = (double)p / DRIFT_PHASES;
+		sum = 0;
+		for (k = 0; k < DRIFT_TAPS; k++) {
+			x = c + mu - k;
+			h[k] = 2.0 * fc;
+			if (x != 0) {
+				h[k] = sin(2.0 * M_PI * fc * x) / (M_PI * x);}
+			h[k] *= 0.42 + 0.5 * cos(M_PI * x / half) + 0.08 * cos(2.0 * M_PI * x / half);
+			sum += h[k];
+		}
+		q = 0;
+		for (k = 0; k < DRIFT_TAPS; k++) {
+			bank[p * DRIFT_TAPS + k] = (int16_t)round(h[k] / sum * (1 << RESAMPLE_SHIFT));
+			q += bank[p * DRIFT_TAPS + k];
+		}
+		bank[p * DRIFT_TAPS + c + (mu >= 0.5)] += (1 << RESAMPLE_SHIFT) - q;
+	}
+}
+
+int drift_init(struct drift_resampler *r, int channels)
+{
+	int c;
+	free(r->bank);
+	for (c = 0; c < DRIFT_MAX_CHANNELS; c++) {
+		free(r->buf[c]);}
+	memset(r, 0, sizeof(struct drift_resampler));
+	if (channels > DRIFT_MAX_CHANNELS) {
+		return -1;}
+	r->channels = channels;
+	r->buf_size = 4 * DRIFT_TAPS;
+	r->bank = (int16_t*)malloc((DRIFT_PHASES + 1) * DRIFT_TAPS * sizeof(int16_t));
+	if (!r->bank) {
+		return -1;}
+	for (c = 0; c < channels; c++) {
+		r->buf[c] = (int16_t*)calloc(r->buf_size, sizeof(int16_t));
+		if (!r->buf[c]) {
+			return -1;}
+	}
+	drift_design(r->bank);
+	r->dot = dot_select(dsp_cpu_features());
+	return 0;
+}
+
+int drift_process(struct drift_resampler *r, const int16_t *in, int frames,
+	double ratio, int16_t *out, int max_frames)
+{
+	int hist = DRIFT_TAPS - 1;
+	int ch = r->channels;
+	int n = hist + frames;
+	double step = 1.0 / ratio;
+	double ph;
+	const int16_t *b0;
+	int16_t *tmp;
+	int32_t d0, d1;
+	int c, i, p, a, s, o = 0;
+	if (n > r->buf_size) {
+		for (c = 0; c < ch; c++) {
+			tmp = (int16_t*)realloc(r->buf[c], n * sizeof(int16_t));
+			if (!tmp) {
+				return 0;}
+			r->buf[c] = tmp;
+		}
+		r->buf_size = n;
+	}
+	for (i = 0; i < frames; i++) {
+		for (c = 0; c < ch; c++) {
+			r->buf[c][hist + i] = in[i * ch + c];}
+	}
+	/* the output at pos reads buf[i .. i+DRIFT_TAPS-1], the delay between
+	   the two banks either side of the fraction is interpolated */
+	for (i = (int)r->pos; i + DRIFT_TAPS <= n; i = (int)r->pos) {
+		ph = (r->pos - i) * DRIFT_PHASES;
+		p = (int)ph;
+		a = (int)((ph - p) * 32768);
+		b0 = r->bank + p * DRIFT_TAPS;
+		for (c = 0; c < ch && o < max_frames; c++) {
+			d0 = r->dot(b0, r->buf[c] + i, DRIFT_TAPS);
+			d1 = r->dot(b0 + DRIFT_TAPS, r->buf[c] + i, DRIFT_TAPS);
+			s = (d0 + (int32_t)(((int64_t)(d1 - d0) * a) >> 15)
+				+ (1 << (RESAMPLE_SHIFT-1))) >> RESAMPLE_SHIFT;
+			if (s > 32767) {
+				s = 32767;}
+			if (s < -32768) {
+				s = -32768;}
+			out[o * ch + c] = (int16_t)s;
+		}
+		if (o < max_frames) {
+			o++;}
+		r->pos += step;
+	}
+	r->pos -= frames;
+	for (c = 0; c < ch; c++) {
+		memmove(r->buf[c], r->buf[c] + frames, hist * sizeof(int16_t));}
+	return o;
+}
@@ -0,0 +1,138 @@
+/*
+ * Polyphase rational resampler for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RTL_FM_RESAMPLE_H
+#define __RTL_FM_RESAMPLE_H
+
+#include <stdint.h>
+
+#include "rtl_fm_dsp.h"
+
+/* taps per phase, a multiple of 16 for the dot kernels */
+#define RESAMPLE_TAPS		96
+/* caps the coefficient banks at 192 KB, odd ratios get approximated */
+#define RESAMPLE_MAX_PHASES	1024
+#define RESAMPLE_SHIFT		14
+
+/* up/down == rate_out/rate_in, everything that needs a divide
+   is worked out once in resample_init() */
+struct resampler
+{
+	int      rate_in;
+	int      rate_out;
+	int      cutoff;
+	int      up;
+	int      down;
+	int      phase;     /* bank of the next output */
+	int      pos;       /* newest input sample of the next output */
+	int16_t  *bank;     /* up banks of RESAMPLE_TAPS, time reversed */
+	int      *adv;      /* input samples to step after each phase */
+	int      *next;     /* phase after each phase */
+	int16_t  *buf;      /* RESAMPLE_TAPS-1 samples of history, then the block */
+	int      buf_size;
+	dot_fn   dot;
+	float    *bank_f32; /* resample_init_f32() builds these instead */
+	float    *buf_f32;
+	dot_f32_fn dot_f32;
+};
+
+/* drift_process(), the ratio stays within a fraction of a percent of 1
+   and moves every block, so the banks are fractional delays of one
+   prototype and the position is carried as a real number */
+#define DRIFT_TAPS		32
+#define DRIFT_PHASES		128
+#define DRIFT_MAX_CHANNELS	2
+
+struct drift_resampler
+{
+	int      channels;
+	double   pos;       /* input sample of the next output, from the start of buf */
+	int16_t  *bank;     /* DRIFT_PHASES+1 delays of 0..1 sample */
+	int16_t  *buf[DRIFT_MAX_CHANNELS];  /* DRIFT_TAPS-1 of history, then the block */
+	int      buf_size;
+	dot_fn   dot;
+};
+
+/*!
+ * Build the coefficient banks for a rate_in to rate_out conversion
+ *
+ * \param r resampler, zeroed or from an earlier resample_init()
+ * \param rate_in input sample rate
+ * \param rate_out output sample rate
+ * \param cutoff -6 dB point in Hz, 0 for 0.45 of the lower of the two rates
+ * \return 0 on success, -1 if out of memory
+ */
+
+extern int resample_init(struct resampler *r, int rate_in, int rate_out, int cutoff);
+
+/*!
+ * Resample one block in place, state carries over
+ *
+ * \param r resampler from resample_init()
+ * \param buf samples in, resampled samples out
+ * \param len number of input samples
+ * \param max_len room in buf, outputs past it are dropped
+ * \return number of output samples
+ */
+
+extern int resample_process(struct resampler *r, int16_t *buf, int len, int max_len);
+
+/*!
+ * resample_init() with unquantized float banks, for resample_process_f32()
+ *
+ * \return 0 on success, -1 if out of memory
+ */
+
+extern int resample_init_f32(struct resampler *r, int rate_in, int rate_out, int cutoff);
+
+/*!
+ * Float version of resample_process()
+ *
+ * \param r resampler from resample_init_f32()
+ * \param buf samples in, resampled samples out
+ * \param len number of input samples
+ * \param max_len room in buf, outputs past it are dropped
+ * \return number of output samples
+ */
+
+extern int resample_process_f32(struct resampler *r, float *buf, int len, int max_len);
+
+/*!
+ * Set up a variable ratio resampler
+ *
+ * \param r resampler, zeroed or from an earlier drift_init()
+ * \param channels interleaved, up to DRIFT_MAX_CHANNELS
+ * \return 0 on success, -1 if out of memory
+ */
+
+extern int drift_init(struct drift_resampler *r, int channels);
+
+/*!
+ * Resample one block of interleaved frames, state carries over
+ *
+ * \param in interleaved input
+ * \param frames input frames
+ * \param ratio output frames per input frame, near 1
+ * \param out interleaved output, not in
+ * \param max_frames room in out, outputs past it are dropped
+ * \return output frames
+ */
+
+extern int drift_process(struct drift_resampler *r, const int16_t *in, int frames,
+	double ratio, int16_t *out, int max_frames);
+
+#endif /* #ifndef __RTL_FM_RESAMPLE_H */
@@ -0,0 +1,205 @@
+/*
+ * Block ring between the rtl_fm_lib threads
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "rtl_fm_ring.h"
+
+static void ring_wait(uint32_t *word, uint32_t val)
+/* sleeps only if *word is still val, the kernel checks that atomically */
+{
+	struct timespec ts;
+	ts.tv_sec = 0;
+	ts.tv_nsec = RING_WAIT_MS * 1000000L;
+	syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+}
+
+static void ring_wake(uint32_t *word)
+{
+	syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static uint32_t ring_now_us(void)
+/* wraps every 71 minutes, only differences are used */
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000000LL + ts.tv_nsec / 1000);
+}
+
+static void ring_woke(uint32_t *woken, uint32_t *word)
+/* the waking side stamps the time just before it wakes the sleeper */
+{
+	__atomic_store_n(woken, ring_now_us(), __ATOMIC_RELEASE);
+	ring_wake(word);
+}
+
+static void ring_woken(struct ring_latency *l, uint32_t *woken)
+/* after a wait, nothing to count if it timed out */
+{
+	uint32_t t = __atomic_exchange_n(woken, 0, __ATOMIC_ACQUIRE);
+	uint32_t us;
+	int i;
+	if (!t) {
+		return;}
+	us = ring_now_us() - t;
+	l->n++;
+	l->sum_us += us;
+	if (us > l->max_us) {
+		l->max_us = us;}
+	for (i = 0; i < RING_LAT_BUCKETS - 1 && us >= (1u << i); i++) {}
+	l->hist[i]++;
+}
+
+int ring_init(struct block_ring *r, int blocks, int block_len)
+{
+	void *mem;
+	memset(r, 0, sizeof(struct block_ring));
+	r->blocks = blocks;
+	r->block_len = block_len;
+	r->stride = (block_len + RING_ALIGN/2 - 1) & ~(RING_ALIGN/2 - 1);
+	if (posix_memalign(&mem, RING_ALIGN, (size_t)blocks * r->stride * sizeof(int16_t))) {
+		return -1;}
+	r->mem = (int16_t*)mem;
+	/* fault every page in now rather than on the first blocks */
+	memset(mem, 0, (size_t)blocks * r->stride * sizeof(int16_t));
+	r->len = (int*)calloc(blocks, sizeof(int));
+	r->stamp = (struct block_stamp*)calloc(blocks, sizeof(struct block_stamp));
+	if (!r->len || !r->stamp) {
+		return -1;}
+	return 0;
+}
+
+void ring_free(struct block_ring *r)
+{
+	free(r->mem);
+	free(r->len);
+	free(r->stamp);
+	r->mem = NULL;
+	r->len = NULL;
+	r->stamp = NULL;
+}
+
+/* The sleeping side raises its flag and then sleeps on the other
+   side's counter, the waking side moves its counter and then reads
+   the flag.  Both pairs are seq_cst, so either the waker sees the
+   flag or the futex sees the new counter and does not sleep. */
+
+int16_t *ring_acquire(struct block_ring *r)
+{
+	uint32_t head = r->head;
+	uint32_t tail;
+	for (;;) {
+		tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		if (head - tail < (uint32_t)r->blocks) {
+			return r->mem + (size_t)(head & (r->blocks - 1)) * r->stride;}
+		if (__atomic_load_n(&r->closed, __ATOMIC_ACQUIRE)) {
+			return NULL;}
+		r->full_waits++;
+		__atomic_store_n(&r->full_wait, 1, __ATOMIC_SEQ_CST);
+		ring_wait(&r->tail, tail);
+		__atomic_store_n(&r->full_wait, 0, __ATOMIC_RELAXED);
+		ring_woken(&r->full_lat, &r->full_woken);
+	}
+}
+
+struct block_stamp *ring_next_stamp(struct block_ring *r)
+{
+	return &r->stamp[r->head & (r->blocks - 1)];
+}
+
+void ring_publish(struct block_ring *r, int len)
+{
+	r->len[r->head & (r->blocks - 1)] = len;
+	__atomic_store_n(&r->head, r->head + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&r->empty_wait, __ATOMIC_SEQ_CST)) {
+		ring_woke(&r->empty_woken, &r->head);}
+}
+
+int16_t *ring_peek(struct block_ring *r, int *len)
+{
+	uint32_t tail = r->tail;
+	uint32_t head;
+	for (;;) {
+		if (__atomic_load_n(&r->closed, __ATOMIC_ACQUIRE)) {
+			return NULL;}
+		head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		if (head != tail) {
+			*len = r->len[tail & (r->blocks - 1)];
+			return r->mem + (size_t)(tail & (r->blocks - 1)) * r->stride;
+		}
+		__atomic_store_n(&r->empty_wait, 1, __ATOMIC_SEQ_CST);
+		ring_wait(&r->head, head);
+		__atomic_store_n(&r->empty_wait, 0, __ATOMIC_RELAXED);
+		ring_woken(&r->empty_lat, &r->empty_woken);
+	}
+}
+
+const struct block_stamp *ring_stamp(struct block_ring *r)
+{
+	return &r->stamp[r->tail & (r->blocks - 1)];
+}
+
+void ring_release(struct block_ring *r)
+{
+	__atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&r->full_wait, __ATOMIC_SEQ_CST)) {
+		ring_woke(&r->full_woken, &r->tail);}
+}
+
+void ring_close(struct block_ring *r)
+{
+	__atomic_store_n(&r->closed, 1, __ATOMIC_RELEASE);
+	ring_wake(&r->head);
+	ring_wake(&r->tail);
+}
+
+void ring_latency_add(struct ring_latency *sum, const struct ring_latency *l)
+{
+	int i;
+	sum->n += l->n;
+	sum->sum_us += l->sum_us;
+	if (l->max_us > sum->max_us) {
+		sum->max_us = l->max_us;}
+	for (i = 0; i < RING_LAT_BUCKETS; i++) {
+		sum->hist[i] += l->hist[i];}
+}
+
+void ring_latency_print(const char *name, const struct ring_latency *l)
+/* the 99th percentile as the bucket it falls in */
+{
+	uint32_t seen = 0, bound;
+	int i;
+	if (!l->n) {
+		fprintf(stderr, "%-10s wake-ups: none\n", name);
+		return;
+	}
+	for (i = 0; i < RING_LAT_BUCKETS - 1; i++) {
+		seen += l->hist[i];
+		if (seen >= l->n - l->n / 100) {
+			break;}
+	}
+	bound = i < RING_LAT_BUCKETS - 1 ? 1u << i : l->max_us + 1;
+	fprintf(stderr, "%-10s wake-ups: %u, avg %llu us, 99%% < %u us, max %u us\n",
+		name, l->n, (unsigned long long)(l->sum_us / l->n), bound, l->max_us);
+}
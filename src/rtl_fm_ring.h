@@ -0,0 +1,157 @@
+/*
+ * Block ring between the rtl_fm_lib threads
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * One producer thread, one consumer thread, a fixed set of blocks.
+ * The producer fills the block at head and publishes it, the consumer
+ * reads the block at tail and releases it, so a block is owned by one
+ * side at a time and never copied.  head and tail only ever grow and
+ * each is written by one side, no locks.  A side only enters the kernel
+ * (futex) when the ring is full or empty.
+ */
+
+#ifndef __RTL_FM_RING_H
+#define __RTL_FM_RING_H
+
+#include <stdint.h>
+
+#include "rtl_fm_stamp.h"
+
+/* blocks in flight, a power of 2 */
+#define RING_BLOCKS		4
+/* head and tail on their own cache lines, blocks start on one */
+#define RING_ALIGN		64
+/* waits wake up this often to look for ring_close() */
+#define RING_WAIT_MS		100
+
+/* wake-up latency buckets, bucket i counts waits under 2^i us */
+#define RING_LAT_BUCKETS	12
+
+/* time from the futex wake to the woken side running again, how long
+   the scheduler kept a ready thread off the cpu */
+struct ring_latency
+{
+	uint32_t n;
+	uint32_t max_us;
+	uint64_t sum_us;
+	uint32_t hist[RING_LAT_BUCKETS];
+};
+
+struct block_ring
+{
+	/* producer */
+	uint32_t head __attribute__((aligned(RING_ALIGN)));
+	uint32_t full_wait;
+	uint32_t full_waits;    /* times the producer had to block */
+	uint32_t empty_woken;   /* us the consumer was woken at */
+	struct ring_latency full_lat;
+	/* consumer */
+	uint32_t tail __attribute__((aligned(RING_ALIGN)));
+	uint32_t empty_wait;
+	uint32_t full_woken;    /* us the producer was woken at */
+	struct ring_latency empty_lat;
+	/* fixed after ring_init() */
+	int      blocks __attribute__((aligned(RING_ALIGN)));
+	int      block_len;     /* int16 per block */
+	int      stride;        /* int16 between blocks */
+	int16_t  *mem;
+	int      *len;
+	struct block_stamp *stamp;
+	uint32_t closed;
+};
+
+/*!
+ * Allocate the blocks
+ *
+ * \param r ring, zeroed
+ * \param blocks number of blocks, a power of 2
+ * \param block_len int16 per block
+ * \return 0 on success, -1 if out of memory
+ */
+
+extern int ring_init(struct block_ring *r, int blocks, int block_len);
+
+extern void ring_free(struct block_ring *r);
+
+/*!
+ * Producer, the next block to fill, waits while the ring is full
+ *
+ * \return block_len int16, NULL once the ring is closed
+ */
+
+extern int16_t *ring_acquire(struct block_ring *r);
+
+/*!
+ * Producer, the stamp of the block from ring_acquire(), set it before
+ * the block is published
+ */
+
+extern struct block_stamp *ring_next_stamp(struct block_ring *r);
+
+/*!
+ * Producer, hand the block from ring_acquire() to the consumer
+ *
+ * \param len int16 filled in
+ */
+
+extern void ring_publish(struct block_ring *r, int len);
+
+/*!
+ * Consumer, the oldest published block, waits while the ring is empty
+ *
+ * \param len int16 in the block
+ * \return block, NULL once the ring is closed
+ */
+
+extern int16_t *ring_peek(struct block_ring *r, int *len);
+
+/*!
+ * Consumer, the stamp of the block from ring_peek()
+ */
+
+extern const struct block_stamp *ring_stamp(struct block_ring *r);
+
+/*!
+ * Consumer, give the block from ring_peek() back to the producer
+ */
+
+extern void ring_release(struct block_ring *r);
+
+/*!
+ * Add the wake-ups of one side to a total
+ *
+ * \param sum total, zeroed to start
+ * \param l full_lat or empty_lat, read once its thread is joined
+ */
+
+extern void ring_latency_add(struct ring_latency *sum, const struct ring_latency *l);
+
+/*!
+ * One line of wake-up latency
+ *
+ * \param name thread it belongs to
+ */
+
+extern void ring_latency_print(const char *name, const struct ring_latency *l);
+
+/*!
+ * Make both sides return NULL, from any thread
+ */
+
+extern void ring_close(struct block_ring *r);
+
+#endif /* #ifndef __RTL_FM_RING_H */
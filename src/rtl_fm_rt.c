@@ -0,0 +1,124 @@
+/*
+ * Real-time scheduling profile for the rtl_fm_lib threads
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "rtl_fm_rt.h"
+
+static const char *rt_names[RT_STAGES] = {
+	"dongle", "demod", "output", "controller", "worker"};
+
+static const struct rt_stage_conf rt_defaults[RT_STAGES] = {
+	{50, 1},        /* dongle */
+	{40, 2},        /* demod */
+	{45, 3},        /* output */
+	{0,  0},        /* controller */
+	{40, -1},       /* worker */
+};
+
+struct rt_profile rt;
+
+int rt_parse(struct rt_profile *p, const char *spec)
+{
+	char name[16];
+	int i, prio, cpu, n;
+	memcpy(p->stage, rt_defaults, sizeof(rt_defaults));
+	p->enabled = 1;
+	if (!strcmp(spec, "default")) {
+		return 0;}
+	while (*spec) {
+		cpu = -1;
+		n = 0;
+		if (sscanf(spec, "%15[a-z]=%d%n@%d%n", name, &prio, &n, &cpu, &n) < 2) {
+			return -1;}
+		for (i = 0; i < RT_STAGES; i++) {
+			if (!strcmp(name, rt_names[i])) {
+				break;}
+		}
+		if (i == RT_STAGES || prio < 0 || prio > 99) {
+			return -1;}
+		p->stage[i].prio = prio;
+		p->stage[i].cpu = cpu;
+		spec += n;
+		if (*spec == ',') {
+			spec++;
+		} else if (*spec) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int rt_lock_memory(void)
+{
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		fprintf(stderr, "mlockall: %s, memory not locked (ulimit -l)\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void __attribute__((noinline)) rt_prefault_stack(void)
+/* a store a page, each through the volatile lvalue; a memset() with
+   the volatile cast away is a dead store the optimiser drops.  The
+   read back is only there so -Wall sees the array used. */
+{
+	volatile char stack[RT_STACK_PREFAULT];
+	long i, page = sysconf(_SC_PAGESIZE);
+	if (page <= 0) {
+		page = 4096;}
+	for (i = 0; i < RT_STACK_PREFAULT; i += page) {
+		stack[i] = 0;}
+	stack[RT_STACK_PREFAULT - 1] = 0;
+	(void)stack[0];
+}
+
+void rt_enter(enum rt_stage s)
+{
+	struct rt_stage_conf *c = &rt.stage[s];
+	struct sched_param param;
+	cpu_set_t cpus;
+	long i, n = sysconf(_SC_NPROCESSORS_ONLN);
+	int r;
+	if (!rt.enabled) {
+		return;}
+	/* pool threads inherit the demod's cpu, -1 hands them all back */
+	CPU_ZERO(&cpus);
+	if (c->cpu >= 0 && c->cpu < n) {
+		CPU_SET(c->cpu, &cpus);
+	} else {
+		for (i = 0; i < n; i++) {
+			CPU_SET(i, &cpus);}
+	}
+	r = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	if (r) {
+		fprintf(stderr, "%s: cpu %i: %s\n", rt_names[s], c->cpu, strerror(r));}
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = c->prio;
+	r = pthread_setschedparam(pthread_self(), c->prio ? SCHED_FIFO : SCHED_OTHER, &param);
+	if (r) {
+		fprintf(stderr, "%s: SCHED_FIFO %i: %s (needs root or rtprio)\n",
+			rt_names[s], c->prio, strerror(r));}
+	rt_prefault_stack();
+}
@@ -0,0 +1,84 @@
+/*
+ * Real-time scheduling profile for the rtl_fm_lib threads
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * -R, each stage thread applies its own SCHED_FIFO priority and cpu as
+ * it starts.  The main thread takes the controller's, so the display
+ * and encoder threads it starts afterwards stay with it.  Memory is
+ * locked, and the rings are faulted in by ring_init(), so a block never
+ * waits on a page fault.
+ */
+
+#ifndef __RTL_FM_RT_H
+#define __RTL_FM_RT_H
+
+enum rt_stage
+{
+	RT_DONGLE,
+	RT_DEMOD,
+	RT_OUTPUT,
+	RT_CONTROLLER,
+	RT_WORKER,      /* -E parallel, the demod's pool threads */
+	RT_STAGES
+};
+
+/* stack touched as a thread starts, faults it in while that is free */
+#define RT_STACK_PREFAULT	(64 * 1024)
+
+struct rt_stage_conf
+{
+	int      prio;          /* SCHED_FIFO 1..99, 0 leaves SCHED_OTHER */
+	int      cpu;           /* -1 for any */
+};
+
+struct rt_profile
+{
+	int      enabled;
+	struct rt_stage_conf stage[RT_STAGES];
+};
+
+extern struct rt_profile rt;
+
+/*!
+ * Parse -R, stage=prio[@cpu] separated by commas, without @cpu the stage
+ * runs on any, the stages not named keep the defaults.  "default" alone
+ * takes the defaults as they are: the dongle highest since librtlsdr
+ * drops transfers it is late for, then the output, the sound card runs
+ * dry, then the demod.  On four cores each gets its own and the
+ * controller shares cpu 0 with the rest of the system.
+ *
+ * \param spec e.g. "default" or "dongle=60@1,demod=40@2"
+ * \return 0, -1 on a stage or number it does not know
+ */
+
+extern int rt_parse(struct rt_profile *p, const char *spec);
+
+/*!
+ * mlockall() the process, call before the threads start
+ *
+ * \return 0, -1 if the limit or a missing privilege refused it
+ */
+
+extern int rt_lock_memory(void);
+
+/*!
+ * Apply the stage's settings to the calling thread, nothing without -R
+ */
+
+extern void rt_enter(enum rt_stage s);
+
+#endif /* #ifndef __RTL_FM_RT_H */
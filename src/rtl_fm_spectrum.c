@@ -0,0 +1,165 @@
+/*
+ * Streaming spectrum engine for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "rtl_fm_spectrum.h"
+
+static void *spectrum_alloc(size_t size)
+/* cache line aligned and zeroed */
+{
+	void *p = NULL;
+	if (posix_memalign(&p, 64, size)) {
+		return NULL;}
+	memset(p, 0, size);
+	return p;
+}
+
+void spectrum_free(struct spectrum *s)
+{
+	if (!s->nfft) {
+		return;}
+	kiss_fftr_free(s->cfg);
+	free(s->frame);
+	free(s->window);
+	free(s->tbuf);
+	free(s->fbuf);
+	free(s->power);
+	free(s->shared);
+	pthread_mutex_destroy(&s->lock);
+	memset(s, 0, sizeof(struct spectrum));
+}
+
+int spectrum_init(struct spectrum *s, int nfft, int overlap, int window, int every, float avg)
+{
+	int i;
+	double w;
+	spectrum_free(s);
+	if (nfft > SPECTRUM_MAX_NFFT) {
+		nfft = SPECTRUM_MAX_NFFT;}
+	if (nfft < 16) {
+		nfft = 16;}
+	nfft &= ~1;
+	if (overlap < 0 || overlap >= nfft) {
+		overlap = 0;}
+	s->nfft = nfft;
+	s->nbins = nfft/2 + 1;
+	s->hop = nfft - overlap;
+	s->every = every < 1 ? 1 : every;
+	s->avg = (avg <= 0 || avg > 1) ? 1.0f : avg;
+	pthread_mutex_init(&s->lock, NULL);
+	s->cfg = kiss_fftr_alloc(nfft, 0, NULL, NULL);
+	s->frame = (int16_t*)spectrum_alloc(nfft * sizeof(int16_t));
+	s->window = (float*)spectrum_alloc(nfft * sizeof(float));
+	s->tbuf = (kiss_fft_scalar*)spectrum_alloc(nfft * sizeof(kiss_fft_scalar));
+	s->fbuf = (kiss_fft_cpx*)spectrum_alloc(s->nbins * sizeof(kiss_fft_cpx));
+	s->power = (float*)spectrum_alloc(s->nbins * sizeof(float));
+	s->shared = (float*)spectrum_alloc(s->nbins * sizeof(float));
+	if (!s->cfg || !s->frame || !s->window || !s->tbuf || !s->fbuf || !s->power || !s->shared) {
+		return -1;}
+	for (i = 0; i < nfft; i++) {
+		w = 2.0 * M_PI * i / nfft;
+		switch (window) {
+		case SPECTRUM_HANN:
+			s->window[i] = (float)(0.5 - 0.5 * cos(w));
+			break;
+		case SPECTRUM_BLACKMAN:
+			s->window[i] = (float)(0.42 - 0.5 * cos(w) + 0.08 * cos(2.0 * w));
+			break;
+		default:
+			s->window[i] = 1.0f;
+		}
+	}
+	return 0;
+}
+
+static void spectrum_frame(struct spectrum *s)
+{
+	int i;
+	float mean = 0, p;
+	/* remove the dc bias so it does not leak through the window */
+	for (i = 0; i < s->nfft; i++) {
+		mean += s->frame[i];}
+	mean /= s->nfft;
+	for (i = 0; i < s->nfft; i++) {
+		s->tbuf[i] = (kiss_fft_scalar)((s->frame[i] - mean) * s->window[i]);}
+	kiss_fftr(s->cfg, s->tbuf, s->fbuf);
+	for (i = 0; i < s->nbins; i++) {
+		p = (float)s->fbuf[i].r * s->fbuf[i].r + (float)s->fbuf[i].i * s->fbuf[i].i;
+		s->power[i] += (p - s->power[i]) * s->avg;
+	}
+	pthread_mutex_lock(&s->lock);
+	memcpy(s->shared, s->power, s->nbins * sizeof(float));
+	s->frames++;
+	pthread_mutex_unlock(&s->lock);
+}
+
+int spectrum_feed(struct spectrum *s, const int16_t *samples, int len)
+{
+	int n, published = 0;
+	while (len > 0) {
+		n = s->nfft - s->fill;
+		if (n > len) {
+			n = len;}
+		memcpy(s->frame + s->fill, samples, n * sizeof(int16_t));
+		s->fill += n;
+		samples += n;
+		len -= n;
+		if (s->fill < s->nfft) {
+			break;}
+		if (s->skip == 0) {
+			spectrum_frame(s);
+			published++;
+		}
+		s->skip = (s->skip + 1) % s->every;
+		/* keep the overlap for the next frame */
+		memmove(s->frame, s->frame + s->hop, (s->nfft - s->hop) * sizeof(int16_t));
+		s->fill = s->nfft - s->hop;
+	}
+	return published;
+}
+
+unsigned long spectrum_read(struct spectrum *s, float *power, int nbins)
+{
+	unsigned long frames;
+	if (nbins > s->nbins) {
+		nbins = s->nbins;}
+	pthread_mutex_lock(&s->lock);
+	memcpy(power, s->shared, nbins * sizeof(float));
+	frames = s->frames;
+	pthread_mutex_unlock(&s->lock);
+	return frames;
+}
+
+float spectrum_band_power(struct spectrum *s, int lo, int hi)
+{
+	float sum = 0;
+	int i;
+	if (lo < 0) {
+		lo = 0;}
+	if (hi >= s->nbins) {
+		hi = s->nbins - 1;}
+	if (hi < lo) {
+		return 0;}
+	pthread_mutex_lock(&s->lock);
+	for (i = lo; i <= hi; i++) {
+		sum += s->shared[i];}
+	pthread_mutex_unlock(&s->lock);
+	return sum / (hi - lo + 1);
+}
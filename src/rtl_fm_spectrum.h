@@ -0,0 +1,107 @@
+/*
+ * Streaming spectrum engine for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RTL_FM_SPECTRUM_H
+#define __RTL_FM_SPECTRUM_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <kissfft/kiss_fft.h>
+#include <kissfft/kiss_fftr.h>
+
+#define SPECTRUM_MAX_NFFT	4096
+
+#define SPECTRUM_RECT		0
+#define SPECTRUM_HANN		1
+#define SPECTRUM_BLACKMAN	2
+
+/* everything is allocated by spectrum_init(), spectrum_feed() only
+   copies samples and runs the fft when a frame is due */
+struct spectrum
+{
+	int      nfft;
+	int      nbins;         /* nfft/2 + 1 */
+	int      hop;           /* nfft - overlap */
+	int      every;         /* transform one frame in every */
+	int      skip;
+	int      fill;
+	float    avg;           /* 1.0: no averaging */
+	kiss_fftr_cfg cfg;
+	int16_t  *frame;
+	float    *window;
+	kiss_fft_scalar *tbuf;
+	kiss_fft_cpx *fbuf;
+	float    *power;        /* owned by the dsp thread */
+	float    *shared;       /* last published copy, under lock */
+	unsigned long frames;   /* published frames, under lock */
+	pthread_mutex_t lock;
+};
+
+/*!
+ * Allocate the fft plan and buffers
+ *
+ * \param s spectrum, zeroed or from an earlier spectrum_init()
+ * \param nfft transform size, even, up to SPECTRUM_MAX_NFFT
+ * \param overlap samples shared by consecutive frames, below nfft
+ * \param window SPECTRUM_RECT, SPECTRUM_HANN or SPECTRUM_BLACKMAN
+ * \param every transform one frame in every, limits the cpu spent
+ * \param avg weight of a new frame in the running power average, 0 to 1
+ * \return 0 on success, -1 if out of memory
+ */
+
+extern int spectrum_init(struct spectrum *s, int nfft, int overlap, int window, int every, float avg);
+
+/*!
+ * Release what spectrum_init() allocated
+ */
+
+extern void spectrum_free(struct spectrum *s);
+
+/*!
+ * Push samples in, transforms and publishes every frame that completes
+ *
+ * \param s spectrum from spectrum_init()
+ * \param samples real int16 samples
+ * \param len number of samples, any length
+ * \return number of frames published
+ */
+
+extern int spectrum_feed(struct spectrum *s, const int16_t *samples, int len);
+
+/*!
+ * Copy out the latest power bins, safe from any thread
+ *
+ * \param s spectrum from spectrum_init()
+ * \param power up to nbins bins, bin i is at i * rate / nfft
+ * \param nbins number of bins wanted
+ * \return number of frames published so far
+ */
+
+extern unsigned long spectrum_read(struct spectrum *s, float *power, int nbins);
+
+/*!
+ * Mean power over a range of bins of the latest frame, safe from any thread
+ *
+ * \param s spectrum from spectrum_init()
+ * \param lo first bin
+ * \param hi last bin
+ * \return mean power
+ */
+
+extern float spectrum_band_power(struct spectrum *s, int lo, int hi);
+
+#endif /* #ifndef __RTL_FM_SPECTRUM_H */
@@ -0,0 +1,105 @@
+/*
+ * Per-block timestamps and stage latency histograms for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "rtl_fm_stamp.h"
+
+uint64_t stamp_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int lat_bucket(uint32_t us)
+/* below LAT_SUB as is, above it the top LAT_SUB_BITS+1 bits */
+{
+	int e;
+	if (us < LAT_SUB) {
+		return us;}
+	e = 31 - __builtin_clz(us);
+	if (e - LAT_SUB_BITS + 1 > LAT_OCTAVES) {
+		return LAT_BUCKETS - 1;}
+	return (e - LAT_SUB_BITS + 1) * LAT_SUB + ((us >> (e - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+static uint32_t lat_bucket_top(int b)
+/* the first us past bucket b */
+{
+	int o = b / LAT_SUB;
+	int m = b % LAT_SUB;
+	if (!o) {
+		return b + 1;}
+	return (uint32_t)(LAT_SUB + m + 1) << (o - 1);
+}
+
+void lat_add(struct lat_hist *h, uint64_t from_ns, uint64_t to_ns)
+{
+	uint64_t us = to_ns > from_ns ? (to_ns - from_ns) / 1000 : 0;
+	if (us > 0xffffffffULL) {
+		us = 0xffffffffULL;}
+	h->n++;
+	h->sum_us += us;
+	if (us > h->max_us) {
+		h->max_us = (uint32_t)us;}
+	h->bucket[lat_bucket((uint32_t)us)]++;
+}
+
+void lat_merge(struct lat_hist *sum, const struct lat_hist *h)
+{
+	int i;
+	sum->n += h->n;
+	sum->sum_us += h->sum_us;
+	if (h->max_us > sum->max_us) {
+		sum->max_us = h->max_us;}
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		sum->bucket[i] += h->bucket[i];}
+}
+
+uint32_t lat_percentile(const struct lat_hist *h, double p)
+{
+	uint64_t seen = 0;
+	uint64_t want = (uint64_t)(p * h->n + 0.5);
+	uint32_t top;
+	int i;
+	if (!h->n) {
+		return 0;}
+	if (want < 1) {
+		want = 1;}
+	for (i = 0; i < LAT_BUCKETS - 1; i++) {
+		seen += h->bucket[i];
+		if (seen >= want) {
+			break;}
+	}
+	top = i < LAT_BUCKETS - 1 ? lat_bucket_top(i) : h->max_us + 1;
+	/* never past the largest seen */
+	return top > h->max_us + 1 ? h->max_us + 1 : top;
+}
+
+void lat_print(const char *name, const struct lat_hist *h)
+{
+	if (!h->n) {
+		fprintf(stderr, "%-14s blocks: none\n", name);
+		return;
+	}
+	fprintf(stderr, "%-14s blocks: %u, avg %llu us, 50%% < %u, 90%% < %u, 99%% < %u, 99.9%% < %u, max %u us\n",
+		name, h->n, (unsigned long long)(h->sum_us / h->n),
+		lat_percentile(h, 0.5), lat_percentile(h, 0.9), lat_percentile(h, 0.99),
+		lat_percentile(h, 0.999), h->max_us);
+}
@@ -0,0 +1,98 @@
+/*
+ * Per-block timestamps and stage latency histograms for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * rtlsdr_callback() stamps each transfer as it arrives, and the stamp
+ * rides with the block through both rings, the output block made from
+ * a dongle block carries the same one.  Each thread adds the stages it
+ * runs to its own histograms, nothing is shared until the threads are
+ * joined, so the cost is a clock_gettime() (vDSO, no syscall) at each
+ * end of a stage and one bucket increment, per block.
+ *
+ * The buckets are log-linear: exact below LAT_SUB us, then LAT_SUB per
+ * octave, so a percentile is within 1/LAT_SUB of the true value from
+ * 1 us to over a minute in a fixed 768 bytes.
+ */
+
+#ifndef __RTL_FM_STAMP_H
+#define __RTL_FM_STAMP_H
+
+#include <stdint.h>
+
+#define LAT_SUB_BITS		3
+#define LAT_SUB			(1 << LAT_SUB_BITS)
+/* octaves above LAT_SUB us, up to 67 s, the last bucket takes the rest */
+#define LAT_OCTAVES		23
+#define LAT_BUCKETS		(LAT_SUB * (LAT_OCTAVES + 1))
+
+struct block_stamp
+{
+	uint64_t usb_ns;        /* CLOCK_MONOTONIC as rtlsdr_callback() ran */
+	uint64_t sample;        /* iq samples from the dongle before this block */
+	uint64_t sent_ns;       /* published to the ring it is in */
+};
+
+struct lat_hist
+{
+	uint32_t n;
+	uint32_t max_us;
+	uint64_t sum_us;
+	uint32_t bucket[LAT_BUCKETS];
+};
+
+/*!
+ * CLOCK_MONOTONIC in ns
+ */
+
+extern uint64_t stamp_now_ns(void);
+
+/*!
+ * Count one latency
+ *
+ * \param h histogram, zeroed to start
+ * \param from_ns start of the stage, from stamp_now_ns()
+ * \param to_ns end of the stage
+ */
+
+extern void lat_add(struct lat_hist *h, uint64_t from_ns, uint64_t to_ns);
+
+/*!
+ * Add one histogram to another
+ *
+ * \param sum total, zeroed to start
+ */
+
+extern void lat_merge(struct lat_hist *sum, const struct lat_hist *h);
+
+/*!
+ * The latency a fraction of the counts fall under
+ *
+ * \param p 0.5 for the median, 0.99 ...
+ * \return us, the upper edge of the bucket it falls in, 0 if empty
+ */
+
+extern uint32_t lat_percentile(const struct lat_hist *h, double p);
+
+/*!
+ * One line of percentiles
+ *
+ * \param name stage it belongs to
+ */
+
+extern void lat_print(const char *name, const struct lat_hist *h);
+
+#endif /* #ifndef __RTL_FM_STAMP_H */
@@ -0,0 +1,190 @@
+/*
+ * FM stereo multiplex decoder for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * multiplex = 0.45 (L+R) + 0.45 (L-R) sin(2 p) + 0.1 sin(p), p the pilot phase
+ *
+ * The pll puts the nco on p, the same table then gives sin(2 p) for the
+ * synchronous demod and sin(p) to cancel the pilot out of the sum channel.
+ * Everything per sample is table lookups, 16x16 multiplies and shifts, so
+ * the ARMv6 Pi Zero can keep up at 170 kHz.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "rtl_fm_stereo.h"
+
+/* lock detector time constant, 2^n samples */
+#define LOCK_SHIFT		12
+/* change of stereo blend per block, out of 256 */
+#define BLEND_STEP		32
+
+static int16_t nco_sin[NCO_SIZE];
+static int nco_ready = 0;
+
+const int16_t *nco_table(void)
+{
+	int i;
+	if (!nco_ready) {
+		for (i = 0; i < NCO_SIZE; i++) {
+			nco_sin[i] = (int16_t)round(32767.0 * sin(2.0 * M_PI * i / NCO_SIZE));}
+		nco_ready = 1;
+	}
+	return nco_sin;
+}
+
+static inline int16_t sat16(int x)
+{
+	if (x > 32767) {
+		return 32767;}
+	if (x < -32768) {
+		return -32768;}
+	return (int16_t)x;
+}
+
+int stereo_init(struct stereo_decoder *st, int rate_in, int rate_out, int deemph_us)
+{
+	/* pilot amplitude out of the discriminator at 7.5 kHz deviation, pi == 1<<14 */
+	double pilot = 15000.0 * (1 << 14) / rate_in;
+	double kd = pilot / 2.0;
+	double wn = 2.0 * M_PI * STEREO_PLL_HZ / rate_in;
+	double per_rad = 4294967296.0 / (2.0 * M_PI);
+	struct resampler rs_sum = st->rs_sum;
+	struct resampler rs_diff = st->rs_diff;
+
+	free(st->sum);
+	free(st->diff);
+	memset(st, 0, sizeof(struct stereo_decoder));
+	st->rs_sum = rs_sum;
+	st->rs_diff = rs_diff;
+	st->rate_in = rate_in;
+	st->rate_out = rate_out;
+	st->usable = rate_in >= STEREO_MIN_RATE;
+	nco_table();
+
+	st->freq = (uint32_t)((double)STEREO_PILOT / rate_in * 4294967296.0);
+	/* second order loop, damping 0.707 */
+	st->kp = (int)round(2.0 * 0.707 * wn * per_rad / kd);
+	st->ki = (int)round(wn * wn * per_rad / kd * 65536.0);
+	if (deemph_us > 0) {
+		st->deemph_a = (int)round(65536.0 * (1.0 - exp(-1.0 / (rate_out * deemph_us * 1e-6))));}
+
+	resample_init(&st->rs_sum, rate_in, rate_out, STEREO_AUDIO_CUTOFF);
+	resample_init(&st->rs_diff, rate_in, rate_out, STEREO_AUDIO_CUTOFF);
+	if (!st->usable) {
+		fprintf(stderr, "Stereo needs at least %i Hz, decoding mono.\n", STEREO_MIN_RATE);
+		return -1;
+	}
+	return 0;
+}
+
+static void stereo_pll(struct stereo_decoder *st, const int16_t *buf, int len)
+/* runs the pilot pll, splits the multiplex into sum and half the difference */
+{
+	const int16_t *tab = nco_sin;
+	uint32_t phase = st->phase;
+	/* +-50 Hz of pull in, the pilot is specified to +-2 Hz */
+	int64_t lim = (int64_t)(50.0 / st->rate_in * 4294967296.0) << 16;
+	int pilot = st->locked ? st->lock_i >> 7 : 0;
+	int i, x, e, idx, s1, c1, s2;
+	for (i = 0; i < len; i++) {
+		x = buf[i];
+		idx = phase >> (32 - NCO_BITS);
+		s1 = tab[idx];
+		c1 = tab[(idx + NCO_SIZE/4) & (NCO_SIZE-1)];
+		s2 = tab[(idx * 2) & (NCO_SIZE-1)];
+		/* phase detector, averages to pilot/2 * sin(error) */
+		e = (x * c1) >> 15;
+		st->lock_i += ((x * s1 >> 7) - st->lock_i) >> LOCK_SHIFT;
+		st->lock_q += ((e << 8) - st->lock_q) >> LOCK_SHIFT;
+		st->integ += (int64_t)e * st->ki;
+		if (st->integ > lim) {
+			st->integ = lim;}
+		if (st->integ < -lim) {
+			st->integ = -lim;}
+		phase += st->freq + (uint32_t)(int32_t)(st->integ >> 16) + (uint32_t)(e * st->kp);
+		st->sum[i] = sat16(x - ((pilot * s1) >> 15));
+		st->diff[i] = (int16_t)((x * s2) >> 15);
+	}
+	st->phase = phase;
+}
+
+static void stereo_lock(struct stereo_decoder *st)
+/* locked when the in phase pilot is a quarter of nominal and dominates the quadrature */
+{
+	int nominal = (int)(15000.0 * (1 << 14) / st->rate_in / 2.0 * 256.0);
+	int i = st->lock_i, q = abs(st->lock_q);
+	if (!st->locked && i > nominal / 4 && q < i / 4) {
+		st->locked = 1;
+		fprintf(stderr, "Stereo pilot locked.\n");
+	} else if (st->locked && (i < nominal / 8 || q > i / 2)) {
+		st->locked = 0;
+		fprintf(stderr, "Stereo pilot lost.\n");
+	}
+	if (st->locked && st->blend < 256) {
+		st->blend += BLEND_STEP;}
+	if (!st->locked && st->blend > 0) {
+		st->blend -= BLEND_STEP;}
+}
+
+static inline int deemph(int *y, int x, int a)
+/* one pole low pass, state << 8 */
+{
+	if (!a) {
+		return x;}
+	*y += (int)(((int64_t)((x << 8) - *y) * a) >> 16);
+	return *y >> 8;
+}
+
+int stereo_process(struct stereo_decoder *st, int16_t *buf, int len, int max_len)
+{
+	int16_t *tmp;
+	int i, n, s, d, l, r;
+	if (len > st->buf_len) {
+		tmp = (int16_t*)realloc(st->sum, len * sizeof(int16_t));
+		if (!tmp) {
+			return 0;}
+		st->sum = tmp;
+		tmp = (int16_t*)realloc(st->diff, len * sizeof(int16_t));
+		if (!tmp) {
+			return 0;}
+		st->diff = tmp;
+		st->buf_len = len;
+	}
+	if (st->usable) {
+		stereo_pll(st, buf, len);
+		stereo_lock(st);
+	} else {
+		memcpy(st->sum, buf, len * sizeof(int16_t));
+		memset(st->diff, 0, len * sizeof(int16_t));
+	}
+	n = resample_process(&st->rs_sum, st->sum, len, max_len / 2);
+	resample_process(&st->rs_diff, st->diff, len, max_len / 2);
+	for (i = 0; i < n; i++) {
+		s = st->sum[i];
+		/* diff was halved to fit int16 */
+		d = (st->diff[i] * st->blend) >> 7;
+		l = deemph(&st->deemph_l, s + d, st->deemph_a);
+		r = deemph(&st->deemph_r, s - d, st->deemph_a);
+		buf[2*i]   = sat16(l);
+		buf[2*i+1] = sat16(r);
+	}
+	return 2 * n;
+}
@@ -0,0 +1,95 @@
+/*
+ * FM stereo multiplex decoder for rtl_fm_lib
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RTL_FM_STEREO_H
+#define __RTL_FM_STEREO_H
+
+#include <stdint.h>
+
+#include "rtl_fm_resample.h"
+
+/* the pilot PLL and the 38 kHz mixer index the same sine table,
+   phase is a 32 bit accumulator, the top bits pick the entry */
+#define NCO_BITS		10
+#define NCO_SIZE		(1 << NCO_BITS)
+
+#define STEREO_PILOT		19000
+/* sum and difference channels are cut here before the matrix */
+#define STEREO_AUDIO_CUTOFF	16000
+/* lowest multiplex rate that still carries the 38 kHz subcarrier */
+#define STEREO_MIN_RATE		106000
+/* de-emphasis, 50 outside the Americas and Korea */
+#define STEREO_DEEMPH_US	75
+/* pll loop bandwidth */
+#define STEREO_PLL_HZ		20
+
+struct stereo_decoder
+{
+	int      rate_in;
+	int      rate_out;
+	int      usable;
+	/* pilot pll */
+	uint32_t phase;
+	uint32_t freq;
+	int64_t  integ;         /* frequency correction, << 16 */
+	int      kp, ki;
+	int      lock_i, lock_q;    /* pilot in phase and quadrature, << 8 */
+	int      locked;
+	int      blend;         /* 0 mono .. 256 full separation */
+	/* after the matrix */
+	int      deemph_a;      /* 1 - exp(-1/(rate * tau)), << 16, 0 for off */
+	int      deemph_l, deemph_r;    /* << 8 */
+	int16_t  *sum;
+	int16_t  *diff;
+	int      buf_len;
+	struct resampler rs_sum;
+	struct resampler rs_diff;
+};
+
+/*!
+ * Shared sine table for the numerically controlled oscillators
+ *
+ * \return NCO_SIZE entries of sin, 32767 == 1.0
+ */
+
+extern const int16_t *nco_table(void);
+
+/*!
+ * Set up the decoder, state is cleared
+ *
+ * \param st decoder, zeroed or from an earlier stereo_init()
+ * \param rate_in multiplex (discriminator output) sample rate
+ * \param rate_out audio sample rate, per channel
+ * \param deemph_us de-emphasis time constant, 0 for off
+ * \return 0 on success, -1 if the rate is too low for stereo (mono out)
+ */
+
+extern int stereo_init(struct stereo_decoder *st, int rate_in, int rate_out, int deemph_us);
+
+/*!
+ * Decode one block of multiplex in place
+ *
+ * \param st decoder from stereo_init()
+ * \param buf multiplex in, interleaved L/R out
+ * \param len number of multiplex samples
+ * \param max_len room in buf, in int16
+ * \return number of int16 values in buf (2 per audio sample)
+ */
+
+extern int stereo_process(struct stereo_decoder *st, int16_t *buf, int len, int max_len);
+
+#endif /* #ifndef __RTL_FM_STEREO_H */
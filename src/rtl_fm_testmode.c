@@ -0,0 +1,135 @@
+/*
+ * Dropped sample detection with the RTL2832 test counter
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "rtl_fm_stamp.h"
+#include "rtl_fm_testmode.h"
+
+/* the rates the tuner takes, 2.56M and up are past what most hosts carry */
+static const uint32_t testmode_rates[] = {
+	1024000, 1400000, 1800000, 1920000, 2048000, 2400000, 2560000, 2800000, 3200000};
+
+struct sweep_ctx
+{
+	rtlsdr_dev_t *dev;
+	uint32_t rate;
+	uint64_t end_ns;
+	struct counter_check c;
+};
+
+uint64_t counter_check_block(struct counter_check *c, const unsigned char *buf,
+	uint32_t len, uint32_t rate, uint64_t now_ns)
+/* one pass the compiler vectorises, byte by byte only where it broke */
+{
+	uint64_t lost = 0, gap;
+	uint32_t i;
+	uint8_t n, bad = 0;
+	if (!len) {
+		return 0;}
+	c->transfer_ns = rate ? 1000000000ULL * (len / 2) / rate : 0;
+	if (c->transfers) {
+		gap = now_ns - c->last_ns;
+		if (gap > c->max_gap_ns) {
+			c->max_gap_ns = gap;}
+		if (c->transfer_ns && gap > TESTMODE_GAP * c->transfer_ns) {
+			c->gaps++;}
+	}
+	c->last_ns = now_ns;
+	c->transfers++;
+	c->bytes += len;
+	if (!c->started) {
+		c->next = buf[0];
+		c->started = 1;
+	}
+	n = c->next;
+	for (i = 0; i < len; i++) {
+		bad |= buf[i] ^ (uint8_t)(n + i);}
+	if (!bad) {
+		c->next = (uint8_t)(n + len);
+		return 0;
+	}
+	/* the counter only runs forward, a jump back is a wrap */
+	for (i = 0; i < len; i++, n++) {
+		if (buf[i] != n) {
+			lost += (uint8_t)(buf[i] - n);
+			c->breaks++;
+			n = buf[i];
+		}
+	}
+	c->next = n;
+	c->lost += lost;
+	return lost;
+}
+
+void counter_check_print(const struct counter_check *c)
+{
+	fprintf(stderr, "testmode   transfers: %llu, samples: %llu, lost at least %llu in %llu places\n",
+		(unsigned long long)c->transfers, (unsigned long long)(c->bytes / 2),
+		(unsigned long long)(c->lost / 2), (unsigned long long)c->breaks);
+	fprintf(stderr, "testmode   usb gaps: %llu over %ix a transfer (%.1f ms), longest %.1f ms\n",
+		(unsigned long long)c->gaps, TESTMODE_GAP, c->transfer_ns / 1e6, c->max_gap_ns / 1e6);
+}
+
+static void sweep_callback(unsigned char *buf, uint32_t len, void *ctx)
+{
+	struct sweep_ctx *s = (struct sweep_ctx*)ctx;
+	uint64_t now = stamp_now_ns();
+	counter_check_block(&s->c, buf, len, s->rate, now);
+	if (now >= s->end_ns) {
+		rtlsdr_cancel_async(s->dev);}
+}
+
+uint32_t testmode_sweep(rtlsdr_dev_t *dev, uint32_t buf_num, uint32_t buf_len)
+/* the highest rate is the last one below the first that lost samples,
+   a rate above that which happens to pass is not counted on */
+{
+	struct sweep_ctx s;
+	uint32_t best = 0;
+	int i, failed = 0;
+	fprintf(stderr, "testmode sweep, %i s a rate\n", TESTMODE_SECS);
+	fprintf(stderr, "%10s %12s %10s %7s %6s %10s\n", "rate", "samples", "lost", "breaks", "gaps", "longest ms");
+	for (i = 0; i < (int)(sizeof(testmode_rates) / sizeof(testmode_rates[0])); i++) {
+		memset(&s, 0, sizeof(s));
+		s.dev = dev;
+		if (rtlsdr_set_sample_rate(dev, testmode_rates[i]) < 0) {
+			fprintf(stderr, "%10u not taken\n", testmode_rates[i]);
+			continue;
+		}
+		s.rate = rtlsdr_get_sample_rate(dev);
+		rtlsdr_set_testmode(dev, 1);
+		rtlsdr_reset_buffer(dev);
+		s.end_ns = stamp_now_ns() + TESTMODE_SECS * 1000000000ULL;
+		rtlsdr_read_async(dev, sweep_callback, &s, buf_num, buf_len);
+		fprintf(stderr, "%10u %12llu %10llu %7llu %6llu %10.1f\n", s.rate,
+			(unsigned long long)(s.c.bytes / 2), (unsigned long long)(s.c.lost / 2),
+			(unsigned long long)s.c.breaks, (unsigned long long)s.c.gaps, s.c.max_gap_ns / 1e6);
+		if (!s.c.transfers || s.c.lost) {
+			failed = 1;
+		} else if (!failed) {
+			best = s.rate;
+		}
+	}
+	rtlsdr_set_testmode(dev, 0);
+	if (best) {
+		fprintf(stderr, "testmode sweep: up to %u S/s without a dropped sample\n", best);
+	} else {
+		fprintf(stderr, "testmode sweep: samples dropped at every rate\n");
+	}
+	return best;
+}
@@ -0,0 +1,83 @@
+/*
+ * Dropped sample detection with the RTL2832 test counter
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * In test mode the chip sends an 8 bit counter instead of samples, one
+ * count a byte, running on across transfers.  Where it jumps the bytes
+ * in between never reached us: the chip's fifo overran because the
+ * host did not take the transfers fast enough.  A loss of a multiple
+ * of 256 bytes cannot be told from none, so the counts are "at least",
+ * as with rtl_test -t.
+ *
+ * -E testmode runs the radio on the counter and checks every transfer
+ * in rtlsdr_callback(), through the whole pipeline at its rate, and
+ * reports at exit.  -E testsweep only reads the dongle, each rate of
+ * testmode_rates[] for TESTMODE_SECS, and exits with the highest rate
+ * that lost nothing, what this board and hub can carry.
+ */
+
+#ifndef __RTL_FM_TESTMODE_H
+#define __RTL_FM_TESTMODE_H
+
+#include <stdint.h>
+#include "rtl-sdr.h"
+
+#define TESTMODE_SECS		5
+/* a transfer later than this many transfer times is a usb gap */
+#define TESTMODE_GAP		2
+
+struct counter_check
+{
+	uint8_t  next;              /* the count expected next */
+	int      started;
+	uint64_t transfers;
+	uint64_t bytes;
+	uint64_t lost;              /* bytes, at least */
+	uint64_t breaks;            /* places the count jumped */
+	uint64_t gaps;
+	uint64_t last_ns;
+	uint64_t max_gap_ns;        /* longest between two transfers */
+	uint64_t transfer_ns;       /* what the last transfer held */
+};
+
+/*!
+ * Check a transfer of test counter bytes
+ *
+ * \param rate iq pairs a second, what a transfer's time is taken from
+ * \param now_ns its arrival
+ * \return bytes lost before and inside it, at least
+ */
+
+extern uint64_t counter_check_block(struct counter_check *c, const unsigned char *buf,
+	uint32_t len, uint32_t rate, uint64_t now_ns);
+
+/*!
+ * Print the totals
+ */
+
+extern void counter_check_print(const struct counter_check *c);
+
+/*!
+ * Read the counter at each rate in turn, test mode is off after
+ *
+ * \param buf_num buf_len as for rtlsdr_read_async(), 0 for its defaults
+ * \return the highest rate that lost nothing, 0 if none
+ */
+
+extern uint32_t testmode_sweep(rtlsdr_dev_t *dev, uint32_t buf_num, uint32_t buf_len);
+
+#endif /* #ifndef __RTL_FM_TESTMODE_H */
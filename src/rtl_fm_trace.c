@@ -0,0 +1,186 @@
+/*
+ * Timeline of pipeline events, dumped as Chrome trace JSON
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "rtl_fm_stamp.h"
+#include "rtl_fm_trace.h"
+
+int trace_on = 0;
+
+static __thread struct trace_buf *trace_tls;
+static struct trace_buf *trace_bufs[TRACE_MAX_THREADS];
+static int trace_nbufs;
+static const char *trace_file;
+static pthread_t trace_dumper;
+static int trace_closing;
+
+void trace_record(const char *name, char ph)
+/* the event first, then head, the dump never reads past head */
+{
+	struct trace_buf *b = trace_tls;
+	struct trace_event *e;
+	if (!b) {
+		return;}
+	e = &b->ev[b->head & (TRACE_EVENTS - 1)];
+	e->ts_ns = stamp_now_ns();
+	e->name = name;
+	e->ph = ph;
+	__atomic_store_n(&b->head, b->head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_thread(const char *name)
+{
+	struct trace_buf *b;
+	int i;
+	if (!trace_on || trace_tls) {
+		return;}
+	b = (struct trace_buf*)calloc(1, sizeof(struct trace_buf));
+	if (!b) {
+		return;}
+	i = __atomic_fetch_add(&trace_nbufs, 1, __ATOMIC_RELAXED);
+	if (i >= TRACE_MAX_THREADS) {
+		fprintf(stderr, "trace: more than %i threads, %s not traced\n", TRACE_MAX_THREADS, name);
+		free(b);
+		return;
+	}
+	b->tid = (int)syscall(SYS_gettid);
+	snprintf(b->name, sizeof(b->name), "%s", name);
+	__atomic_store_n(&trace_bufs[i], b, __ATOMIC_RELEASE);
+	trace_tls = b;
+}
+
+static void trace_write_buf(FILE *f, const struct trace_buf *b, struct trace_event *copy,
+	int pid, int *first)
+/* copy out what is there, then drop what the thread wrote over meanwhile */
+{
+	uint32_t head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+	uint32_t base = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+	uint32_t i, after;
+	const struct trace_event *e;
+	for (i = base; i < head; i++) {
+		copy[i - base] = b->ev[i & (TRACE_EVENTS - 1)];}
+	after = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+	/* event after may be half written, in the slot of after - TRACE_EVENTS */
+	i = after >= TRACE_EVENTS && after - TRACE_EVENTS + 1 > base ? after - TRACE_EVENTS + 1 : base;
+	fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%i,\"tid\":%i,"
+		"\"args\":{\"name\":\"%s\"}}", *first ? "" : ",", pid, b->tid, b->name);
+	*first = 0;
+	for (; i < head; i++) {
+		e = &copy[i - base];
+		fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":%i,\"tid\":%i,\"ts\":%llu.%03u%s}",
+			e->name, e->ph, pid, b->tid,
+			(unsigned long long)(e->ts_ns / 1000), (unsigned int)(e->ts_ns % 1000),
+			e->ph == 'i' ? ",\"s\":\"t\"" : "");
+	}
+}
+
+int trace_dump(void)
+{
+	char tmp[4096];
+	struct trace_event *copy;
+	struct trace_buf *b;
+	FILE *f;
+	int i, n, first = 1, pid = getpid();
+	if (!trace_file) {
+		return -1;}
+	copy = (struct trace_event*)malloc(TRACE_EVENTS * sizeof(struct trace_event));
+	snprintf(tmp, sizeof(tmp), "%s.tmp", trace_file);
+	f = fopen(tmp, "w");
+	if (!copy || !f) {
+		fprintf(stderr, "trace: %s: %s\n", tmp, strerror(errno));
+		free(copy);
+		if (f) {
+			fclose(f);}
+		return -1;
+	}
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	n = __atomic_load_n(&trace_nbufs, __ATOMIC_ACQUIRE);
+	if (n > TRACE_MAX_THREADS) {
+		n = TRACE_MAX_THREADS;}
+	for (i = 0; i < n; i++) {
+		b = __atomic_load_n(&trace_bufs[i], __ATOMIC_ACQUIRE);
+		if (b) {
+			trace_write_buf(f, b, copy, pid, &first);}
+	}
+	fprintf(f, "\n]}\n");
+	free(copy);
+	/* a viewer never sees half a file */
+	if (fclose(f) != 0 || rename(tmp, trace_file) < 0) {
+		fprintf(stderr, "trace: %s: %s\n", trace_file, strerror(errno));
+		return -1;
+	}
+	fprintf(stderr, "trace: %s written\n", trace_file);
+	return 0;
+}
+
+static void *trace_dump_fn(void *arg)
+{
+	sigset_t *set = (sigset_t*)arg;
+	int sig;
+	while (!sigwait(set, &sig)) {
+		if (__atomic_load_n(&trace_closing, __ATOMIC_ACQUIRE)) {
+			break;}
+		trace_dump();
+	}
+	return 0;
+}
+
+int trace_open(const char *filename)
+/* the dump thread starts with every signal blocked, another helper's
+   SIGUSR1 is never delivered to it, and waits for SIGUSR2 alone */
+{
+	static sigset_t set;
+	sigset_t all, old;
+	int r;
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR2);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+	trace_file = filename;
+	trace_on = 1;
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	r = pthread_create(&trace_dumper, NULL, trace_dump_fn, &set);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (r) {
+		fprintf(stderr, "trace: no dump thread\n");
+		trace_on = 0;
+		return -1;
+	}
+	trace_thread("main");
+	fprintf(stderr, "trace: to %s on exit and on kill -USR2 %i\n", filename, (int)getpid());
+	return 0;
+}
+
+void trace_close(void)
+/* the rings stay, a thread not joined yet may still hold one */
+{
+	if (!trace_on) {
+		return;}
+	__atomic_store_n(&trace_closing, 1, __ATOMIC_RELEASE);
+	pthread_kill(trace_dumper, SIGUSR2);
+	pthread_join(trace_dumper, NULL);
+	trace_on = 0;
+	trace_dump();
+}
@@ -0,0 +1,108 @@
+/*
+ * Timeline of pipeline events, dumped as Chrome trace JSON
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * -X file, every thread that calls trace_thread() gets a ring of its
+ * own events, only that thread writes it, so recording is a clock read
+ * and three stores with no lock or atomic read-modify-write.  When the
+ * ring is full the oldest events are written over, what is kept is the
+ * last TRACE_EVENTS of each thread, the seconds before a dropout.
+ *
+ * kill -USR2 writes the file from a thread that only waits for that
+ * signal, the rings keep recording meanwhile and whatever was written
+ * over while being read is left out.  The file is written again at
+ * exit.  Load it in chrome://tracing or ui.perfetto.dev.
+ *
+ * Without -X the TRACE_ macros are one load and a branch predicted not
+ * taken, -DRTL_FM_NO_TRACE takes them out altogether.
+ */
+
+#ifndef __RTL_FM_TRACE_H
+#define __RTL_FM_TRACE_H
+
+#include <stdint.h>
+
+/* per thread, 24 bytes each, 384 KB */
+#define TRACE_EVENTS		16384
+#define TRACE_MAX_THREADS	32
+#define TRACE_NAME_LEN		16
+
+struct trace_event
+{
+	uint64_t ts_ns;
+	const char *name;       /* a string literal, only the pointer is kept */
+	char     ph;            /* 'B' begin, 'E' end, 'i' instant */
+};
+
+struct trace_buf
+{
+	uint32_t head;          /* events ever recorded, written by its thread */
+	int      tid;
+	char     name[TRACE_NAME_LEN];
+	struct trace_event ev[TRACE_EVENTS];
+};
+
+extern int trace_on;
+
+extern void trace_record(const char *name, char ph);
+
+#ifdef RTL_FM_NO_TRACE
+#define TRACE_BEGIN(name)	do {} while (0)
+#define TRACE_END(name)		do {} while (0)
+#define TRACE_INSTANT(name)	do {} while (0)
+#else
+#define TRACE_BEGIN(name)	do { if (__builtin_expect(trace_on, 0)) trace_record(name, 'B'); } while (0)
+#define TRACE_END(name)		do { if (__builtin_expect(trace_on, 0)) trace_record(name, 'E'); } while (0)
+#define TRACE_INSTANT(name)	do { if (__builtin_expect(trace_on, 0)) trace_record(name, 'i'); } while (0)
+#endif
+
+/*!
+ * Start recording, before any thread that records is started.  Blocks
+ * SIGUSR2 in the caller, the threads it starts inherit that and the
+ * dump thread is the one left to take it; that one blocks every other
+ * signal.
+ *
+ * \param filename the JSON written on SIGUSR2 and at exit
+ * \return 0, -1 if the dump thread could not start
+ */
+
+extern int trace_open(const char *filename);
+
+/*!
+ * Give the calling thread a ring, nothing without -X
+ *
+ * \param name shown as the thread's name in the timeline
+ */
+
+extern void trace_thread(const char *name);
+
+/*!
+ * Write the file now
+ *
+ * \return 0, -1 if it could not be written
+ */
+
+extern int trace_dump(void);
+
+/*!
+ * Stop recording and the dump thread, write the file a last time, after
+ * the stage threads are joined
+ */
+
+extern void trace_close(void);
+
+#endif /* #ifndef __RTL_FM_TRACE_H */